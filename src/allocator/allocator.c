@@ -5,6 +5,13 @@
 #include "threading/task.h"
 #include "threading/thread.h"
 #include "tlsf/tlsf.h"
+#include "common/console.h"
+#include "common/cvar.h"
+#include "common/profiler.h"
+#include "common/sort.h"
+#include "common/stringutil.h"
+#include "ui/cimgui.h"
+#include "ui/cimgui_ext.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -17,9 +24,25 @@
 #define kTempCapacity   (256 << 20)
 #define kTlsCapacity    (16 << 20)
 
+// thread caches in front of the perm allocator, for blocks of up to
+// 1 << (kMinClassShift + kNumClasses - 1) bytes, header included.
+#define kMinClassShift  5
+#define kNumClasses     8
+#define kMaxClassBytes  (1 << (kMinClassShift + kNumClasses - 1))
+#define kCacheBytes     (64 << 10)
+// remotely freed blocks held by a cache before they are drained
+#define kRemoteDrain    256
+
+// callsites tracked by telemetry, site 0 collects any overflow
+#define kMaxSites       2048
+
+// per-thread temp arenas take chunks of this size from the frame's block
+#define kTempChunk      (256 << 10)
+
 typedef pim_alignas(kAlign) struct hdr_s
 {
-    i32 type;
+    i16 type;
+    i16 site;
     i32 userBytes;
     i32 tid;
     i32 refCount;
@@ -33,10 +56,81 @@ typedef struct linear_allocator_s
     u64 capacity;
 } linear_allocator_t;
 
+// free blocks are linked through their first user bytes
+typedef struct block_s
+{
+    struct block_s* next;
+} block_t;
+
+typedef struct magazine_s
+{
+    block_t* head;
+    i32 count;
+} magazine_t;
+
+// bump allocator over a chunk of the current frame's temp block.
+// the most recent allocation can grow in place.
+typedef struct arena_s
+{
+    u64 head;
+    u64 tail;
+    hdr_t* last;
+    i32 frame;
+} arena_t;
+
+typedef struct stat_s
+{
+    i64 bytes;
+    i64 count;
+} stat_t;
+
+// perm stats are live allocations.
+// temp stats are allocations made this frame for callsites,
+// and running totals for threads, with lastTemp taken per frame.
+typedef struct stats_s
+{
+    stat_t live[EAlloc_Count];
+    stat_t lastTemp;
+} stats_t;
+
+// size-class free lists owned by one thread.
+// refills from and returns to the tlsf pool in batches,
+// so that the perm mutex is taken once per batch instead of per block.
+typedef pim_alignas(64) struct tcache_s
+{
+    isize owner;                        // address of owning thread's token
+    block_t* remote;                    // blocks freed by other threads
+    i32 remoteCount;                    // approximate length of remote
+    magazine_t mags[kNumClasses];
+    arena_t temp;
+    stats_t stats;                      // written by the owner only
+} tcache_t;
+
+typedef struct site_s
+{
+    const char* file;
+    i32 line;
+    stats_t stats;
+} site_t;
+
 static i32 ms_tempIndex;
+static i32 ms_tempFrame;
+static i32 ms_tempFrameBytes;
+static i32 ms_tempPeakBytes;
 static mutex_t ms_perm_mtx;
 static tlsf_t ms_perm;
 static linear_allocator_t ms_temp[kTempFrames];
+static tcache_t ms_caches[kMaxThreads];
+
+static mutex_t ms_site_mtx;
+static site_t ms_sites[kMaxSites];
+static pim_alignas(64) stats_t ms_sharedStats;   // threads without a cache
+static stats_t ms_threadStats[kMaxThreads + 1];  // per frame snapshot, last is shared
+
+static cvar_t cv_alloc_sites = { cvart_bool, 0, "alloc_sites", "0", "track allocator stats per callsite, contends on shared counters" };
+
+// address is unique per live thread
+static pim_thread_local i32 ms_cacheToken;
 
 // ----------------------------------------------------------------------------
 
@@ -116,11 +210,403 @@ static void linear_clear(linear_allocator_t* alloc)
 
 // ----------------------------------------------------------------------------
 
+static u32 site_hash(const char* file, i32 line)
+{
+    u32 hash = (u32)((isize)file >> 4);
+    hash ^= (u32)line * 0x9E3779B1u;
+    return hash ^ (hash >> 16);
+}
+
+// index of the site for file:line, inserted on first use.
+// lookups are lock free, inserts are serialized.
+static i32 site_get(const char* file, i32 line)
+{
+    const u32 mask = kMaxSites - 1;
+    const u32 hash = site_hash(file, line);
+    for (u32 i = 0; i < kMaxSites; ++i)
+    {
+        const u32 j = (hash + i) & mask;
+        if (!j)
+        {
+            continue;
+        }
+        site_t* site = ms_sites + j;
+        const char* siteFile = LoadPtr(const char, site->file, MO_Acquire);
+        if (!siteFile)
+        {
+            mutex_lock(&ms_site_mtx);
+            siteFile = LoadPtr(const char, site->file, MO_Relaxed);
+            if (!siteFile)
+            {
+                site->line = line;
+                StorePtr(const char, site->file, file, MO_Release);
+                siteFile = file;
+            }
+            mutex_unlock(&ms_site_mtx);
+        }
+        if ((siteFile == file) && (site->line == line))
+        {
+            return (i32)j;
+        }
+    }
+    return 0;
+}
+
+static void stat_add(stat_t* stat, i64 bytes, i64 count)
+{
+    fetch_add_i64(&(stat->bytes), bytes, MO_Relaxed);
+    fetch_add_i64(&(stat->count), count, MO_Relaxed);
+}
+
+// only the owning thread writes, so no read-modify-write is needed
+static void stat_add_owned(stat_t* stat, i64 bytes, i64 count)
+{
+    store_i64(&(stat->bytes), load_i64(&(stat->bytes), MO_Relaxed) + bytes, MO_Relaxed);
+    store_i64(&(stat->count), load_i64(&(stat->count), MO_Relaxed) + count, MO_Relaxed);
+}
+
+static tcache_t* tcache_get(i32 tid);
+
+// thread stats go to the calling thread, which may not be the allocating
+// one, so a thread's live stats are what it allocated minus what it freed.
+static void stats_add(const hdr_t* hdr, i64 bytes, i64 count)
+{
+    tcache_t* cache = tcache_get(task_thread_id());
+    if (cache)
+    {
+        stat_add_owned(&(cache->stats.live[hdr->type]), bytes, count);
+    }
+    else
+    {
+        stat_add(&(ms_sharedStats.live[hdr->type]), bytes, count);
+    }
+    if (hdr->site >= 0)
+    {
+        stat_add(&(ms_sites[hdr->site].stats.live[hdr->type]), bytes, count);
+    }
+}
+
+static void stats_snapshot(stats_t* dst, const stats_t* src)
+{
+    stat_t temp;
+    temp.bytes = load_i64(&(src->live[EAlloc_Temp].bytes), MO_Relaxed);
+    temp.count = load_i64(&(src->live[EAlloc_Temp].count), MO_Relaxed);
+    dst->lastTemp.bytes = temp.bytes - dst->live[EAlloc_Temp].bytes;
+    dst->lastTemp.count = temp.count - dst->live[EAlloc_Temp].count;
+    dst->live[EAlloc_Temp] = temp;
+    dst->live[EAlloc_Perm].bytes = load_i64(&(src->live[EAlloc_Perm].bytes), MO_Relaxed);
+    dst->live[EAlloc_Perm].count = load_i64(&(src->live[EAlloc_Perm].count), MO_Relaxed);
+}
+
+static void stats_rollover(stats_t* stats)
+{
+    stats->lastTemp.bytes = exch_i64(&(stats->live[EAlloc_Temp].bytes), 0, MO_Relaxed);
+    stats->lastTemp.count = exch_i64(&(stats->live[EAlloc_Temp].count), 0, MO_Relaxed);
+}
+
+static void stats_frame(void)
+{
+    for (i32 i = 0; i < kMaxThreads; ++i)
+    {
+        stats_snapshot(ms_threadStats + i, &(ms_caches[i].stats));
+    }
+    stats_snapshot(ms_threadStats + kMaxThreads, &ms_sharedStats);
+    for (i32 i = 0; i < kMaxSites; ++i)
+    {
+        stats_rollover(&(ms_sites[i].stats));
+    }
+}
+
+static const char* site_name(i32 iSite)
+{
+    const char* file = ms_sites[iSite].file;
+    if (!file)
+    {
+        return "(untracked)";
+    }
+    const char* name = file;
+    for (const char* c = file; *c; ++c)
+    {
+        if ((*c == '/') || (*c == '\\'))
+        {
+            name = c + 1;
+        }
+    }
+    return name;
+}
+
+static i32 CmpTempSite(i32 lhs, i32 rhs, void* usr)
+{
+    const i64 a = ms_sites[lhs].stats.live[EAlloc_Temp].bytes;
+    const i64 b = ms_sites[rhs].stats.live[EAlloc_Temp].bytes;
+    return (a > b) ? -1 : ((a < b) ? 1 : 0);
+}
+
+// called when the temp block runs dry, names the biggest consumers
+static void log_temp_sites(i32 bytes)
+{
+    con_logf(LogSev_Error, "alloc", "temp allocator out of memory allocating %d bytes, capacity %d", bytes, kTempCapacity);
+    if (cv_alloc_sites.asFloat == 0.0f)
+    {
+        con_logf(LogSev_Error, "alloc", "set alloc_sites 1 to name the largest temp callsites");
+        return;
+    }
+
+    i32 indices[kMaxSites];
+    for (i32 i = 0; i < kMaxSites; ++i)
+    {
+        indices[i] = i;
+    }
+    sort_i32(indices, kMaxSites, CmpTempSite, NULL);
+
+    for (i32 i = 0; i < 10; ++i)
+    {
+        const site_t* site = ms_sites + indices[i];
+        const stat_t stat = site->stats.live[EAlloc_Temp];
+        if (stat.count > 0)
+        {
+            con_logf(LogSev_Error, "alloc", "%s:%d, %lld bytes in %lld allocations", site_name(indices[i]), site->line, stat.bytes, stat.count);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+static i32 class_index(i32 bytes)
+{
+    ASSERT(bytes > 0);
+    ASSERT(bytes <= kMaxClassBytes);
+    i32 i = 0;
+    while ((1 << (i + kMinClassShift)) < bytes)
+    {
+        ++i;
+    }
+    return i;
+}
+
+static i32 class_bytes(i32 iClass)
+{
+    return 1 << (iClass + kMinClassShift);
+}
+
+static i32 class_capacity(i32 iClass)
+{
+    const i32 count = kCacheBytes / class_bytes(iClass);
+    return count > 4 ? count : 4;
+}
+
+// the cache for tid, if the calling thread owns it.
+// threads outside of the task system share tid 0, only the first claims it.
+static tcache_t* tcache_get(i32 tid)
+{
+    tcache_t* cache = ms_caches + tid;
+    const isize self = (isize)&ms_cacheToken;
+    isize owner = load_isize(&(cache->owner), MO_Relaxed);
+    if (owner == self)
+    {
+        return cache;
+    }
+    if (!owner && cmpex_isize(&(cache->owner), &owner, self, MO_Acquire))
+    {
+        return cache;
+    }
+    return NULL;
+}
+
+static void tcache_trim(magazine_t* mag, i32 keep);
+
+static void tcache_drain_remote(tcache_t* cache)
+{
+    store_i32(&(cache->remoteCount), 0, MO_Relaxed);
+    block_t* block = ExchPtr(block_t, cache->remote, NULL, MO_Acquire);
+    if (block)
+    {
+        while (block)
+        {
+            block_t* next = block->next;
+            const hdr_t* hdr = (const hdr_t*)block - 1;
+            magazine_t* mag = cache->mags + class_index(hdr->userBytes + kAlign);
+            block->next = mag->head;
+            mag->head = block;
+            mag->count++;
+            block = next;
+        }
+        for (i32 i = 0; i < kNumClasses; ++i)
+        {
+            const i32 capacity = class_capacity(i);
+            if (cache->mags[i].count > capacity)
+            {
+                tcache_trim(cache->mags + i, capacity >> 1);
+            }
+        }
+    }
+}
+
+static void tcache_refill(tcache_t* cache, i32 iClass)
+{
+    tcache_drain_remote(cache);
+
+    magazine_t* mag = cache->mags + iClass;
+    if (!mag->head)
+    {
+        const i32 bytes = class_bytes(iClass);
+        const i32 batch = class_capacity(iClass) >> 1;
+        mutex_lock(&ms_perm_mtx);
+        for (i32 i = 0; i < batch; ++i)
+        {
+            hdr_t* hdr = tlsf_memalign(ms_perm, kAlign, bytes);
+            if (!hdr)
+            {
+                break;
+            }
+            block_t* block = (block_t*)(hdr + 1);
+            block->next = mag->head;
+            mag->head = block;
+            mag->count++;
+        }
+        mutex_unlock(&ms_perm_mtx);
+    }
+}
+
+// returns all but the most recent 'keep' blocks to the pool
+static void tcache_trim(magazine_t* mag, i32 keep)
+{
+    block_t* block = mag->head;
+    for (i32 i = 1; (i < keep) && block; ++i)
+    {
+        block = block->next;
+    }
+    if (block)
+    {
+        block_t* extra = block->next;
+        block->next = NULL;
+        mag->count = keep;
+
+        mutex_lock(&ms_perm_mtx);
+        while (extra)
+        {
+            block_t* next = extra->next;
+            tlsf_free(ms_perm, (hdr_t*)extra - 1);
+            extra = next;
+        }
+        mutex_unlock(&ms_perm_mtx);
+    }
+}
+
+// may round bytes up to its size class
+static hdr_t* perm_alloc(i32 tid, i32* pBytes)
+{
+    i32 bytes = *pBytes;
+    if (bytes <= kMaxClassBytes)
+    {
+        const i32 iClass = class_index(bytes);
+        bytes = class_bytes(iClass);
+        *pBytes = bytes;
+        tcache_t* cache = tcache_get(tid);
+        if (cache)
+        {
+            magazine_t* mag = cache->mags + iClass;
+            if (!mag->head)
+            {
+                tcache_refill(cache, iClass);
+            }
+            block_t* block = mag->head;
+            if (block)
+            {
+                mag->head = block->next;
+                mag->count--;
+                return (hdr_t*)block - 1;
+            }
+        }
+    }
+
+    mutex_lock(&ms_perm_mtx);
+    hdr_t* hdr = tlsf_memalign(ms_perm, kAlign, bytes);
+    mutex_unlock(&ms_perm_mtx);
+    return hdr;
+}
+
+static void perm_dealloc(hdr_t* hdr)
+{
+    const i32 bytes = hdr->userBytes + kAlign;
+    if (bytes <= kMaxClassBytes)
+    {
+        const i32 iClass = class_index(bytes);
+        ASSERT(class_bytes(iClass) == bytes);
+        block_t* block = (block_t*)(hdr + 1);
+
+        const i32 owner = hdr->tid;
+        tcache_t* cache = tcache_get(task_thread_id());
+        if (cache && (cache == ms_caches + owner))
+        {
+            magazine_t* mag = cache->mags + iClass;
+            block->next = mag->head;
+            mag->head = block;
+            mag->count++;
+            const i32 capacity = class_capacity(iClass);
+            if (mag->count > capacity)
+            {
+                tcache_trim(mag, capacity >> 1);
+            }
+            if (load_i32(&(cache->remoteCount), MO_Relaxed) > kRemoteDrain)
+            {
+                tcache_drain_remote(cache);
+            }
+            return;
+        }
+
+        // freed by another thread, hand it back to the allocating thread
+        tcache_t* ownerCache = ms_caches + owner;
+        if (load_isize(&(ownerCache->owner), MO_Relaxed))
+        {
+            block_t* head = LoadPtr(block_t, ownerCache->remote, MO_Relaxed);
+            do
+            {
+                block->next = head;
+            } while (!CmpExPtr(block_t, ownerCache->remote, head, block, MO_Release));
+            inc_i32(&(ownerCache->remoteCount), MO_Relaxed);
+            return;
+        }
+    }
+
+    mutex_lock(&ms_perm_mtx);
+    tlsf_free(ms_perm, hdr);
+    mutex_unlock(&ms_perm_mtx);
+}
+
+// returns a cache's remotely freed blocks to the pool, for owners that
+// have stopped refilling or freeing. safe from any thread, as the owner
+// also only takes the list as a whole.
+static void tcache_release_remote(tcache_t* cache)
+{
+    if (load_i32(&(cache->remoteCount), MO_Relaxed) > kRemoteDrain)
+    {
+        store_i32(&(cache->remoteCount), 0, MO_Relaxed);
+        block_t* block = ExchPtr(block_t, cache->remote, NULL, MO_Acquire);
+        if (block)
+        {
+            mutex_lock(&ms_perm_mtx);
+            while (block)
+            {
+                block_t* next = block->next;
+                tlsf_free(ms_perm, (hdr_t*)block - 1);
+                block = next;
+            }
+            mutex_unlock(&ms_perm_mtx);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 void alloc_sys_init(void)
 {
     mutex_create(&ms_perm_mtx);
+    mutex_create(&ms_site_mtx);
     ms_perm = create_tlsf(kPermCapacity);
+    cvar_reg(&cv_alloc_sites);
     ms_tempIndex = 0;
+    ms_tempFrame = 0;
     for (i32 i = 0; i < NELEM(ms_temp); ++i)
     {
         create_linear(ms_temp + i, kTempCapacity);
@@ -129,9 +615,31 @@ void alloc_sys_init(void)
 
 void alloc_sys_update(void)
 {
+    const u64 used = load_u64(&(ms_temp[ms_tempIndex].head), MO_Relaxed);
+    ms_tempFrameBytes = (i32)(used < kTempCapacity ? used : kTempCapacity);
+    ms_tempPeakBytes = ms_tempFrameBytes > ms_tempPeakBytes ?
+        ms_tempFrameBytes : ms_tempPeakBytes;
+
     const i32 i = (ms_tempIndex + 1) % kTempFrames;
     ms_tempIndex = i;
+    ++ms_tempFrame;
     linear_clear(ms_temp + i);
+    stats_frame();
+
+    for (i32 j = 0; j < kMaxThreads; ++j)
+    {
+        tcache_release_remote(ms_caches + j);
+    }
+}
+
+i32 alloc_temp_frame_bytes(void)
+{
+    return ms_tempFrameBytes;
+}
+
+i32 alloc_temp_peak_bytes(void)
+{
+    return ms_tempPeakBytes;
 }
 
 void alloc_sys_shutdown(void)
@@ -139,8 +647,10 @@ void alloc_sys_shutdown(void)
     mutex_lock(&ms_perm_mtx);
     free(ms_perm);
     ms_perm = NULL;
+    memset(ms_caches, 0, sizeof(ms_caches));
     mutex_unlock(&ms_perm_mtx);
     mutex_destroy(&ms_perm_mtx);
+    mutex_destroy(&ms_site_mtx);
 
     for (i32 i = 0; i < NELEM(ms_temp); ++i)
     {
@@ -150,7 +660,72 @@ void alloc_sys_shutdown(void)
 
 // ----------------------------------------------------------------------------
 
-void* pim_malloc(EAlloc type, i32 bytes)
+static arena_t* temp_arena(i32 tid)
+{
+    tcache_t* cache = tcache_get(tid);
+    if (!cache)
+    {
+        return NULL;
+    }
+    arena_t* arena = &(cache->temp);
+    if (arena->frame != ms_tempFrame)
+    {
+        arena->head = 0;
+        arena->tail = 0;
+        arena->last = NULL;
+        arena->frame = ms_tempFrame;
+    }
+    return arena;
+}
+
+static void* temp_alloc(i32 tid, i32 bytes)
+{
+    arena_t* arena = temp_arena(tid);
+    if (!arena)
+    {
+        return linear_alloc(ms_temp + ms_tempIndex, bytes);
+    }
+
+    if ((arena->head + bytes) > arena->tail)
+    {
+        // abandon the rest of the chunk, oversized requests get their own
+        const i32 chunk = bytes > kTempChunk ? bytes : kTempChunk;
+        u8* base = linear_alloc(ms_temp + ms_tempIndex, chunk);
+        if (!base)
+        {
+            return NULL;
+        }
+        arena->head = (u64)base;
+        arena->tail = (u64)base + chunk;
+    }
+
+    hdr_t* hdr = (hdr_t*)(arena->head);
+    arena->head += bytes;
+    arena->last = hdr;
+    return hdr;
+}
+
+// extends hdr to bytes (header included) if it is the calling thread's
+// most recent temp allocation and its chunk has room.
+static bool temp_grow(i32 tid, hdr_t* hdr, i32 bytes)
+{
+    arena_t* arena = temp_arena(tid);
+    if (arena && (arena->last == hdr))
+    {
+        const u64 tail = (u64)hdr + bytes;
+        if (tail <= arena->tail)
+        {
+            arena->head = tail;
+            hdr->userBytes = bytes - kAlign;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+
+void* _pim_malloc(EAlloc type, i32 bytes, const char* file, i32 line)
 {
     void* ptr = NULL;
     const i32 tid = task_thread_id();
@@ -168,12 +743,14 @@ void* pim_malloc(EAlloc type, i32 bytes)
             ASSERT(false);
             break;
         case EAlloc_Perm:
-            mutex_lock(&ms_perm_mtx);
-            ptr = tlsf_memalign(ms_perm, kAlign, bytes);
-            mutex_unlock(&ms_perm_mtx);
+            ptr = perm_alloc(tid, &bytes);
             break;
         case EAlloc_Temp:
-            ptr = linear_alloc(ms_temp + ms_tempIndex, bytes);
+            ptr = temp_alloc(tid, bytes);
+            if (!ptr)
+            {
+                log_temp_sites(bytes);
+            }
             break;
         }
 
@@ -183,10 +760,13 @@ void* pim_malloc(EAlloc type, i32 bytes)
         ASSERT(ptr_is_aligned(ptr));
 
         hdr_t* hdr = (hdr_t*)ptr;
-        hdr->type = type;
+        hdr->type = (i16)type;
+        // -1 is untracked, frees of blocks made while tracking still count
+        hdr->site = cv_alloc_sites.asFloat != 0.0f ? (i16)site_get(file, line) : -1;
         hdr->userBytes = userBytes;
         hdr->tid = tid;
         hdr->refCount = 1;
+        stats_add(hdr, userBytes, 1);
         ptr = hdr + 1;
 
         ASSERT(ptr_is_aligned(ptr));
@@ -218,9 +798,8 @@ void pim_free(void* ptr)
             ASSERT(false);
             break;
         case EAlloc_Perm:
-            mutex_lock(&ms_perm_mtx);
-            tlsf_free(ms_perm, hdr);
-            mutex_unlock(&ms_perm_mtx);
+            stats_add(hdr, -userBytes, -1);
+            perm_dealloc(hdr);
             break;
         case EAlloc_Temp:
             break;
@@ -228,7 +807,7 @@ void pim_free(void* ptr)
     }
 }
 
-void* pim_realloc(EAlloc type, void* prev, i32 bytes)
+void* _pim_realloc(EAlloc type, void* prev, i32 bytes, const char* file, i32 line)
 {
     ASSERT(bytes > 0);
     ASSERT(ptr_is_aligned(prev));
@@ -236,7 +815,7 @@ void* pim_realloc(EAlloc type, void* prev, i32 bytes)
     i32 prevBytes = 0;
     if (prev)
     {
-        const hdr_t* prevHdr = (const hdr_t*)prev - 1;
+        const hdr_t* prevHdr = (hdr_t*)prev - 1;
         prevBytes = prevHdr->userBytes;
 
         ASSERT(ptr_is_aligned(prevHdr));
@@ -256,16 +835,28 @@ void* pim_realloc(EAlloc type, void* prev, i32 bytes)
     nextBytes = nextBytes > 64 ? nextBytes : 64;
     nextBytes = nextBytes > bytes ? nextBytes : bytes;
 
-    void* next = pim_malloc(type, nextBytes);
+    if (prev && (type == EAlloc_Temp))
+    {
+        hdr_t* prevHdr = (hdr_t*)prev - 1;
+        if ((prevHdr->type == EAlloc_Temp) &&
+            temp_grow(task_thread_id(), prevHdr, align_bytes(nextBytes)))
+        {
+            stats_add(prevHdr, prevHdr->userBytes - prevBytes, 0);
+            IF_DEBUG(memset((u8*)prev + prevBytes, 0xcc, prevHdr->userBytes - prevBytes));
+            return prev;
+        }
+    }
+
+    void* next = _pim_malloc(type, nextBytes, file, line);
     memcpy(next, prev, prevBytes);
     pim_free(prev);
 
     return next;
 }
 
-void* pim_calloc(EAlloc type, i32 bytes)
+void* _pim_calloc(EAlloc type, i32 bytes, const char* file, i32 line)
 {
-    void* ptr = pim_malloc(type, bytes);
+    void* ptr = _pim_malloc(type, bytes, file, line);
     memset(ptr, 0x00, bytes);
     return ptr;
 }
@@ -310,3 +901,169 @@ void pim_popa(i32 bytes)
 
     ASSERT(ms_iFrame[tid] >= 0);
 }
+
+// ----------------------------------------------------------------------------
+
+typedef struct frag_s
+{
+    i64 usedBytes;
+    i64 freeBytes;
+    i64 largestFree;
+    i32 usedBlocks;
+    i32 freeBlocks;
+} frag_t;
+
+static bool ms_revSort;
+static i32 ms_cmpMode = 1;
+
+static void FragWalkFn(void* ptr, size_t size, int used, void* user)
+{
+    frag_t* frag = user;
+    if (used)
+    {
+        frag->usedBytes += size;
+        frag->usedBlocks += 1;
+    }
+    else
+    {
+        frag->freeBytes += size;
+        frag->freeBlocks += 1;
+        frag->largestFree = (i64)size > frag->largestFree ? (i64)size : frag->largestFree;
+    }
+}
+
+static i32 CmpSiteFn(i32 ilhs, i32 irhs, void* usr)
+{
+    const stats_t* lhs = &(ms_sites[ilhs].stats);
+    const stats_t* rhs = &(ms_sites[irhs].stats);
+    i64 cmp = 0;
+    switch (ms_cmpMode)
+    {
+    default:
+    case 0:
+        cmp = strcmp(site_name(ilhs), site_name(irhs));
+        cmp = cmp ? cmp : ms_sites[ilhs].line - ms_sites[irhs].line;
+        break;
+    case 1:
+        cmp = rhs->live[EAlloc_Perm].bytes - lhs->live[EAlloc_Perm].bytes;
+        break;
+    case 2:
+        cmp = rhs->live[EAlloc_Perm].count - lhs->live[EAlloc_Perm].count;
+        break;
+    case 3:
+        cmp = rhs->lastTemp.bytes - lhs->lastTemp.bytes;
+        break;
+    case 4:
+        cmp = rhs->lastTemp.count - lhs->lastTemp.count;
+        break;
+    }
+    i32 sign = (cmp > 0) - (cmp < 0);
+    return ms_revSort ? -sign : sign;
+}
+
+static bool stats_empty(const stats_t* stats)
+{
+    return !stats->live[EAlloc_Perm].count && !stats->lastTemp.count;
+}
+
+static void stats_row(const char* name, i32 line, const stats_t* stats)
+{
+    if (line > 0)
+    {
+        igText("%s:%d", name, line); igNextColumn();
+    }
+    else
+    {
+        igText("%s", name); igNextColumn();
+    }
+    igText("%lld", stats->live[EAlloc_Perm].bytes); igNextColumn();
+    igText("%lld", stats->live[EAlloc_Perm].count); igNextColumn();
+    igText("%lld", stats->lastTemp.bytes); igNextColumn();
+    igText("%lld", stats->lastTemp.count); igNextColumn();
+}
+
+ProfileMark(pm_gui, alloc_gui)
+void alloc_gui(bool* pEnabled)
+{
+    ProfileBegin(pm_gui);
+
+    if (igBegin("Allocator", pEnabled, 0))
+    {
+        const i32 tempBytes = ms_tempFrameBytes;
+        igText("Temp: %d of %d bytes last frame, peak %d", tempBytes, kTempCapacity, ms_tempPeakBytes);
+        igProgressBar((float)tempBytes / (float)kTempCapacity, (ImVec2) { -1.0f, 0.0f }, NULL);
+
+        frag_t frag = { 0 };
+        mutex_lock(&ms_perm_mtx);
+        tlsf_walk_pool(tlsf_get_pool(ms_perm), FragWalkFn, &frag);
+        mutex_unlock(&ms_perm_mtx);
+
+        const double fragmentation = frag.freeBytes > 0 ?
+            1.0 - (double)frag.largestFree / (double)frag.freeBytes : 0.0;
+        igText("Perm pool: %lld bytes in %d used blocks (thread caches included)", frag.usedBytes, frag.usedBlocks);
+        igText("Perm free: %lld bytes in %d blocks, largest %lld", frag.freeBytes, frag.freeBlocks, frag.largestFree);
+        igText("Perm fragmentation: %.2f%%", fragmentation * 100.0);
+
+        const char* const titles[] =
+        {
+            "Source",
+            "Perm Bytes",
+            "Perm Count",
+            "Temp Bytes",
+            "Temp Count",
+        };
+
+        igSeparator();
+        igText("Threads");
+        igTableHeader(NELEM(titles), titles, NULL);
+        for (i32 i = 0; i <= kMaxThreads; ++i)
+        {
+            const stats_t* stats = ms_threadStats + i;
+            if (!stats_empty(stats))
+            {
+                char name[32];
+                if (i < kMaxThreads)
+                {
+                    SPrintf(ARGS(name), "thread %d", i);
+                }
+                else
+                {
+                    SPrintf(ARGS(name), "shared");
+                }
+                stats_row(name, 0, stats);
+            }
+        }
+        igTableFooter();
+
+        igSeparator();
+        igText("Callsites");
+        bool trackSites = cv_alloc_sites.asFloat != 0.0f;
+        if (igCheckbox("Track callsites", &trackSites))
+        {
+            cvar_set_bool(&cv_alloc_sites, trackSites);
+        }
+        if (igTableHeader(NELEM(titles), titles, &ms_cmpMode))
+        {
+            ms_revSort = !ms_revSort;
+        }
+        i32* indices = tmp_malloc(sizeof(indices[0]) * kMaxSites);
+        i32 count = 0;
+        for (i32 i = 0; i < kMaxSites; ++i)
+        {
+            if (!stats_empty(&(ms_sites[i].stats)))
+            {
+                indices[count++] = i;
+            }
+        }
+        sort_i32(indices, count, CmpSiteFn, NULL);
+        for (i32 i = 0; i < count; ++i)
+        {
+            const i32 j = indices[i];
+            stats_row(site_name(j), ms_sites[j].line, &(ms_sites[j].stats));
+        }
+        igTableFooter();
+    }
+    igEnd();
+
+    ProfileEnd(pm_gui);
+}
@@ -8,44 +8,34 @@ void alloc_sys_init(void);
 void alloc_sys_update(void);
 void alloc_sys_shutdown(void);
 
-void* pim_malloc(EAlloc allocator, i32 bytes);
+// temp bytes used by the last completed frame, and the most used by any frame
+i32 alloc_temp_frame_bytes(void);
+i32 alloc_temp_peak_bytes(void);
+
+// live bytes per allocator, thread and callsite; temp usage; perm fragmentation
+void alloc_gui(bool* pEnabled);
+
+// file and line identify the callsite in allocator telemetry
+void* _pim_malloc(EAlloc allocator, i32 bytes, const char* file, i32 line);
+void* _pim_realloc(EAlloc allocator, void* prev, i32 bytes, const char* file, i32 line);
+void* _pim_calloc(EAlloc allocator, i32 bytes, const char* file, i32 line);
 void pim_free(void* ptr);
-void* pim_realloc(EAlloc allocator, void* prev, i32 bytes);
-void* pim_calloc(EAlloc allocator, i32 bytes);
+
+#define pim_malloc(allocator, bytes)        _pim_malloc((allocator), (bytes), __FILE__, __LINE__)
+#define pim_realloc(allocator, prev, bytes) _pim_realloc((allocator), (prev), (bytes), __FILE__, __LINE__)
+#define pim_calloc(allocator, bytes)        _pim_calloc((allocator), (bytes), __FILE__, __LINE__)
 
 // alternative to alloca
 void* pim_pusha(i32 bytes);
 void pim_popa(i32 bytes);
 
-static void* perm_malloc(i32 bytes)
-{
-    return pim_malloc(EAlloc_Perm, bytes);
-}
-
-static void* perm_calloc(i32 bytes)
-{
-    return pim_calloc(EAlloc_Perm, bytes);
-}
-
-static void* perm_realloc(void* prev, i32 bytes)
-{
-    return pim_realloc(EAlloc_Perm, prev, bytes);
-}
-
-static void* tmp_malloc(i32 bytes)
-{
-    return pim_malloc(EAlloc_Temp, bytes);
-}
-
-static void* tmp_realloc(void* prev, i32 bytes)
-{
-    return pim_realloc(EAlloc_Temp, prev, bytes);
-}
-
-static void* tmp_calloc(i32 bytes)
-{
-    return pim_calloc(EAlloc_Temp, bytes);
-}
+#define perm_malloc(bytes)          pim_malloc(EAlloc_Perm, (bytes))
+#define perm_calloc(bytes)          pim_calloc(EAlloc_Perm, (bytes))
+#define perm_realloc(prev, bytes)   pim_realloc(EAlloc_Perm, (prev), (bytes))
+
+#define tmp_malloc(bytes)           pim_malloc(EAlloc_Temp, (bytes))
+#define tmp_realloc(prev, bytes)    pim_realloc(EAlloc_Temp, (prev), (bytes))
+#define tmp_calloc(bytes)           pim_calloc(EAlloc_Temp, (bytes))
 
 #define ZeroElem(ptr, i)        memset((ptr) + (i), 0, sizeof((ptr)[0]))
 #define PopSwap(ptr, i, len)    memcpy((ptr) + (i), (ptr) + (len) - 1, sizeof((ptr)[0]))
@@ -25,6 +25,7 @@ extern "C" void SignalFenceRelease() { std::atomic_signal_fence(std::memory_orde
 
 extern "C" void ThreadFenceAcquire() { std::atomic_thread_fence(std::memory_order_acquire); }
 extern "C" void ThreadFenceRelease() { std::atomic_thread_fence(std::memory_order_release); }
+extern "C" void ThreadFenceSeqCst() { std::atomic_thread_fence(std::memory_order_seq_cst); }
 
 // ----------------------------------------------------------------------------
 
@@ -19,6 +19,7 @@ void SignalFenceRelease();
 
 void ThreadFenceAcquire();
 void ThreadFenceRelease();
+void ThreadFenceSeqCst();
 
 #define DECL_ATOMIC(T) \
     T load_##T(const volatile T* atom, memorder_t ord); \
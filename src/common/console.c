@@ -13,6 +13,7 @@
 
 #include <string.h>
 #include <math.h>
+#include <stdio.h>
 
 #define MAX_LINES       256
 #define MAX_HISTORY     64
@@ -224,6 +225,11 @@ void con_puts(u32 color, const char* line)
         {
             fstr_puts(ms_file, line);
         }
+        // no console window to read, echo to stdout instead
+        if (window_headless())
+        {
+            puts(line);
+        }
 
         char** lines = ms_lines;
         u32* colors = ms_colors;
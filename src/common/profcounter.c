@@ -0,0 +1,178 @@
+#include "common/profcounter.h"
+#include "common/atomics.h"
+#include "common/cvar.h"
+#include "common/profiler.h"
+#include "common/time.h"
+#include "math/scalar.h"
+#include "threading/intrin.h"
+#include "threading/task.h"
+#include "ui/cimgui.h"
+
+// id 0 is never handed out, it marks an unregistered counter
+#define kMaxCounters    128
+
+typedef struct ctrstat_s
+{
+    u64 calls;
+    u64 samples;
+    u64 ticks;
+    u64 pad;
+} ctrstat_t;
+
+static cvar_t cv_pf_counters = { cvart_bool, 0, "pf_counters", "1", "enable sampled profile counters" };
+static cvar_t cv_pf_sample = { cvart_int, 0, "pf_sample", "3", "profile counters time one of every 2^n calls" };
+
+static bool ms_enabled;
+static u64 ms_sampleMask;
+static i32 ms_count;
+static profctr_t* ms_ctrs[kMaxCounters];
+static ctrstat_t ms_stats[kMaxThreads][kMaxCounters];
+static ctrstat_t ms_totals[kMaxCounters];
+static ctrstat_t ms_frame[kMaxCounters];
+
+static u64 ms_tsc0;
+static u64 ms_time0;
+static double ms_ticksPerMs;
+
+// ----------------------------------------------------------------------------
+
+static i32 Register(profctr_t* ctr)
+{
+    i32 id = 0;
+    const i32 slot = inc_i32(&ms_count, MO_Relaxed) + 1;
+    const i32 desired = slot < kMaxCounters ? slot : -1;
+    if (cmpex_i32(&(ctr->id), &id, desired, MO_AcqRel))
+    {
+        if (desired > 0)
+        {
+            StorePtr(profctr_t, ms_ctrs[desired], ctr, MO_Release);
+        }
+        return desired;
+    }
+    // lost the race, the slot stays empty
+    return id;
+}
+
+u64 _CounterBegin(profctr_t* ctr)
+{
+    // plain read, ids only ever change from 0 to their final value
+    i32 id = ctr->id;
+    if (!id)
+    {
+        id = Register(ctr);
+    }
+    if ((id <= 0) || !ms_enabled)
+    {
+        return 0;
+    }
+    ctrstat_t* stat = &ms_stats[task_thread_id()][id];
+    const u64 calls = stat->calls++;
+    return (calls & ms_sampleMask) ? 0 : intrin_timestamp();
+}
+
+void _CounterEnd(profctr_t* ctr, u64 begin)
+{
+    if (begin)
+    {
+        const u64 end = intrin_timestamp();
+        ctrstat_t* stat = &ms_stats[task_thread_id()][ctr->id];
+        stat->samples += 1;
+        stat->ticks += end - begin;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void profctr_sys_init(void)
+{
+    cvar_reg(&cv_pf_counters);
+    cvar_reg(&cv_pf_sample);
+    ms_tsc0 = intrin_timestamp();
+    ms_time0 = time_now();
+    profctr_sys_update();
+}
+
+ProfileMark(pm_update, profctr_sys_update)
+void profctr_sys_update(void)
+{
+    ProfileBegin(pm_update);
+
+    ms_enabled = cvar_get_bool(&cv_pf_counters);
+    const i32 shift = i1_clamp((i32)cv_pf_sample.asFloat, 0, 20);
+    ms_sampleMask = (1ull << shift) - 1;
+
+    const double ms = time_milli(time_now() - ms_time0);
+    if (ms > 0.0)
+    {
+        ms_ticksPerMs = (intrin_timestamp() - ms_tsc0) / ms;
+    }
+
+    // frame deltas of the per-thread totals
+    const i32 numthreads = task_thread_ct();
+    const i32 count = i1_min(load_i32(&ms_count, MO_Relaxed) + 1, kMaxCounters);
+    for (i32 id = 1; id < count; ++id)
+    {
+        ctrstat_t total = { 0 };
+        for (i32 tid = 0; tid < numthreads; ++tid)
+        {
+            const ctrstat_t* stat = &ms_stats[tid][id];
+            total.calls += stat->calls;
+            total.samples += stat->samples;
+            total.ticks += stat->ticks;
+        }
+        ms_frame[id].calls = total.calls - ms_totals[id].calls;
+        ms_frame[id].samples = total.samples - ms_totals[id].samples;
+        ms_frame[id].ticks = total.ticks - ms_totals[id].ticks;
+        ms_totals[id] = total;
+    }
+
+    ProfileEnd(pm_update);
+}
+
+ProfileMark(pm_gui, profctr_gui)
+void profctr_gui(bool* pEnabled)
+{
+    ProfileBegin(pm_gui);
+
+    if (igBegin("Counters", pEnabled, 0))
+    {
+        igText("Sampling 1 in %llu calls", ms_sampleMask + 1);
+
+        igColumns(5);
+        {
+            igText("Name"); igNextColumn();
+            igText("Calls"); igNextColumn();
+            igText("Samples"); igNextColumn();
+            igText("Milliseconds"); igNextColumn();
+            igText("ns / call"); igNextColumn();
+
+            igSeparator();
+
+            const double ticksPerMs = ms_ticksPerMs > 0.0 ? ms_ticksPerMs : 1.0;
+            const i32 count = i1_min(load_i32(&ms_count, MO_Relaxed) + 1, kMaxCounters);
+            for (i32 id = 1; id < count; ++id)
+            {
+                const profctr_t* ctr = LoadPtr(profctr_t, ms_ctrs[id], MO_Acquire);
+                if (!ctr)
+                {
+                    continue;
+                }
+                const ctrstat_t stat = ms_frame[id];
+                // sampled time scaled up to all calls
+                const double avgTicks = stat.samples ? (double)stat.ticks / stat.samples : 0.0;
+                const double ms = (avgTicks * stat.calls) / ticksPerMs;
+                const double ns = (avgTicks / ticksPerMs) * 1000000.0;
+
+                igText("%s", ctr->name); igNextColumn();
+                igText("%llu", stat.calls); igNextColumn();
+                igText("%llu", stat.samples); igNextColumn();
+                igText("%3.3f", ms); igNextColumn();
+                igText("%3.1f", ns); igNextColumn();
+            }
+        }
+        igColumns(1);
+    }
+    igEnd();
+
+    ProfileEnd(pm_gui);
+}
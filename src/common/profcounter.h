@@ -0,0 +1,35 @@
+#pragma once
+
+#include "common/macro.h"
+
+PIM_C_BEGIN
+
+// sampled timers cheap enough for per-pixel and per-ray code.
+// no tree building or allocation, each thread accumulates into its own slots.
+typedef struct profctr_s
+{
+    const char* name;
+    i32 id;
+} profctr_t;
+
+void profctr_sys_init(void);
+void profctr_sys_update(void);
+
+void profctr_gui(bool* pEnabled);
+
+u64 _CounterBegin(profctr_t* ctr);
+void _CounterEnd(profctr_t* ctr, u64 begin);
+
+#define PIM_PROFILE_COUNTERS 1
+
+#if PIM_PROFILE_COUNTERS
+    #define ProfileCounter(var, tag)    static profctr_t var = { #tag };
+    #define CounterBegin(ctr)           _CounterBegin(&(ctr))
+    #define CounterEnd(ctr, begin)      _CounterEnd(&(ctr), (begin))
+#else
+    #define ProfileCounter(var, tag)    
+    #define CounterBegin(ctr)           0ull
+    #define CounterEnd(ctr, begin)      (void)(begin)
+#endif // PIM_PROFILE_COUNTERS
+
+PIM_C_END
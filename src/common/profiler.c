@@ -7,10 +7,20 @@
 #include "common/time.h"
 #include "common/cvar.h"
 #include "common/fnv1a.h"
+#include "math/scalar.h"
 #include "common/stringutil.h"
+#include "common/atomics.h"
+#include "common/cmd.h"
+#include "common/console.h"
 #include "containers/dict.h"
+#include "io/fstr.h"
 #include "ui/cimgui.h"
 #include <string.h>
+#include <stdlib.h>
+
+// completed marks kept per thread, for the timeline and trace export
+#define kRingCapacity   (1 << 14)
+#define kRingMask       (kRingCapacity - 1)
 
 // ----------------------------------------------------------------------------
 
@@ -26,12 +36,33 @@ typedef struct node_s
     u32 hash;
 } node_t;
 
+typedef struct event_s
+{
+    const profmark_t* mark;
+    u64 begin;
+    u64 end;
+    u32 frame;
+    i32 depth;
+} event_t;
+
+// single producer ring, written only by its thread.
+// readers validate against head after copying, to drop overwritten events.
+typedef pim_alignas(64) struct ring_s
+{
+    event_t* events;
+    u64 head;
+    i32 depth;
+} ring_t;
+
 // ----------------------------------------------------------------------------
 
 static void OnGui(void);
 static void VisitClr(node_t* node);
 static void VisitSum(node_t* node);
 static void VisitGui(const node_t* node);
+static event_t* ReadFrames(i32 tid, u32 firstFrame, u32 lastFrame, i32* countOut);
+static void TimelineGui(void);
+static cmdstat_t CmdProfileDump(i32 argc, const char** argv);
 
 // ----------------------------------------------------------------------------
 
@@ -40,6 +71,8 @@ static node_t ms_prevroots[kMaxThreads];
 static node_t ms_roots[kMaxThreads];
 static node_t* ms_top[kMaxThreads];
 
+static ring_t ms_rings[kMaxThreads];
+
 static i32 ms_avgWindow = 20;
 static dict_t ms_node_dict;
 
@@ -53,6 +86,20 @@ static void EnsureDict(void)
     }
 }
 
+void profile_sys_init(void)
+{
+    cmd_reg("profile_dump", CmdProfileDump);
+}
+
+void profile_sys_shutdown(void)
+{
+    for (i32 i = 0; i < kMaxThreads; ++i)
+    {
+        pim_free(ms_rings[i].events);
+        ms_rings[i].events = NULL;
+    }
+}
+
 ProfileMark(pm_gui, profile_gui)
 void profile_gui(bool* pEnabled)
 {
@@ -63,6 +110,13 @@ void profile_gui(bool* pEnabled)
     {
         igSliderInt("avg over # frames", &ms_avgWindow, 1, 1000, "%d");
 
+        if (igCollapsingHeader1("Timeline"))
+        {
+            TimelineGui();
+        }
+
+        // worker trees live in their own temp arenas and are swapped
+        // without synchronization; per-thread data is in the timeline.
         node_t* root = ms_prevroots[0].fchild;
 
         igSeparator();
@@ -101,6 +155,8 @@ void _ProfileBegin(profmark_t* mark)
         ms_roots[tid] = (node_t){ 0 };
         ms_frame[tid] = frame;
         ms_top[tid] = NULL;
+        // unbalanced marks must not skew the nesting of later frames
+        ms_rings[tid].depth = 0;
     }
 
     node_t* top = ms_top[tid];
@@ -122,6 +178,7 @@ void _ProfileBegin(profmark_t* mark)
     }
     top->lchild = next;
     ms_top[tid] = next;
+    ms_rings[tid].depth += 1;
 
     next->begin = time_now();
 }
@@ -144,6 +201,23 @@ void _ProfileEnd(profmark_t* mark)
 
     top->end = end;
     ms_top[tid] = top->parent;
+
+    ring_t* ring = ms_rings + tid;
+    ring->depth -= 1;
+    event_t* events = ring->events;
+    if (!events)
+    {
+        events = perm_calloc(sizeof(events[0]) * kRingCapacity);
+        StorePtr(event_t, ring->events, events, MO_Release);
+    }
+    const u64 head = ring->head;
+    event_t* evt = events + (head & kRingMask);
+    evt->mark = mark;
+    evt->begin = top->begin;
+    evt->end = end;
+    evt->frame = ms_frame[tid];
+    evt->depth = ring->depth;
+    store_u64(&(ring->head), head + 1, MO_Release);
 }
 
 // ----------------------------------------------------------------------------
@@ -274,8 +348,276 @@ static void VisitGui(const node_t* node)
     VisitGui(node->sibling);
 }
 
+// ----------------------------------------------------------------------------
+
+// events of frames [firstFrame, lastFrame] still held by tid's ring
+static event_t* ReadFrames(i32 tid, u32 firstFrame, u32 lastFrame, i32* countOut)
+{
+    ring_t* ring = ms_rings + tid;
+    *countOut = 0;
+
+    const event_t* events = LoadPtr(event_t, ring->events, MO_Acquire);
+    if (!events)
+    {
+        return NULL;
+    }
+
+    const u64 head = load_u64(&(ring->head), MO_Acquire);
+    const u64 tail = head > kRingCapacity ? head - kRingCapacity : 0;
+    const i32 len = (i32)(head - tail);
+    event_t* copy = tmp_malloc(sizeof(copy[0]) * len);
+    for (i32 i = 0; i < len; ++i)
+    {
+        copy[i] = events[(tail + i) & kRingMask];
+    }
+
+    // anything the owner wrapped over while copying is torn, including
+    // the unpublished slot at head2, which overwrites index head2 - capacity
+    const u64 head2 = load_u64(&(ring->head), MO_Acquire);
+    const u64 keep = head2 >= kRingCapacity ? head2 - kRingCapacity + 1 : 0;
+    i32 first = 0;
+    if (keep > tail)
+    {
+        first = (keep - tail) < (u64)len ? (i32)(keep - tail) : len;
+    }
+
+    i32 count = 0;
+    for (i32 i = first; i < len; ++i)
+    {
+        const u32 frame = copy[i].frame;
+        if ((frame >= firstFrame) && (frame <= lastFrame))
+        {
+            copy[count++] = copy[i];
+        }
+    }
+
+    *countOut = count;
+    return copy;
+}
+
+static u32 MarkColor(const profmark_t* mark)
+{
+    u32 hash = mark->hash ? mark->hash : HashStr(mark->name);
+    float r, g, b;
+    igColorConvertHSVtoRGB((hash & 0xffff) / 65535.0f, 0.6f, 0.8f, &r, &g, &b);
+    return igColorConvertFloat4ToU32((ImVec4) { r, g, b, 1.0f });
+}
+
+typedef struct occupancy_s
+{
+    const profmark_t* mark;
+    u64 sum;
+    u64 threads;
+} occupancy_t;
+
+static void TimelineGui(void)
+{
+    const u32 frame = time_framecount() - 1;
+    const i32 numthreads = task_thread_ct();
+
+    event_t** threadEvents = tmp_calloc(sizeof(threadEvents[0]) * numthreads);
+    i32* threadCounts = tmp_calloc(sizeof(threadCounts[0]) * numthreads);
+
+    u64 t0 = ~0ull;
+    u64 t1 = 0;
+    for (i32 tid = 0; tid < numthreads; ++tid)
+    {
+        threadEvents[tid] = ReadFrames(tid, frame, frame, &threadCounts[tid]);
+        for (i32 i = 0; i < threadCounts[tid]; ++i)
+        {
+            const event_t* evt = &threadEvents[tid][i];
+            t0 = evt->begin < t0 ? evt->begin : t0;
+            t1 = evt->end > t1 ? evt->end : t1;
+        }
+    }
+    if (t1 <= t0)
+    {
+        igText("No events");
+        return;
+    }
+
+    const double frameMs = time_milli(t1 - t0);
+    igText("Frame %u: %.3f ms", frame, frameMs);
+
+    ImVec2 origin;
+    igGetCursorScreenPos(&origin);
+    ImVec2 avail;
+    igGetContentRegionAvail(&avail);
+
+    const float labelWidth = 64.0f;
+    const float rowHeight = igGetTextLineHeight() + 2.0f;
+    const float width = avail.x - labelWidth > 64.0f ? avail.x - labelWidth : 64.0f;
+    const double scale = width / (double)(t1 - t0);
+    ImDrawList* drawList = igGetWindowDrawList();
+    const u32 textColor = igGetColorU32Col(ImGuiCol_Text, 1.0f);
+
+    occupancy_t* marks = NULL;
+    i32 markCount = 0;
+
+    float y = origin.y;
+    for (i32 tid = 0; tid < numthreads; ++tid)
+    {
+        const event_t* events = threadEvents[tid];
+        const i32 count = threadCounts[tid];
+        if (!count)
+        {
+            continue;
+        }
+
+        char label[32];
+        SPrintf(ARGS(label), tid ? "worker %d" : "main", tid);
+        ImDrawList_AddTextVec2(drawList, (ImVec2) { origin.x, y }, textColor, label, NULL);
+
+        i32 maxDepth = 0;
+        for (i32 i = 0; i < count; ++i)
+        {
+            const event_t* evt = events + i;
+            maxDepth = evt->depth > maxDepth ? evt->depth : maxDepth;
+
+            const float x0 = origin.x + labelWidth + (float)((evt->begin - t0) * scale);
+            const float x1 = origin.x + labelWidth + (float)((evt->end - t0) * scale);
+            const ImVec2 lo = { x0, y + evt->depth * rowHeight };
+            const ImVec2 hi = { (x1 - x0) < 1.0f ? x0 + 1.0f : x1, lo.y + rowHeight - 1.0f };
+            ImDrawList_AddRectFilled(drawList, lo, hi, MarkColor(evt->mark), 0.0f, 0);
+
+            const char* name = evt->mark->name;
+            ImVec2 textSize;
+            igCalcTextSize(&textSize, name, NULL, false, -1.0f);
+            if (textSize.x < (hi.x - lo.x))
+            {
+                ImDrawList_AddTextVec2(drawList, lo, 0xff000000, name, NULL);
+            }
+            if (igIsMouseHoveringRect(lo, hi, true))
+            {
+                igSetTooltip("%s\n%.3f ms", name, time_milli(evt->end - evt->begin));
+            }
+
+            i32 j = 0;
+            for (; j < markCount; ++j)
+            {
+                if (marks[j].mark == evt->mark)
+                {
+                    break;
+                }
+            }
+            if (j == markCount)
+            {
+                ++markCount;
+                marks = tmp_realloc(marks, sizeof(marks[0]) * markCount);
+                marks[j] = (occupancy_t){ evt->mark };
+            }
+            marks[j].sum += evt->end - evt->begin;
+            marks[j].threads |= 1ull << (tid & 63);
+        }
+        y += (maxDepth + 1) * rowHeight + 4.0f;
+    }
+    igDummy((ImVec2) { avail.x, y - origin.y });
+
+    // sum of time inside each mark over frame time, the average number of busy threads
+    igColumns(4);
+    igText("Mark"); igNextColumn();
+    igText("Total ms"); igNextColumn();
+    igText("Threads"); igNextColumn();
+    igText("Avg Busy"); igNextColumn();
+    igSeparator();
+    for (i32 i = 0; i < markCount; ++i)
+    {
+        const double ms = time_milli(marks[i].sum);
+        u64 threads = marks[i].threads;
+        i32 threadCount = 0;
+        for (; threads; threads &= threads - 1)
+        {
+            ++threadCount;
+        }
+        igText("%s", marks[i].mark->name); igNextColumn();
+        igText("%3.2f", ms); igNextColumn();
+        igText("%d", threadCount); igNextColumn();
+        igText("%.2f", ms / frameMs); igNextColumn();
+    }
+    igColumns(1);
+}
+
+// ----------------------------------------------------------------------------
+
+// writes the last N frames of every thread in chrome://tracing json format
+static cmdstat_t CmdProfileDump(i32 argc, const char** argv)
+{
+    i32 frames = 1;
+    if (argc > 1)
+    {
+        frames = atoi(argv[1]);
+        if (frames <= 0)
+        {
+            con_logf(LogSev_Error, "prof", "invalid frame count '%s'", argv[1]);
+            return cmdstat_err;
+        }
+    }
+
+    const u32 lastFrame = time_framecount() - 1;
+    const u32 firstFrame = lastFrame >= (u32)frames ? lastFrame - (frames - 1) : 0;
+
+    char filename[PIM_PATH] = { 0 };
+    if (argc > 2)
+    {
+        StrCpy(ARGS(filename), argv[2]);
+    }
+    else
+    {
+        SPrintf(ARGS(filename), "profile_%u.json", lastFrame);
+    }
+
+    fstr_t file = fstr_open(filename, "wb");
+    if (!fstr_isopen(file))
+    {
+        con_logf(LogSev_Error, "prof", "failed to open '%s'", filename);
+        return cmdstat_err;
+    }
+
+    const u64 start = time_appstart();
+    i32 written = 0;
+    char line[512];
+    fstr_puts(file, "{\"traceEvents\":[\n");
+    for (i32 tid = 0; tid < kMaxThreads; ++tid)
+    {
+        i32 count = 0;
+        const event_t* events = ReadFrames(tid, firstFrame, lastFrame, &count);
+        if (!count)
+        {
+            continue;
+        }
+
+        SPrintf(ARGS(line),
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+            written ? ",\n" : "", tid, tid ? "worker" : "main", tid);
+        fstr_puts(file, line);
+        ++written;
+
+        for (i32 i = 0; i < count; ++i)
+        {
+            const event_t* evt = events + i;
+            SPrintf(ARGS(line),
+                ",\n{\"name\":\"%s\",\"cat\":\"pim\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+                evt->mark->name,
+                tid,
+                time_micro(evt->begin - start),
+                time_micro(evt->end - evt->begin),
+                evt->frame);
+            fstr_puts(file, line);
+            ++written;
+        }
+    }
+    fstr_puts(file, "\n]}\n");
+    fstr_close(&file);
+
+    con_logf(LogSev_Info, "prof", "wrote %d events from frames %u to %u to '%s'", written, firstFrame, lastFrame, filename);
+    return cmdstat_ok;
+}
+
 #else
 
+void profile_sys_init(void) {}
+void profile_sys_shutdown(void) {}
+
 void profile_gui(bool* pEnabled) {}
 
 void _ProfileBegin(profmark_t* mark) {}
@@ -12,6 +12,9 @@ typedef struct profmrk_s
     u64 sum;
 } profmark_t;
 
+void profile_sys_init(void);
+void profile_sys_shutdown(void);
+
 void profile_gui(bool* pEnabled);
 
 void _ProfileBegin(profmark_t* mark);
@@ -1,5 +1,7 @@
 #include "editor/menubar.h"
 #include "common/profiler.h"
+#include "common/profcounter.h"
+#include "allocator/allocator.h"
 #include "ui/cimgui.h"
 #include "rendering/r_window.h"
 #include "common/cvar.h"
@@ -32,6 +34,8 @@ static edwin_t ms_windows[] =
     { "CVars", false, cvar_gui },
     { "Assets", false, asset_gui },
     { "Profiler", false, profile_gui },
+    { "Counters", false, profctr_gui },
+    { "Allocator", false, alloc_gui },
     { "Renderer", false, render_sys_gui },
     { "Textures", false, texture_sys_gui },
     { "Meshes", false, mesh_sys_gui },
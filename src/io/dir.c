@@ -1,5 +1,6 @@
 #include "io/dir.h"
 
+#include <Windows.h>
 #include <direct.h>
 #include <io.h>
 
@@ -64,6 +65,14 @@ void pim_rmdir(const char* path)
     IsZero(_rmdir(path));
 }
 
+void pim_rename(const char* src, const char* dst)
+{
+    ASSERT(src);
+    ASSERT(dst);
+    const DWORD flags = MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH;
+    IsZero(!MoveFileExA(src, dst, flags));
+}
+
 void pim_chmod(const char* path, i32 flags)
 {
     ASSERT(path);
@@ -10,6 +10,8 @@ void pim_getcwd(char* dst, i32 size);
 void pim_chdir(const char* path);
 void pim_mkdir(const char* path);
 void pim_rmdir(const char* path);
+// replaces dst with src in one step, readers see either the old or new file
+void pim_rename(const char* src, const char* dst);
 
 typedef enum
 {
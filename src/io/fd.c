@@ -132,6 +132,12 @@ i32 fd_tell(fd_t fd)
     return NotNeg((i32)_tell(fd.handle));
 }
 
+i32 fd_sync(fd_t fd)
+{
+    ASSERT(fd.handle >= 0);
+    return IsZero(_commit(fd.handle));
+}
+
 void fd_pipe(fd_t* fd0, fd_t* fd1, i32 bufferSize)
 {
     ASSERT(fd0);
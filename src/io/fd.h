@@ -49,6 +49,8 @@ i32 fd_printf(fd_t hdl, const char* fmt, ...);
 
 i32 fd_seek(fd_t hdl, i32 offset);
 i32 fd_tell(fd_t hdl);
+// commits written data to disk, 0 on success
+i32 fd_sync(fd_t hdl);
 
 void fd_pipe(fd_t* p0, fd_t* p1, i32 bufferSize);
 void fd_stat(fd_t hdl, fd_status_t* status);
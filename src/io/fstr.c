@@ -56,6 +56,17 @@ void fstr_flush(fstr_t stream)
     IsZero(fflush(file));
 }
 
+i32 fstr_sync(fstr_t stream)
+{
+    FILE* file = stream.handle;
+    ASSERT(file);
+    if (IsZero(fflush(file)))
+    {
+        return -1;
+    }
+    return fd_sync(fstr_to_fd(stream));
+}
+
 i32 fstr_read(fstr_t stream, void* dst, i32 size)
 {
     FILE* file = stream.handle;
@@ -12,6 +12,8 @@ static i32 fstr_isopen(fstr_t fstr) { return fstr.handle != NULL; }
 fstr_t fstr_open(const char* filename, const char* mode);
 void fstr_close(fstr_t* stream);
 void fstr_flush(fstr_t stream);
+// flushes and commits written data to disk, 0 on success
+i32 fstr_sync(fstr_t stream);
 i32 fstr_read(fstr_t stream, void* dst, i32 size);
 i32 fstr_write(fstr_t stream, const void* src, i32 size);
 void fstr_gets(fstr_t stream, char* dst, i32 size);
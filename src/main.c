@@ -11,19 +11,30 @@
 #include "os/socket.h"
 #include "logic/logic.h"
 #include "common/profiler.h"
+#include "common/profcounter.h"
 #include "common/cvar.h"
 #include "common/cmd.h"
 #include "common/console.h"
 #include "editor/editor.h"
+#include "common/stringutil.h"
 
 static void Init(void);
 static void Update(void);
 static void Shutdown(void);
 static void OnGui(void);
+static void ParseArgs(i32 argc, char** argv);
 
-int main()
+// -headless: skips the window, gl, vulkan, input, ui, audio and editor.
+// intended for bake nodes and perf runs, which drive pim through +commands.
+static bool ms_headless;
+// console lines from +command arguments, run once every system is up
+static char ms_argCmds[4096];
+
+int main(int argc, char** argv)
 {
+    ParseArgs(argc, argv);
     Init();
+    cmd_text(ms_argCmds);
     while (window_is_open())
     {
         Update();
@@ -32,35 +43,84 @@ int main()
     return 0;
 }
 
+// Quake style command line:
+//  pim -headless +mapload e1m1 +lm_gen 1 +wait 1000 +mapsave e1m1 +quit
+// each +name starts a console line, the following plain arguments are its
+// parameters.
+static void ParseArgs(i32 argc, char** argv)
+{
+    ms_headless = false;
+    ms_argCmds[0] = 0;
+    bool inCmd = false;
+    for (i32 i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (!arg || !arg[0])
+        {
+            continue;
+        }
+        if (arg[0] == '+')
+        {
+            if (inCmd)
+            {
+                StrCat(ARGS(ms_argCmds), "\n");
+            }
+            StrCat(ARGS(ms_argCmds), arg + 1);
+            inCmd = true;
+        }
+        else if (arg[0] == '-')
+        {
+            if (StrICmp(arg, PIM_PATH, "-headless") == 0)
+            {
+                ms_headless = true;
+            }
+            inCmd = false;
+        }
+        else if (inCmd)
+        {
+            StrCatf(ARGS(ms_argCmds), " \"%s\"", arg);
+        }
+    }
+}
+
 static void Init(void)
 {
     time_sys_init();            // setup sokol time
     alloc_sys_init();           // preallocate pools
-    window_sys_init();          // gl context, window
+    window_sys_init(ms_headless);   // gl context, window
     cmd_sys_init();
     con_sys_init();
+    profile_sys_init();
+    profctr_sys_init();
     task_sys_init();            // enable async work
     asset_sys_init();           // means of loading data
     network_sys_init();         // setup sockets
     render_sys_init();          // setup rendering resources
-    audio_sys_init();           // setup audio callback
-    input_sys_init();           // setup glfw input callbacks
-    ui_sys_init();              // setup imgui
-    logic_sys_init();           // setup game logic
-    editor_sys_init();
+    if (!ms_headless)
+    {
+        audio_sys_init();       // setup audio callback
+        input_sys_init();       // setup glfw input callbacks
+        ui_sys_init();          // setup imgui
+        logic_sys_init();       // setup game logic
+        editor_sys_init();
+    }
 }
 
 static void Shutdown(void)
 {
-    editor_sys_shutdown();
-    logic_sys_shutdown();
-    ui_sys_shutdown();
-    input_sys_shutdown();
-    audio_sys_shutdown();
+    if (!ms_headless)
+    {
+        editor_sys_shutdown();
+        logic_sys_shutdown();
+        ui_sys_shutdown();
+        input_sys_shutdown();
+        audio_sys_shutdown();
+    }
     render_sys_shutdown();
     network_sys_shutdown();
     asset_sys_shutdown();
     task_sys_shutdown();
+    profile_sys_shutdown();
     con_sys_shutdown();
     cmd_sys_shutdown();
     window_sys_shutdown();
@@ -72,7 +132,10 @@ ProfileMark(pm_input, InitPhase)
 static void InitPhase(void)
 {
     ProfileBegin(pm_input);
-    input_sys_update();         // pump input events to callbacks
+    if (!ms_headless)
+    {
+        input_sys_update();     // pump input events to callbacks
+    }
     window_sys_update();        // update window size
     network_sys_update();       // transmit and receive game state
     asset_sys_update();         // stream assets in
@@ -84,7 +147,10 @@ static void SimulatePhase(void)
 {
     ProfileBegin(pm_simulate);
     cmd_sys_update();
-    logic_sys_update();         // update game simulation
+    if (!ms_headless)
+    {
+        logic_sys_update();     // update game simulation
+    }
     task_sys_update();          // schedule tasks
     ProfileEnd(pm_simulate);
 }
@@ -94,7 +160,10 @@ static void PresentPhase(void)
 {
     ProfileBegin(pm_present);
     render_sys_update();        // draw tasks
-    audio_sys_update();         // handle audio events
+    if (!ms_headless)
+    {
+        audio_sys_update();     // handle audio events
+    }
     ProfileEnd(pm_present);
 }
 
@@ -102,13 +171,17 @@ ProfileMark(pm_update, Update)
 static void Update(void)
 {
     time_sys_update();          // bump frame id for profiler
+    profctr_sys_update();       // roll profile counters over to the new frame
     alloc_sys_update();         // reset linear allocator
     ProfileBegin(pm_update);
 
     InitPhase();
     SimulatePhase();
     PresentPhase();
-    OnGui();
+    if (!ms_headless)
+    {
+        OnGui();
+    }
 
     window_swapbuffers();       // glfwSwapBuffers
     ProfileEnd(pm_update);
@@ -41,6 +41,42 @@ pim_inline float4 VEC_CALL rgba8_f4(u32 c)
     return f4_v((r + 0.5f) * s, (g + 0.5f) * s, (b + 0.5f) * s, (a + 0.5f) * s);
 }
 
+// shared exponent hdr color, 9 bit mantissas and a 5 bit exponent
+// https://www.khronos.org/registry/OpenGL/extensions/EXT/EXT_texture_shared_exponent.txt
+#define kRgb9e5Max      65408.0f
+
+pim_inline u32 VEC_CALL f4_rgb9e5(float4 v)
+{
+    const float r = f1_clamp(v.x, 0.0f, kRgb9e5Max);
+    const float g = f1_clamp(v.y, 0.0f, kRgb9e5Max);
+    const float b = f1_clamp(v.z, 0.0f, kRgb9e5Max);
+    const float maxc = f1_max(r, f1_max(g, b));
+    if (!(maxc > 0.0f))
+    {
+        return 0;
+    }
+    // exponent biased by 15, less 9 for the mantissa bits
+    i32 e = i1_max(-16, (i32)floorf(log2f(maxc))) + 16;
+    if ((u32)floorf(maxc / ldexpf(1.0f, e - 24) + 0.5f) == 512u)
+    {
+        ++e;
+    }
+    const float rcpScale = 1.0f / ldexpf(1.0f, e - 24);
+    const u32 rm = (u32)floorf(r * rcpScale + 0.5f);
+    const u32 gm = (u32)floorf(g * rcpScale + 0.5f);
+    const u32 bm = (u32)floorf(b * rcpScale + 0.5f);
+    return rm | (gm << 9) | (bm << 18) | ((u32)e << 27);
+}
+
+pim_inline float4 VEC_CALL rgb9e5_f4(u32 c)
+{
+    const float scale = ldexpf(1.0f, (i32)(c >> 27) - 24);
+    const float r = (float)(c & 0x1ff) * scale;
+    const float g = (float)((c >> 9) & 0x1ff) * scale;
+    const float b = (float)((c >> 18) & 0x1ff) * scale;
+    return f4_v(r, g, b, 0.0f);
+}
+
 // reference sRGB -> Linear conversion (no approximation)
 pim_inline float VEC_CALL sRGBToLinear(float c)
 {
@@ -69,6 +69,82 @@ pim_inline float2 VEC_CALL Hammersley2D(u32 i, u32 N)
     return c;
 }
 
+pim_inline u32 VEC_CALL ReverseBits32(u32 bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return bits;
+}
+
+// maps 32 random bits to [0, 1), never rounding up to 1
+pim_inline float VEC_CALL U32ToUnorm(u32 bits)
+{
+    return (float)(bits >> 8u) * (1.0f / (1u << 24u));
+}
+
+// https://nullprogram.com/blog/2018/07/31/
+pim_inline u32 VEC_CALL HashU32(u32 x)
+{
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+pim_inline u32 VEC_CALL HashCombine32(u32 seed, u32 x)
+{
+    return HashU32(seed ^ (x + 0x9e3779b9u + (seed << 6u) + (seed >> 2u)));
+}
+
+// second dimension of the sobol sequence, the first is ReverseBits32(i)
+pim_inline u32 VEC_CALL Sobol1(u32 i)
+{
+    u32 r = 0u;
+    for (u32 v = 1u << 31u; i; i >>= 1u, v ^= v >> 1u)
+    {
+        if (i & 1u)
+        {
+            r ^= v;
+        }
+    }
+    return r;
+}
+
+// Practical Hash-based Owen Scrambling, Burley 2020
+// https://jcgt.org/published/0009/04/01/
+pim_inline u32 VEC_CALL NestedUniformScramble(u32 x, u32 seed)
+{
+    x = ReverseBits32(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return ReverseBits32(x);
+}
+
+// owen scrambled, shuffled sobol point i of the sequence selected by seed.
+// a fresh seed per dimension pair pads the sequence to any dimension.
+pim_inline float VEC_CALL OwenSobol1D(u32 i, u32 seed)
+{
+    i = NestedUniformScramble(i, seed);
+    u32 x = NestedUniformScramble(ReverseBits32(i), HashCombine32(seed, 0u));
+    return U32ToUnorm(x);
+}
+
+pim_inline float2 VEC_CALL OwenSobol2D(u32 i, u32 seed)
+{
+    i = NestedUniformScramble(i, seed);
+    u32 x = NestedUniformScramble(ReverseBits32(i), HashCombine32(seed, 0u));
+    u32 y = NestedUniformScramble(Sobol1(i), HashCombine32(seed, 1u));
+    return f2_v(U32ToUnorm(x), U32ToUnorm(y));
+}
+
 // http://www.pbr-book.org/3ed-2018/Monte_Carlo_Integration/Importance_Sampling.html
 pim_inline float VEC_CALL PowerHeuristic(float f, float g)
 {
@@ -107,19 +183,21 @@ pim_inline float4 VEC_CALL SampleBaryCoord(float2 Xi)
     return f4_v(w, u, v, 0.0f);
 }
 
-pim_inline float2 VEC_CALL SampleNGon(prng_t* rng, i32 N, float rot)
+// Xi.x picks the side and is rescaled, so stratified Xi stay stratified
+pim_inline float2 VEC_CALL SampleNGon(float2 Xi, i32 N, float rot)
 {
-    const i32 side = prng_i32(rng) % N;
+    const i32 side = i1_min((i32)(Xi.x * N), N - 1);
+    Xi.x = Xi.x * N - side;
     const float R = kTau / N;
     const float a = rot + (1 + side) * R;
     const float b = rot + (2 + side) * R;
     const float2 A = { cosf(a), sinf(a) };
     const float2 B = { cosf(b), sinf(b) };
-    const float4 wuv = SampleBaryCoord(f2_rand(rng));
+    const float4 wuv = SampleBaryCoord(Xi);
     return f2_blend(f2_0, A, B, wuv);
 }
 
-pim_inline float2 VEC_CALL SamplePentagram(prng_t* rng)
+pim_inline float2 VEC_CALL SamplePentagram(float2 Xi)
 {
     // https://mathworld.wolfram.com/Pentagram.html
     // https://www.desmos.com/calculator/ptfwlfemow
@@ -127,8 +205,8 @@ pim_inline float2 VEC_CALL SamplePentagram(prng_t* rng)
     const float s = kPi * 0.1f;
     // (3-sqrt(5))/2
     const float q = 0.38196601125f;
-    const float2 Xi = f2_rand(rng);
-    const i32 side = prng_i32(rng) % 5;
+    const i32 side = i1_min((i32)(Xi.x * 5.0f), 4);
+    Xi.x = Xi.x * 5.0f - side;
     const float a = s + (1.0f + side) * R;
     const float b = s + (1.5f + side) * R;
     const float c = s + (2.0f + side) * R;
@@ -0,0 +1,619 @@
+#include "rendering/bench.h"
+#include "allocator/allocator.h"
+#include "common/console.h"
+#include "common/cmd.h"
+#include "common/cvar.h"
+#include "common/time.h"
+#include "common/random.h"
+#include "common/sort.h"
+#include "common/profiler.h"
+#include "common/stringutil.h"
+#include "io/fstr.h"
+#include "threading/task.h"
+#include "math/scalar.h"
+#include "math/float3_funcs.h"
+#include "math/float4_funcs.h"
+#include "math/quat_funcs.h"
+#include "assets/asset_system.h"
+#include "rendering/constants.h"
+#include "rendering/camera.h"
+#include "rendering/framebuffer.h"
+#include "rendering/drawable.h"
+#include "rendering/path_tracer.h"
+#include "rendering/lightmap.h"
+#include "rendering/denoise.h"
+#include "rendering/rtcdraw.h"
+#include <string.h>
+#include <math.h>
+
+static cvar_t cv_bench_seed = { cvart_int, 0, "bench_seed", "1", "rng seed of every benchmark scenario" };
+static cvar_t cv_bench_warmup = { cvart_int, 0, "bench_warmup", "-1", "untimed iterations per scenario, negative uses the scenario default" };
+static cvar_t cv_bench_iterations = { cvart_int, 0, "bench_iterations", "0", "timed iterations per scenario, 0 uses the scenario default" };
+static cvar_t cv_bench_quit = { cvart_bool, 0, "bench_quit", "0", "quit once the benchmark completes" };
+
+typedef enum
+{
+    BenchId_MapLoad,
+    BenchId_Raster,
+    BenchId_PathTrace,
+    BenchId_Lightmap,
+    BenchId_Denoise,
+
+    BenchId_COUNT
+} BenchId;
+
+typedef struct benchdef_s
+{
+    const char* name;
+    const char* units;          // unit of work reported by Run
+    i32 warmup;
+    i32 iterations;
+    bool(*Setup)(const char* arg);
+    double(*Run)(i32 i);        // units of work done, negative on failure
+    void(*Teardown)(void);
+} benchdef_t;
+
+typedef struct benchjob_s
+{
+    BenchId id;
+    char arg[16];
+} benchjob_t;
+
+typedef struct benchresult_s
+{
+    char name[32];
+    const char* units;
+    i32 warmup;
+    i32 iterations;
+    float minMs;
+    float meanMs;
+    float p50Ms;
+    float p90Ms;
+    float p99Ms;
+    float maxMs;
+    double perSec;
+} benchresult_t;
+
+static cmdstat_t CmdBench(i32 argc, const char** argv);
+
+static bool MapLoad_Setup(const char* arg);
+static double MapLoad_Run(i32 i);
+static void MapLoad_Teardown(void);
+static bool Raster_Setup(const char* arg);
+static double Raster_Run(i32 i);
+static void Raster_Teardown(void);
+static bool PathTrace_Setup(const char* arg);
+static double PathTrace_Run(i32 i);
+static void PathTrace_Teardown(void);
+static bool Lightmap_Setup(const char* arg);
+static double Lightmap_Run(i32 i);
+static void Lightmap_Teardown(void);
+static bool Denoise_Setup(const char* arg);
+static double Denoise_Run(i32 i);
+static void Denoise_Teardown(void);
+
+static const benchdef_t ms_defs[] =
+{
+    { "mapload", "loads", 1, 3, MapLoad_Setup, MapLoad_Run, MapLoad_Teardown },
+    { "raster", "frames", 16, 128, Raster_Setup, Raster_Run, Raster_Teardown },
+    { "pathtrace", "samples", 4, 32, PathTrace_Setup, PathTrace_Run, PathTrace_Teardown },
+    { "lightmap", "texels", 1, 8, Lightmap_Setup, Lightmap_Run, Lightmap_Teardown },
+    { "denoise", "frames", 2, 16, Denoise_Setup, Denoise_Run, Denoise_Teardown },
+};
+SASSERT(NELEM(ms_defs) == BenchId_COUNT);
+
+// ----------------------------------------------------------------------------
+
+static benchjob_t* ms_jobs;
+static i32 ms_jobCount;
+static i32 ms_iJob;
+
+static bool ms_setup;
+static i32 ms_iter;
+static i32 ms_warmup;
+static i32 ms_iterations;
+static float* ms_times;
+static double ms_work;
+
+static benchresult_t* ms_results;
+static i32 ms_resultCount;
+static char ms_outPath[PIM_PATH];
+
+// scenario state
+static char ms_mapCmd[PIM_PATH];
+static camera_t ms_camera;
+static framebuf_t ms_framebuf;
+static pt_scene_t* ms_scene;
+static pt_trace_t ms_trace;
+static cvar_t* cv_pt_target_error;
+static float ms_targetError;
+static i32 ms_activeTexels;
+static float3* ms_dnColor;
+static float3* ms_dnAlbedo;
+static float3* ms_dnNormal;
+static float3* ms_dnOutput;
+
+// ----------------------------------------------------------------------------
+
+void bench_sys_init(void)
+{
+    cvar_reg(&cv_bench_seed);
+    cvar_reg(&cv_bench_warmup);
+    cvar_reg(&cv_bench_iterations);
+    cvar_reg(&cv_bench_quit);
+
+    cmd_reg("bench", CmdBench);
+}
+
+static void EndJob(bool succeeded);
+
+ProfileMark(pm_update, bench_sys_update)
+void bench_sys_update(void)
+{
+    if (!bench_running())
+    {
+        return;
+    }
+    ProfileBegin(pm_update);
+
+    const benchjob_t* job = ms_jobs + ms_iJob;
+    const benchdef_t* def = ms_defs + job->id;
+    if (!ms_setup)
+    {
+        // every scenario starts from the same rng state
+        const u64 seed = (u64)cv_bench_seed.asFloat;
+        prng_set((prng_t) { seed });
+        pt_sampler_seed(seed);
+
+        ms_warmup = (cv_bench_warmup.asFloat < 0.0f) ?
+            def->warmup : (i32)cv_bench_warmup.asFloat;
+        ms_iterations = (cv_bench_iterations.asFloat < 1.0f) ?
+            def->iterations : (i32)cv_bench_iterations.asFloat;
+        ms_iter = 0;
+        ms_work = 0.0;
+        PermReserve(ms_times, ms_iterations);
+
+        con_logf(LogSev_Info, "bench", "%s %s: %d warmup, %d iterations",
+            def->name, job->arg, ms_warmup, ms_iterations);
+        ms_setup = true;
+        if (!def->Setup(job->arg))
+        {
+            con_logf(LogSev_Error, "bench", "%s %s: setup failed, skipping", def->name, job->arg);
+            EndJob(false);
+            goto end;
+        }
+    }
+
+    {
+        const i32 i = ms_iter++;
+        const u64 begin = time_now();
+        const double work = def->Run(i);
+        const float ms = (float)time_milli(time_now() - begin);
+        if (work < 0.0)
+        {
+            con_logf(LogSev_Error, "bench", "%s %s: iteration %d failed, skipping", def->name, job->arg, i);
+            EndJob(false);
+            goto end;
+        }
+        if (i >= ms_warmup)
+        {
+            ms_times[i - ms_warmup] = ms;
+            ms_work += work;
+        }
+        if (ms_iter >= ms_warmup + ms_iterations)
+        {
+            EndJob(true);
+        }
+    }
+
+end:
+    ProfileEnd(pm_update);
+}
+
+void bench_sys_shutdown(void)
+{
+    if (ms_setup)
+    {
+        ms_defs[ms_jobs[ms_iJob].id].Teardown();
+        ms_setup = false;
+    }
+    pim_free(ms_jobs);
+    ms_jobs = NULL;
+    ms_jobCount = 0;
+    ms_iJob = 0;
+    pim_free(ms_times);
+    ms_times = NULL;
+    pim_free(ms_results);
+    ms_results = NULL;
+    ms_resultCount = 0;
+}
+
+bool bench_running(void)
+{
+    return ms_iJob < ms_jobCount;
+}
+
+// ----------------------------------------------------------------------------
+
+static i32 CmpFloat(const void* lhs, const void* rhs, void* usr)
+{
+    const float a = *(const float*)lhs;
+    const float b = *(const float*)rhs;
+    if (a != b)
+    {
+        return a < b ? -1 : 1;
+    }
+    return 0;
+}
+
+// nearest rank percentile of sorted values
+static float Percentile(const float* sorted, i32 count, float p)
+{
+    i32 i = (i32)ceilf(p * count) - 1;
+    i = i < 0 ? 0 : i;
+    i = i < count ? i : count - 1;
+    return sorted[i];
+}
+
+static void AddResult(const benchjob_t* job)
+{
+    const benchdef_t* def = ms_defs + job->id;
+    const i32 count = ms_iterations;
+    float* times = ms_times;
+    pimsort(times, count, sizeof(times[0]), CmpFloat, NULL);
+
+    double sum = 0.0;
+    for (i32 i = 0; i < count; ++i)
+    {
+        sum += times[i];
+    }
+
+    benchresult_t result = { 0 };
+    if (job->arg[0])
+    {
+        SPrintf(ARGS(result.name), "%s_%s", def->name, job->arg);
+    }
+    else
+    {
+        StrCpy(ARGS(result.name), def->name);
+    }
+    result.units = def->units;
+    result.warmup = ms_warmup;
+    result.iterations = count;
+    result.minMs = times[0];
+    result.meanMs = (float)(sum / count);
+    result.p50Ms = Percentile(times, count, 0.5f);
+    result.p90Ms = Percentile(times, count, 0.9f);
+    result.p99Ms = Percentile(times, count, 0.99f);
+    result.maxMs = times[count - 1];
+    result.perSec = (sum > 0.0) ? (ms_work * 1000.0 / sum) : 0.0;
+
+    con_logf(LogSev_Info, "bench", "%s: mean %.3f ms, p50 %.3f ms, p99 %.3f ms, %.1f %s/s",
+        result.name, result.meanMs, result.p50Ms, result.p99Ms, result.perSec, result.units);
+
+    ++ms_resultCount;
+    PermReserve(ms_results, ms_resultCount);
+    ms_results[ms_resultCount - 1] = result;
+}
+
+static void WriteResults(void)
+{
+    const i32 size = 512 * (ms_resultCount + 1);
+    char* text = tmp_calloc(size);
+
+    StrCatf(text, size, "{\n");
+    StrCatf(text, size, "    \"seed\": %d,\n", (i32)cv_bench_seed.asFloat);
+    StrCatf(text, size, "    \"threads\": %d,\n", task_thread_ct());
+    StrCatf(text, size, "    \"width\": %d,\n", kDrawWidth);
+    StrCatf(text, size, "    \"height\": %d,\n", kDrawHeight);
+    StrCatf(text, size, "    \"scenarios\": [\n");
+    for (i32 i = 0; i < ms_resultCount; ++i)
+    {
+        const benchresult_t* r = ms_results + i;
+        StrCatf(text, size, "        {\n");
+        StrCatf(text, size, "            \"name\": \"%s\",\n", r->name);
+        StrCatf(text, size, "            \"units\": \"%s\",\n", r->units);
+        StrCatf(text, size, "            \"warmup\": %d,\n", r->warmup);
+        StrCatf(text, size, "            \"iterations\": %d,\n", r->iterations);
+        StrCatf(text, size, "            \"min_ms\": %.4f,\n", r->minMs);
+        StrCatf(text, size, "            \"mean_ms\": %.4f,\n", r->meanMs);
+        StrCatf(text, size, "            \"p50_ms\": %.4f,\n", r->p50Ms);
+        StrCatf(text, size, "            \"p90_ms\": %.4f,\n", r->p90Ms);
+        StrCatf(text, size, "            \"p99_ms\": %.4f,\n", r->p99Ms);
+        StrCatf(text, size, "            \"max_ms\": %.4f,\n", r->maxMs);
+        StrCatf(text, size, "            \"per_sec\": %.4f\n", r->perSec);
+        StrCatf(text, size, "        }%s\n", (i + 1 < ms_resultCount) ? "," : "");
+    }
+    StrCatf(text, size, "    ]\n");
+    StrCatf(text, size, "}\n");
+
+    fstr_t fd = fstr_open(ms_outPath, "wb");
+    if (fstr_isopen(fd))
+    {
+        fstr_puts(fd, text);
+        fstr_close(&fd);
+        con_logf(LogSev_Info, "bench", "wrote results to '%s'", ms_outPath);
+    }
+    else
+    {
+        con_logf(LogSev_Error, "bench", "failed to open '%s'", ms_outPath);
+    }
+}
+
+static void EndJob(bool succeeded)
+{
+    const benchjob_t* job = ms_jobs + ms_iJob;
+    ms_defs[job->id].Teardown();
+    ms_setup = false;
+    if (succeeded)
+    {
+        AddResult(job);
+    }
+
+    ++ms_iJob;
+    if (!bench_running())
+    {
+        WriteResults();
+        pim_free(ms_jobs);
+        ms_jobs = NULL;
+        ms_jobCount = 0;
+        ms_iJob = 0;
+        if (cvar_get_bool(&cv_bench_quit))
+        {
+            con_exec("quit");
+        }
+    }
+}
+
+static void AddJob(BenchId id, const char* arg)
+{
+    ++ms_jobCount;
+    PermReserve(ms_jobs, ms_jobCount);
+    benchjob_t* job = ms_jobs + ms_jobCount - 1;
+    memset(job, 0, sizeof(*job));
+    job->id = id;
+    StrCpy(ARGS(job->arg), arg);
+}
+
+static void AddMapJobs(void)
+{
+    char name[PIM_PATH];
+    char path[PIM_PATH];
+    asset_t asset = { 0 };
+    if (asset_get("maps/start.bsp", &asset))
+    {
+        AddJob(BenchId_MapLoad, "start");
+    }
+    for (i32 e = 1; ; ++e)
+    {
+        for (i32 m = 1; ; ++m)
+        {
+            SPrintf(ARGS(name), "e%dm%d", e, m);
+            SPrintf(ARGS(path), "maps/%s.bsp", name);
+            if (!asset_get(path, &asset))
+            {
+                if (m == 1)
+                {
+                    return;
+                }
+                break;
+            }
+            AddJob(BenchId_MapLoad, name);
+        }
+    }
+}
+
+static cmdstat_t CmdBench(i32 argc, const char** argv)
+{
+    if (bench_running())
+    {
+        con_logf(LogSev_Error, "bench", "a benchmark is already running");
+        return cmdstat_err;
+    }
+
+    const char* scenario = (argc > 1) ? argv[1] : "all";
+    const bool all = StrICmp(scenario, 16, "all") == 0;
+    for (i32 i = 0; i < BenchId_COUNT; ++i)
+    {
+        if (all || (StrICmp(scenario, 16, ms_defs[i].name) == 0))
+        {
+            if (i == BenchId_MapLoad)
+            {
+                AddMapJobs();
+            }
+            else
+            {
+                AddJob(i, "");
+            }
+        }
+    }
+    if (!bench_running())
+    {
+        con_logf(LogSev_Error, "bench", "usage: bench <all|mapload|raster|pathtrace|lightmap|denoise> [file.json]");
+        return cmdstat_err;
+    }
+
+    StrCpy(ARGS(ms_outPath), (argc > 2) ? argv[2] : "bench.json");
+    ms_resultCount = 0;
+    return cmdstat_ok;
+}
+
+// ----------------------------------------------------------------------------
+
+// fixed scene and camera shared by the rendering scenarios
+static bool SetupCornellBox(void)
+{
+    if (cmd_exec("cornell_box") != cmdstat_ok)
+    {
+        return false;
+    }
+    cmd_exec("teleport -4 4 -4");
+    cmd_exec("lookat 0 2 0");
+    camera_get(&ms_camera);
+    drawables_trs(drawables_get());
+    return true;
+}
+
+static bool MapLoad_Setup(const char* arg)
+{
+    SPrintf(ARGS(ms_mapCmd), "mapload %s", arg);
+    return true;
+}
+
+static double MapLoad_Run(i32 i)
+{
+    return (cmd_exec(ms_mapCmd) == cmdstat_ok) ? 1.0 : -1.0;
+}
+
+static void MapLoad_Teardown(void)
+{
+
+}
+
+static bool Raster_Setup(const char* arg)
+{
+    if (!SetupCornellBox())
+    {
+        return false;
+    }
+    framebuf_create(&ms_framebuf, kDrawWidth, kDrawHeight);
+    return true;
+}
+
+static double Raster_Run(i32 i)
+{
+    // fixed path: one orbit around the box every 64 frames
+    const i32 kPathFrames = 64;
+    const float angle = kTau * (i % kPathFrames) / kPathFrames;
+    const float radius = 5.657f;
+    const float4 at = { 0.0f, 2.0f, 0.0f, 0.0f };
+    const float4 up = { 0.0f, 1.0f, 0.0f, 0.0f };
+    camera_t camera = ms_camera;
+    camera.position = f4_v(cosf(angle) * radius, 4.0f, sinf(angle) * radius, 1.0f);
+    camera.rotation = quat_lookat(f4_normalize3(f4_sub(at, camera.position)), up);
+    RtcDraw(&ms_framebuf, &camera);
+    return 1.0;
+}
+
+static void Raster_Teardown(void)
+{
+    framebuf_destroy(&ms_framebuf);
+}
+
+static bool PathTrace_Setup(const char* arg)
+{
+    if (!SetupCornellBox())
+    {
+        return false;
+    }
+    // adaptive sampling would make the work per iteration vary
+    cv_pt_target_error = cvar_find("pt_target_error");
+    if (cv_pt_target_error)
+    {
+        ms_targetError = cv_pt_target_error->asFloat;
+        cvar_set_float(cv_pt_target_error, 0.0f);
+    }
+    ms_scene = pt_scene_new();
+    const int2 size = { kDrawWidth, kDrawHeight };
+    pt_trace_new(&ms_trace, ms_scene, &ms_camera, size);
+    return true;
+}
+
+static double PathTrace_Run(i32 i)
+{
+    ms_trace.sampleWeight = 1.0f / (i + 1);
+    pt_trace(&ms_trace);
+    return kDrawPixels;
+}
+
+static void PathTrace_Teardown(void)
+{
+    pt_trace_del(&ms_trace);
+    pt_scene_del(ms_scene);
+    ms_scene = NULL;
+    if (cv_pt_target_error)
+    {
+        cvar_set_float(cv_pt_target_error, ms_targetError);
+    }
+}
+
+static bool Lightmap_Setup(const char* arg)
+{
+    if (!SetupCornellBox())
+    {
+        return false;
+    }
+    ms_scene = pt_scene_new();
+
+    cvar_t* cv_lm_density = cvar_find("lm_density");
+    const float density = cv_lm_density ? cv_lm_density->asFloat : 8.0f;
+    lmpack_t* pack = lmpack_get();
+    lmpack_del(pack);
+    *pack = lmpack_pack(ms_scene, 1024, density, 0.1f, 15.0f);
+
+    // a time slice of 1 traces every occupied texel once per bake
+    ms_activeTexels = pack->texelCount;
+    return ms_activeTexels > 0;
+}
+
+static double Lightmap_Run(i32 i)
+{
+    lmpack_bake(ms_scene, 1.0f);
+    return ms_activeTexels;
+}
+
+static void Lightmap_Teardown(void)
+{
+    // the pack stays bound to the box's drawables
+    pt_scene_del(ms_scene);
+    ms_scene = NULL;
+}
+
+static bool Denoise_Setup(const char* arg)
+{
+    const i32 len = kDrawPixels;
+    ms_dnColor = perm_malloc(sizeof(ms_dnColor[0]) * len);
+    ms_dnAlbedo = perm_malloc(sizeof(ms_dnAlbedo[0]) * len);
+    ms_dnNormal = perm_malloc(sizeof(ms_dnNormal[0]) * len);
+    ms_dnOutput = perm_malloc(sizeof(ms_dnOutput[0]) * len);
+
+    // noisy input with smooth guides, from the seeded rng
+    prng_t rng = prng_get();
+    for (i32 i = 0; i < len; ++i)
+    {
+        const float x = (float)(i % kDrawWidth) / kDrawWidth;
+        const float y = (float)(i / kDrawWidth) / kDrawHeight;
+        const float noise = prng_f32(&rng) * 4.0f;
+        ms_dnColor[i] = f3_v(x * noise, y * noise, 0.5f * noise);
+        ms_dnAlbedo[i] = f3_v(x, y, 0.5f);
+        float4 N = f4_normalize3(f4_v(x - 0.5f, y - 0.5f, 1.0f, 0.0f));
+        ms_dnNormal[i] = f4_f3(N);
+    }
+    prng_set(rng);
+    return true;
+}
+
+static double Denoise_Run(i32 i)
+{
+    const int2 size = { kDrawWidth, kDrawHeight };
+    bool denoised = Denoise(
+        DenoiseType_Image,
+        size,
+        ms_dnColor,
+        ms_dnAlbedo,
+        ms_dnNormal,
+        ms_dnOutput);
+    return denoised ? 1.0 : -1.0;
+}
+
+static void Denoise_Teardown(void)
+{
+    pim_free(ms_dnColor);
+    ms_dnColor = NULL;
+    pim_free(ms_dnAlbedo);
+    ms_dnAlbedo = NULL;
+    pim_free(ms_dnNormal);
+    ms_dnNormal = NULL;
+    pim_free(ms_dnOutput);
+    ms_dnOutput = NULL;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common/macro.h"
+
+PIM_C_BEGIN
+
+// Reproducible benchmark suite:
+// 'bench <scenario|all> [file.json]' runs fixed scenes with fixed seeds,
+// one timed iteration per frame, and writes per scenario percentiles to json.
+// Combine with -headless and bench_quit for unattended runs.
+
+void bench_sys_init(void);
+void bench_sys_update(void);
+void bench_sys_shutdown(void);
+
+bool bench_running(void);
+
+PIM_C_END
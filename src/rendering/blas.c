@@ -0,0 +1,276 @@
+#include "rendering/blas.h"
+#include "rendering/mesh.h"
+#include "allocator/allocator.h"
+#include "common/console.h"
+#include "common/profiler.h"
+#include "threading/mutex.h"
+#include "math/float4_funcs.h"
+#include <string.h>
+
+typedef struct blas_s
+{
+    meshid_t id;
+    const float4* positions;    // changes when mesh_set replaces the mesh
+    RTCScene scene;
+} blas_t;
+
+static RTCDevice ms_device;
+
+// guards the cache and index buffer, tlas builds call in from worker tasks
+static mutex_t ms_mtx;
+
+// indexed by meshid_t::index
+static i32 ms_count;
+static blas_t* ms_blas;
+
+// meshes are unindexed triangle lists, they all share one 0..n index buffer
+static RTCBuffer ms_indices;
+static i32 ms_indexCount;
+
+static void OnRtcError(void* user, RTCError error, const char* msg)
+{
+    if (error != RTC_ERROR_NONE)
+    {
+        con_logf(LogSev_Error, "rtc", "%s", msg);
+        ASSERT(false);
+    }
+}
+
+bool blas_sys_init(void)
+{
+    if (!rtc_init())
+    {
+        return false;
+    }
+    ms_device = rtc.NewDevice(NULL);
+    if (!ms_device)
+    {
+        OnRtcError(NULL, rtc.GetDeviceError(NULL), "Failed to create device");
+        return false;
+    }
+    rtc.SetDeviceErrorFunction(ms_device, OnRtcError, NULL);
+    mutex_create(&ms_mtx);
+    return true;
+}
+
+void blas_sys_shutdown(void)
+{
+    for (i32 i = 0; i < ms_count; ++i)
+    {
+        if (ms_blas[i].scene)
+        {
+            rtc.ReleaseScene(ms_blas[i].scene);
+        }
+    }
+    pim_free(ms_blas);
+    ms_blas = NULL;
+    ms_count = 0;
+
+    if (ms_indices)
+    {
+        rtc.ReleaseBuffer(ms_indices);
+        ms_indices = NULL;
+        ms_indexCount = 0;
+    }
+
+    if (ms_device)
+    {
+        rtc.ReleaseDevice(ms_device);
+        ms_device = NULL;
+        mutex_destroy(&ms_mtx);
+    }
+}
+
+RTCDevice blas_device(void)
+{
+    return ms_device;
+}
+
+static RTCBuffer GetIndices(i32 triCount)
+{
+    if (triCount > ms_indexCount)
+    {
+        // geometries retain the buffer they were created with
+        if (ms_indices)
+        {
+            rtc.ReleaseBuffer(ms_indices);
+        }
+        i32 count = ms_indexCount * 2;
+        count = count > triCount ? count : triCount;
+        ms_indices = rtc.NewBuffer(ms_device, sizeof(int3) * count);
+        ASSERT(ms_indices);
+        if (!ms_indices)
+        {
+            ms_indexCount = 0;
+            return NULL;
+        }
+        i32* pim_noalias dst = rtc.GetBufferData(ms_indices);
+        for (i32 i = 0; i < count * 3; ++i)
+        {
+            dst[i] = i;
+        }
+        ms_indexCount = count;
+    }
+    return ms_indices;
+}
+
+static RTCScene NewBlas(const mesh_t* mesh)
+{
+    const i32 vertCount = mesh->length;
+    const i32 triCount = vertCount / 3;
+    if (triCount <= 0)
+    {
+        return NULL;
+    }
+    RTCBuffer indices = GetIndices(triCount);
+    if (!indices)
+    {
+        return NULL;
+    }
+
+    RTCGeometry geom = rtc.NewGeometry(ms_device, RTC_GEOMETRY_TYPE_TRIANGLE);
+    ASSERT(geom);
+    if (!geom)
+    {
+        return NULL;
+    }
+
+    float3* pim_noalias dstPositions = rtc.SetNewGeometryBuffer(
+        geom,
+        RTC_BUFFER_TYPE_VERTEX,
+        0,
+        RTC_FORMAT_FLOAT3,
+        sizeof(float3),
+        vertCount);
+    if (!dstPositions)
+    {
+        ASSERT(false);
+        rtc.ReleaseGeometry(geom);
+        return NULL;
+    }
+    const float4* pim_noalias srcPositions = mesh->positions;
+    for (i32 i = 0; i < vertCount; ++i)
+    {
+        dstPositions[i] = f4_f3(srcPositions[i]);
+    }
+
+    rtc.SetGeometryBuffer(
+        geom,
+        RTC_BUFFER_TYPE_INDEX,
+        0,
+        RTC_FORMAT_UINT3,
+        indices,
+        0,
+        sizeof(int3),
+        triCount);
+    rtc.CommitGeometry(geom);
+
+    RTCScene scene = rtc.NewScene(ms_device);
+    ASSERT(scene);
+    if (scene)
+    {
+        rtc.AttachGeometryByID(scene, geom, 0);
+        rtc.CommitScene(scene);
+    }
+    rtc.ReleaseGeometry(geom);
+
+    return scene;
+}
+
+ProfileMark(pm_newblas, NewBlas)
+// caller holds ms_mtx
+static RTCScene GetBlas(meshid_t id)
+{
+    mesh_t mesh;
+    if (!ms_device || !mesh_get(id, &mesh))
+    {
+        return NULL;
+    }
+
+    const i32 index = id.index;
+    if (index >= ms_count)
+    {
+        const i32 len = index + 1;
+        PermReserve(ms_blas, len);
+        memset(ms_blas + ms_count, 0, sizeof(ms_blas[0]) * (len - ms_count));
+        ms_count = len;
+    }
+
+    blas_t* blas = ms_blas + index;
+    bool current =
+        (blas->scene != NULL) &&
+        (blas->id.version == id.version) &&
+        (blas->positions == mesh.positions);
+    if (!current)
+    {
+        ProfileBegin(pm_newblas);
+        if (blas->scene)
+        {
+            rtc.ReleaseScene(blas->scene);
+        }
+        blas->id = id;
+        blas->positions = mesh.positions;
+        blas->scene = NewBlas(&mesh);
+        ProfileEnd(pm_newblas);
+    }
+
+    return blas->scene;
+}
+
+RTCScene blas_get(meshid_t id)
+{
+    if (!ms_device)
+    {
+        return NULL;
+    }
+    mutex_lock(&ms_mtx);
+    RTCScene scene = GetBlas(id);
+    mutex_unlock(&ms_mtx);
+    return scene;
+}
+
+bool blas_instance(RTCScene tlas, u32 geomId, meshid_t mesh, const float4x4* matrix)
+{
+    ASSERT(tlas);
+    ASSERT(matrix);
+
+    if (!ms_device)
+    {
+        return false;
+    }
+
+    // hold the lock until the instance retains the scene,
+    // another task may replace a stale entry in the meantime
+    mutex_lock(&ms_mtx);
+    RTCScene blas = GetBlas(mesh);
+    RTCGeometry geom = blas ? rtc.NewGeometry(ms_device, RTC_GEOMETRY_TYPE_INSTANCE) : NULL;
+    ASSERT(!blas || geom);
+    if (geom)
+    {
+        rtc.SetGeometryInstancedScene(geom, blas);
+    }
+    mutex_unlock(&ms_mtx);
+    if (!geom)
+    {
+        return false;
+    }
+
+    rtc.SetGeometryTransform(geom, 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, matrix);
+    rtc.CommitGeometry(geom);
+    rtc.AttachGeometryByID(tlas, geom, geomId);
+    rtc.ReleaseGeometry(geom);
+    return true;
+}
+
+void blas_transform(RTCScene tlas, u32 geomId, const float4x4* matrix)
+{
+    ASSERT(tlas);
+    ASSERT(matrix);
+
+    RTCGeometry geom = rtc.GetGeometry(tlas, geomId);
+    if (geom)
+    {
+        rtc.SetGeometryTransform(geom, 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, matrix);
+        rtc.CommitGeometry(geom);
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "common/macro.h"
+#include "math/types.h"
+#include "rendering/librtc.h"
+
+PIM_C_BEGIN
+
+typedef struct meshid_s meshid_t;
+
+// Bottom level acceleration structures:
+// one object space RTCScene per mesh, shared by every top level scene
+// that instances the mesh. Owns the embree device.
+
+bool blas_sys_init(void);
+void blas_sys_shutdown(void);
+
+RTCDevice blas_device(void);
+
+// committed object space scene of the mesh, NULL if the mesh does not exist.
+// owned by the cache, instances retain it. safe to call from tasks.
+RTCScene blas_get(meshid_t mesh);
+
+// attaches an instance of mesh to tlas at geomId, false if the mesh does not exist
+bool blas_instance(RTCScene tlas, u32 geomId, meshid_t mesh, const float4x4* matrix);
+// moves the instance at geomId, tlas must be committed afterwards
+void blas_transform(RTCScene tlas, u32 geomId, const float4x4* matrix);
+
+PIM_C_END
@@ -4,6 +4,7 @@
 #include "common/fnv1a.h"
 #include "common/guid.h"
 #include "common/profiler.h"
+#include "common/stringutil.h"
 #include "math/float4x4_funcs.h"
 #include "math/frustum.h"
 #include "math/box.h"
@@ -16,6 +17,7 @@
 #include "rendering/mesh.h"
 #include "rendering/material.h"
 #include "io/fstr.h"
+#include "io/dir.h"
 #include "threading/task.h"
 #include <string.h>
 
@@ -34,6 +36,7 @@ i32 drawables_add(drawables_t* dr, guid_t name)
     PermGrow(dr->lmUvs, len);
     PermGrow(dr->matrices, len);
     PermGrow(dr->invMatrices, len);
+    PermGrow(dr->hashes, len);
     PermGrow(dr->translations, len);
     PermGrow(dr->rotations, len);
     PermGrow(dr->scales, len);
@@ -74,6 +77,7 @@ static void RemoveAtIndex(drawables_t* dr, i32 i)
     PopSwap(dr->lmUvs, i, len);
     PopSwap(dr->matrices, i, len);
     PopSwap(dr->invMatrices, i, len);
+    PopSwap(dr->hashes, i, len);
     PopSwap(dr->translations, i, len);
     PopSwap(dr->rotations, i, len);
     PopSwap(dr->scales, i, len);
@@ -119,6 +123,7 @@ void drawables_del(drawables_t* dr)
         pim_free(dr->lmUvs);
         pim_free(dr->matrices);
         pim_free(dr->invMatrices);
+        pim_free(dr->hashes);
         pim_free(dr->translations);
         pim_free(dr->rotations);
         pim_free(dr->scales);
@@ -139,13 +144,18 @@ static void TRSFn(task_t* pbase, i32 begin, i32 end)
     const float4* pim_noalias translations = dr->translations;
     const quat* pim_noalias rotations = dr->rotations;
     const float4* pim_noalias scales = dr->scales;
+    const meshid_t* pim_noalias meshes = dr->meshes;
     float4x4* pim_noalias matrices = dr->matrices;
     float3x3* pim_noalias invMatrices = dr->invMatrices;
+    u64* pim_noalias hashes = dr->hashes;
 
     for (i32 i = begin; i < end; ++i)
     {
         matrices[i] = f4x4_trs(translations[i], rotations[i], scales[i]);
         invMatrices[i] = f3x3_IM(matrices[i]);
+        u64 hash = Fnv64Bytes(meshes + i, sizeof(meshes[0]), Fnv64Bias);
+        hash = Fnv64Bytes(matrices + i, sizeof(matrices[0]), hash);
+        hashes[i] = hash;
     }
 }
 
@@ -184,8 +194,13 @@ bool drawables_save(const drawables_t* src, guid_t name)
 {
     char filename[PIM_PATH] = "data/";
     guid_tofile(ARGS(filename), name, ".drawables");
+    // written aside and swapped in, an interrupted save keeps the old file
+    char tmpname[PIM_PATH] = { 0 };
+    SPrintf(ARGS(tmpname), "%s.tmp", filename);
+    // dir errors are sticky per thread, drop any left by earlier calls
+    dir_errno();
 
-    fstr_t fd = fstr_open(filename, "wb");
+    fstr_t fd = fstr_open(tmpname, "wb");
     if (fstr_isopen(fd))
     {
         void* scratch = NULL;
@@ -288,8 +303,15 @@ bool drawables_save(const drawables_t* src, guid_t name)
             fstr_write(fd, lmuv.indices, sizeof(lmuv.indices[0]) * lmuv.length);
         }
 
+        // only swap in a file that fully reached the disk
+        const bool synced = fstr_sync(fd) == 0;
         fstr_close(&fd);
-        return true;
+        if (!synced)
+        {
+            return false;
+        }
+        pim_rename(tmpname, filename);
+        return dir_errno() == 0;
     }
     return false;
 }
@@ -329,6 +351,7 @@ bool drawables_load(drawables_t* dst, guid_t name)
                 dst->lmUvs = perm_calloc(sizeof(dst->lmUvs[0]) * len);
                 dst->matrices = perm_calloc(sizeof(dst->matrices[0]) * len);
                 dst->invMatrices = perm_calloc(sizeof(dst->invMatrices[0]) * len);
+                dst->hashes = perm_calloc(sizeof(dst->hashes[0]) * len);
                 dst->translations = perm_calloc(sizeof(dst->translations[0]) * len);
                 dst->rotations = perm_calloc(sizeof(dst->rotations[0]) * len);
                 dst->scales = perm_calloc(sizeof(dst->scales[0]) * len);
@@ -354,9 +377,9 @@ bool drawables_load(drawables_t* dst, guid_t name)
                         material_t mat = { 0 };
                         const dmaterial_t dmat = dmats[i];
                         mat.st = dmat.st;
-                        texture_load(dmat.albedo.id, &mat.albedo);
-                        texture_load(dmat.rome.id, &mat.rome);
-                        texture_load(dmat.normal.id, &mat.normal);
+                        texture_load(dmat.albedo.id, false, &mat.albedo);
+                        texture_load(dmat.rome.id, false, &mat.rome);
+                        texture_load(dmat.normal.id, true, &mat.normal);
                         mat.flatAlbedo = dmat.flatAlbedo;
                         mat.flatRome = dmat.flatRome;
                         mat.flags = dmat.flags;
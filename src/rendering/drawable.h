@@ -22,6 +22,7 @@ typedef struct drawables_s
     lm_uvs_t* pim_noalias lmUvs;        // lightmap uvs (must be per-instance)
     float4x4* pim_noalias matrices;     // local to world matrix
     float3x3* pim_noalias invMatrices;  // world to local rotation matrix
+    u64* pim_noalias hashes;            // mesh and matrix hash, for change detection
     float4* pim_noalias translations;
     quat* pim_noalias rotations;
     float4* pim_noalias scales;
@@ -49,6 +50,7 @@ i32 drawables_find(const drawables_t* dr, guid_t name);
 void drawables_clear(drawables_t* dr);
 void drawables_del(drawables_t* dr);
 
+// updates matrices and hashes
 void drawables_trs(drawables_t* dr);
 box_t drawables_bounds(const drawables_t* dr);
 
@@ -6,28 +6,40 @@
 #include "math/float4_funcs.h"
 #include "math/float4x4_funcs.h"
 #include "math/sdf.h"
+#include "math/box.h"
 #include "math/area.h"
 #include "math/sampling.h"
 #include "math/sh.h"
 #include "math/sphgauss.h"
+#include "math/color.h"
 #include "common/console.h"
 #include "common/sort.h"
+#include "containers/dict.h"
 #include "common/stringutil.h"
 #include "threading/task.h"
-#include "threading/mutex.h"
 #include "rendering/path_tracer.h"
 #include "rendering/sampler.h"
 #include "rendering/mesh.h"
+#include "rendering/screentile.h"
 #include "rendering/material.h"
 #include "common/profiler.h"
 #include "common/cmd.h"
 #include "common/atomics.h"
 #include "io/fstr.h"
+#include "io/dir.h"
+#include "io/fd.h"
+#include "io/fmap.h"
 #include <stb/stb_image_write.h>
 #include <string.h>
+#include <stdlib.h>
 
 #define CHART_SPLITS    2
 #define ROW_RESET       -(1<<20)
+#define ATLAS_BATCH     64
+#define BVH_LEAF        4
+#define BVH_STACK       64
+#define BAKE_BATCH      64
+#define BAKE_BUCKETS    256
 
 typedef enum
 {
@@ -39,10 +51,16 @@ typedef enum
     LmChannel_COUNT
 } LmChannel;
 
+// 1 bit per texel, rows padded to whole words
 typedef struct mask_s
 {
     int2 size;
-    u8* ptr;
+    i32 stride;                         // words per row
+    i32 count;                          // set bits
+    int2 lo;                            // inclusive bounds of the set bits
+    int2 hi;
+    u64* pim_noalias bits;
+    i32* pim_noalias rowCounts;         // set bits per row
 } mask_t;
 
 typedef struct chartnode_s
@@ -59,25 +77,37 @@ typedef struct chart_s
     mask_t mask;
     chartnode_t* nodes;
     i32 nodeCount;
-    i32 atlasIndex;
+    i32 atlasIndex;                     // also the search cursor while packing
     int2 translation;
     float area;
 } chart_t;
 
 typedef struct atlas_s
 {
-    mutex_t mtx;
     mask_t mask;
     i32 chartCount;
 } atlas_t;
 
 static lmpack_t ms_pack;
 static bool ms_once;
+static u32 ms_bakeIndex;
 
 static cmdstat_t CmdPrintLm(i32 argc, const char** argv);
+static cmdstat_t CmdPackCheck(i32 argc, const char** argv);
+static void CompactTexels(lmpack_t* pack);
 
 lmpack_t* lmpack_get(void) { return &ms_pack; }
 
+static void RegCmds(void)
+{
+    if (!ms_once)
+    {
+        ms_once = true;
+        cmd_reg("lm_print", CmdPrintLm);
+        cmd_reg("lm_pack_check", CmdPackCheck);
+    }
+}
+
 void lightmap_new(lightmap_t* lm, i32 size)
 {
     ASSERT(lm);
@@ -139,19 +169,57 @@ pim_inline void chartnode_sort(chartnode_t* nodes, i32 count)
 
 pim_inline mask_t VEC_CALL mask_new(int2 size)
 {
-    i32 len = size.x * size.y;
-    mask_t mask;
+    mask_t mask = { 0 };
     mask.size = size;
-    mask.ptr = perm_calloc(sizeof(u8) * len);
+    mask.stride = (size.x + 63) >> 6;
+    mask.lo = size;
+    mask.hi = i2_s(-1);
+    mask.bits = perm_calloc(sizeof(mask.bits[0]) * mask.stride * size.y);
+    mask.rowCounts = perm_calloc(sizeof(mask.rowCounts[0]) * size.y);
     return mask;
 }
 
 pim_inline void VEC_CALL mask_del(mask_t* mask)
 {
-    pim_free(mask->ptr);
-    mask->ptr = NULL;
-    mask->size.x = 0;
-    mask->size.y = 0;
+    pim_free(mask->bits);
+    pim_free(mask->rowCounts);
+    memset(mask, 0, sizeof(*mask));
+}
+
+pim_inline void VEC_CALL mask_set(mask_t* mask, i32 x, i32 y)
+{
+    ASSERT(x >= 0);
+    ASSERT(y >= 0);
+    ASSERT(x < mask->size.x);
+    ASSERT(y < mask->size.y);
+    u64* pim_noalias word = mask->bits + y * mask->stride + (x >> 6);
+    const u64 bit = 1ull << (x & 63);
+    if (!(*word & bit))
+    {
+        *word |= bit;
+        mask->rowCounts[y] += 1;
+        mask->count += 1;
+        mask->lo = i2_min(mask->lo, i2_v(x, y));
+        mask->hi = i2_max(mask->hi, i2_v(x, y));
+    }
+}
+
+// word holding bit x and the shift of x within it, floors negative x
+pim_inline i32 mask_word(i32 x, i32* pim_noalias shiftOut)
+{
+    i32 w = (x >= 0) ? (x >> 6) : -((63 - x) >> 6);
+    *shiftOut = x - w * 64;
+    return w;
+}
+
+// 64 bits of a row beginning at bit x, zeroes outside of the row
+pim_inline u64 mask_window(const u64* pim_noalias row, i32 stride, i32 x)
+{
+    i32 s;
+    const i32 w = mask_word(x, &s);
+    const u64 a = ((u32)w < (u32)stride) ? row[w] : 0;
+    const u64 b = ((u32)(w + 1) < (u32)stride) ? row[w + 1] : 0;
+    return s ? ((a >> s) | (b << (64 - s))) : a;
 }
 
 pim_inline float4 VEC_CALL norm_blend(float4 A, float4 B, float4 C, float4 wuv)
@@ -167,57 +235,89 @@ pim_inline float2 VEC_CALL lm_blend(float3 a, float3 b, float3 c, float4 wuv)
     return lm;
 }
 
+// cheap reject of a row offset, using only per row texel counts
+pim_inline bool VEC_CALL mask_rowsfit(mask_t a, mask_t b, i32 y)
+{
+    for (i32 by = b.lo.y; by <= b.hi.y; ++by)
+    {
+        i32 free = a.size.x - a.rowCounts[by + y];
+        if (b.rowCounts[by] > free)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 pim_inline bool VEC_CALL mask_fits(mask_t a, mask_t b, int2 tr)
 {
-    for (i32 by = 0; by < b.size.y; ++by)
+    if (b.count == 0)
+    {
+        return true;
+    }
+    const int2 lo = i2_add(b.lo, tr);
+    const int2 hi = i2_add(b.hi, tr);
+    if (lo.x < 0 || lo.y < 0)
+    {
+        return false;
+    }
+    if (hi.x >= a.size.x || hi.y >= a.size.y)
+    {
+        return false;
+    }
+    const i32 wlo = b.lo.x >> 6;
+    const i32 whi = b.hi.x >> 6;
+    for (i32 by = b.lo.y; by <= b.hi.y; ++by)
     {
-        for (i32 bx = 0; bx < b.size.x; ++bx)
+        const u64* pim_noalias brow = b.bits + by * b.stride;
+        const u64* pim_noalias arow = a.bits + (by + tr.y) * a.stride;
+        for (i32 i = wlo; i <= whi; ++i)
         {
-            i32 bi = bx + by * b.size.x;
-            if (b.ptr[bi])
+            const u64 bw = brow[i];
+            if (bw && (bw & mask_window(arow, a.stride, tr.x + i * 64)))
             {
-                i32 ax = bx + tr.x;
-                i32 ay = by + tr.y;
-                if (ax < 0 || ay < 0)
-                {
-                    return false;
-                }
-                if (ax >= a.size.x || ay >= a.size.y)
-                {
-                    return false;
-                }
-                i32 ai = ax + ay * a.size.x;
-                if (a.ptr[ai])
-                {
-                    return false;
-                }
+                return false;
             }
         }
     }
     return true;
 }
 
-pim_inline void VEC_CALL mask_write(mask_t a, mask_t b, int2 tr)
+pim_inline void VEC_CALL mask_write(mask_t* a, mask_t b, int2 tr)
 {
-    for (i32 by = 0; by < b.size.y; ++by)
+    ASSERT(mask_fits(*a, b, tr));
+    if (b.count == 0)
+    {
+        return;
+    }
+    const i32 wlo = b.lo.x >> 6;
+    const i32 whi = b.hi.x >> 6;
+    for (i32 by = b.lo.y; by <= b.hi.y; ++by)
     {
-        for (i32 bx = 0; bx < b.size.x; ++bx)
+        const u64* pim_noalias brow = b.bits + by * b.stride;
+        u64* pim_noalias arow = a->bits + (by + tr.y) * a->stride;
+        for (i32 i = wlo; i <= whi; ++i)
         {
-            i32 bi = bx + by * b.size.x;
-            if (b.ptr[bi])
+            const u64 bw = brow[i];
+            if (bw)
             {
-                i32 ax = bx + tr.x;
-                i32 ay = by + tr.y;
-                i32 ai = ax + ay * a.size.x;
-                ASSERT(ax >= 0);
-                ASSERT(ay >= 0);
-                ASSERT(ax < a.size.x);
-                ASSERT(ay < a.size.y);
-                ASSERT(!a.ptr[ai]);
-                a.ptr[ai] = b.ptr[bi];
+                i32 s;
+                const i32 w = mask_word(tr.x + i * 64, &s);
+                if ((u32)w < (u32)a->stride)
+                {
+                    arow[w] |= bw << s;
+                }
+                if (s && ((u32)(w + 1) < (u32)a->stride))
+                {
+                    arow[w + 1] |= bw >> (64 - s);
+                }
             }
         }
+        a->rowCounts[by + tr.y] += b.rowCounts[by];
     }
+    a->count += b.count;
+    a->lo = i2_min(a->lo, i2_add(b.lo, tr));
+    a->hi = i2_max(a->hi, i2_add(b.hi, tr));
 }
 
 pim_inline int2 VEC_CALL tri_size(tri2d_t tri)
@@ -248,18 +348,17 @@ pim_inline bool VEC_CALL TriTest(tri2d_t tri, float2 pt)
     return false;
 }
 
-pim_inline void VEC_CALL mask_tri(mask_t mask, tri2d_t tri)
+pim_inline void VEC_CALL mask_tri(mask_t* mask, tri2d_t tri)
 {
-    const int2 size = mask.size;
+    const int2 size = mask->size;
     for (i32 y = 0; y < size.y; ++y)
     {
         for (i32 x = 0; x < size.x; ++x)
         {
-            const i32 i = x + y * size.x;
             float2 pt = { (float)x, (float)y };
             if (TriTest(tri, pt))
             {
-                mask.ptr[i] = 0xff;
+                mask_set(mask, x, y);
             }
         }
     }
@@ -271,27 +370,41 @@ pim_inline mask_t VEC_CALL mask_fromtri(tri2d_t tri)
     size.x += 2;
     size.y += 2;
     mask_t mask = mask_new(size);
-    mask_tri(mask, tri);
+    mask_tri(&mask, tri);
     return mask;
 }
 
-pim_inline bool VEC_CALL mask_find(mask_t atlas, mask_t item, int2* trOut, i32 prevRow)
+// first fit at or after *trInOut, in row major order
+pim_inline bool VEC_CALL mask_find(mask_t atlas, mask_t item, int2* trInOut)
 {
-    int2 lo = i2_addvs(i2_neg(item.size), 1);
-    int2 hi = i2_subvs(atlas.size, 1);
-    i32 y = lo.y;
-    if (prevRow != ROW_RESET)
+    if (item.count == 0)
+    {
+        *trInOut = i2_0;
+        return true;
+    }
+    if ((atlas.size.x * atlas.size.y - atlas.count) < item.count)
     {
-        y = prevRow;
+        return false;
     }
-    for (; y < hi.y; ++y)
+    // translations keeping the item's texels inside of the atlas
+    const int2 lo = i2_neg(item.lo);
+    const int2 hi = i2_sub(i2_subvs(atlas.size, 1), item.hi);
+    int2 tr = *trInOut;
+    if (tr.y < lo.y)
     {
-        for (i32 x = lo.x; x < hi.x; ++x)
+        tr = lo;
+    }
+    for (; tr.y <= hi.y; ++tr.y, tr.x = lo.x)
+    {
+        if (!mask_rowsfit(atlas, item, tr.y))
+        {
+            continue;
+        }
+        for (tr.x = i1_max(tr.x, lo.x); tr.x <= hi.x; ++tr.x)
         {
-            int2 tr = { x, y };
             if (mask_fits(atlas, item, tr))
             {
-                *trOut = tr;
+                *trInOut = tr;
                 return true;
             }
         }
@@ -356,22 +469,36 @@ pim_inline bool VEC_CALL plane_equal(
     return (dist < distThresh) && (cosTheta >= minCosTheta);
 }
 
+// planes are bucketed by distance in distThresh wide buckets,
+// so a match can only be in the same or a neighboring bucket.
+// returns the earliest match, same as a linear search would.
 pim_inline i32 plane_find(
     const plane_t* planes,
-    i32 planeCount,
+    const i32* nextPlane,
+    const dict_t* buckets,
+    i32 key,
     plane_t plane,
     float distThresh,
-    float degreeThresh)
+    float minCosTheta)
 {
-    const float minCosTheta = cosf(degreeThresh * kRadiansPerDegree);
-    for (i32 i = 0; i < planeCount; ++i)
+    i32 found = -1;
+    for (i32 k = key - 1; k <= key + 1; ++k)
     {
-        if (plane_equal(planes[i], plane, distThresh, minCosTheta))
+        int2 list;
+        if (dict_get(buckets, &k, &list))
         {
-            return i;
+            // chains are in ascending order
+            for (i32 i = list.x; (i != -1) && ((found == -1) || (i < found)); i = nextPlane[i])
+            {
+                if (plane_equal(planes[i], plane, distThresh, minCosTheta))
+                {
+                    found = i;
+                    break;
+                }
+            }
         }
     }
-    return -1;
+    return found;
 }
 
 pim_inline void VEC_CALL chart_minmax(chart_t chart, float2* loOut, float2* hiOut)
@@ -572,13 +699,14 @@ static void ChartMaskFn(task_t* pbase, i32 begin, i32 end)
         for (i32 iNode = 0; iNode < chart.nodeCount; ++iNode)
         {
             tri2d_t tri = chart.nodes[iNode].triCoord;
-            mask_tri(chart.mask, tri);
+            mask_tri(&chart.mask, tri);
         }
 
         charts[i] = chart;
     }
 }
 
+ProfileMark(pm_ChartGroup, chart_group)
 static chart_t* chart_group(
     chartnode_t* nodes,
     i32 nodeCount,
@@ -591,27 +719,53 @@ static chart_t* chart_group(
     ASSERT(nodeCount >= 0);
     ASSERT(countOut);
 
+    ProfileBegin(pm_ChartGroup);
+
     i32 chartCount = 0;
     chart_t* charts = NULL;
     plane_t* planes = NULL;
+    i32* nextPlane = NULL;
+    dict_t buckets;
+    dict_new(&buckets, sizeof(i32), sizeof(int2), EAlloc_Perm);
+    const float rcpDist = 1.0f / f1_max(distThresh, kEpsilon);
+    const float minCosTheta = cosf(degreeThresh * kRadiansPerDegree);
 
     // assign nodes to charts by triangle plane
     for (i32 iNode = 0; iNode < nodeCount; ++iNode)
     {
         chartnode_t node = nodes[iNode];
+        const i32 key = (i32)floorf(node.plane.value.w * rcpDist);
         i32 iChart = plane_find(
             planes,
-            chartCount,
+            nextPlane,
+            &buckets,
+            key,
             node.plane,
             distThresh,
-            degreeThresh);
+            minCosTheta);
         if (iChart == -1)
         {
             iChart = chartCount;
             ++chartCount;
             PermGrow(charts, chartCount);
             PermGrow(planes, chartCount);
+            PermGrow(nextPlane, chartCount);
             planes[iChart] = node.plane;
+            nextPlane[iChart] = -1;
+
+            // head, tail
+            int2 list;
+            if (dict_get(&buckets, &key, &list))
+            {
+                nextPlane[list.y] = iChart;
+                list.y = iChart;
+                dict_set(&buckets, &key, &list);
+            }
+            else
+            {
+                list = i2_s(iChart);
+                dict_add(&buckets, &key, &list);
+            }
         }
 
         chart_t chart = charts[iChart];
@@ -623,6 +777,9 @@ static chart_t* chart_group(
 
     pim_free(planes);
     planes = NULL;
+    pim_free(nextPlane);
+    nextPlane = NULL;
+    dict_del(&buckets);
 
     // split big charts
     for (i32 iChart = 0; iChart < chartCount; ++iChart)
@@ -660,6 +817,7 @@ static chart_t* chart_group(
     task->chartCount = chartCount;
     task_run(&task->task, ChartMaskFn, chartCount);
 
+    ProfileEnd(pm_ChartGroup);
     *countOut = chartCount;
     return charts;
 }
@@ -685,7 +843,6 @@ pim_inline void chart_sort(chart_t* charts, i32 chartCount)
 pim_inline atlas_t atlas_new(i32 size)
 {
     atlas_t atlas = { 0 };
-    mutex_create(&atlas.mtx);
     atlas.mask = mask_new(i2_s(size));
     return atlas;
 }
@@ -694,52 +851,28 @@ pim_inline void atlas_del(atlas_t* atlas)
 {
     if (atlas)
     {
-        mutex_destroy(&atlas->mtx);
         mask_del(&atlas->mask);
         memset(atlas, 0, sizeof(*atlas));
     }
 }
 
+// first fit at or after the chart's cursor (atlasIndex, translation).
+// atlases only ever fill up, so positions before the cursor stay unfit.
 static bool atlas_search(
-    atlas_t* pim_noalias atlases,
+    const atlas_t* pim_noalias atlases,
     i32 atlasCount,
-    chart_t* chart,
-    i32* pim_noalias prevAtlas,
-    i32* pim_noalias prevRow)
-{
-    int2 tr;
-    for (i32 i = *prevAtlas; i < atlasCount; ++i)
-    {
-        atlas_t* pim_noalias atlas = atlases + i;
-    retry:
-        if (mask_find(atlas->mask, chart->mask, &tr, *prevRow))
-        {
-            *prevAtlas = i;
-            *prevRow = tr.y;
-            mutex_lock(&atlas->mtx);
-            bool fits = mask_fits(atlas->mask, chart->mask, tr);
-            if (fits)
-            {
-                mask_write(atlas->mask, chart->mask, tr);
-                chart->translation = tr;
-                chart->atlasIndex = i;
-                atlas->chartCount++;
-            }
-            mutex_unlock(&atlas->mtx);
-            if (fits)
-            {
-                return true;
-            }
-            else
-            {
-                goto retry;
-            }
-        }
-        else
+    chart_t* chart)
+{
+    for (i32 i = chart->atlasIndex; i < atlasCount; ++i)
+    {
+        if (mask_find(atlases[i].mask, chart->mask, &chart->translation))
         {
-            *prevRow = ROW_RESET;
+            chart->atlasIndex = i;
+            return true;
         }
+        chart->translation = i2_s(ROW_RESET);
     }
+    chart->atlasIndex = atlasCount;
     return false;
 }
 
@@ -794,56 +927,21 @@ static chartnode_t* chartnodes_create(float texelsPerUnit, i32* countOut)
 typedef struct atlastask_s
 {
     task_t task;
-    i32 nodeHead;
-    i32 chartCount;
-    i32 atlasCount;
     chart_t* charts;
-    atlas_t* atlases;
+    const atlas_t* atlases;
+    i32 atlasCount;
 } atlastask_t;
 
 static void AtlasFn(task_t* pbase, i32 begin, i32 end)
 {
     atlastask_t* task = (atlastask_t*)pbase;
     chart_t* pim_noalias charts = task->charts;
+    const atlas_t* pim_noalias atlases = task->atlases;
     const i32 atlasCount = task->atlasCount;
-    const i32 chartCount = task->chartCount;
-    i32* pim_noalias pHead = &task->nodeHead;
-    atlas_t* pim_noalias atlases = task->atlases;
 
-    i32 prevAtlas = 0;
-    i32 prevRow = ROW_RESET;
-    float prevArea = 1 << 20;
     for (i32 i = begin; i < end; ++i)
     {
-        i32 iChart = inc_i32(pHead, MO_Relaxed);
-        if (iChart >= chartCount)
-        {
-            break;
-        }
-        chart_t chart = charts[iChart];
-        chart.atlasIndex = -1;
-
-        if (chart.area < (prevArea * 0.9f))
-        {
-            prevArea = chart.area;
-            prevAtlas = 0;
-            prevRow = ROW_RESET;
-        }
-
-        while (!atlas_search(
-            atlases,
-            atlasCount,
-            &chart,
-            &prevAtlas,
-            &prevRow))
-        {
-            prevArea = chart.area;
-            prevAtlas = 0;
-            prevRow = ROW_RESET;
-        }
-
-        mask_del(&chart.mask);
-        charts[iChart] = chart;
+        atlas_search(atlases, atlasCount, charts + i);
     }
 }
 
@@ -867,34 +965,81 @@ pim_inline i32 atlas_estimate(i32 atlasSize, const chart_t* charts, i32 chartCou
     return i1_max(1, atlasCount);
 }
 
+ProfileMark(pm_AtlasesCreate, atlases_create)
 static i32 atlases_create(i32 atlasSize, chart_t* charts, i32 chartCount)
 {
+    ProfileBegin(pm_AtlasesCreate);
+
     i32 atlasCount = atlas_estimate(atlasSize, charts, chartCount);
     atlas_t* atlases = perm_calloc(sizeof(atlases[0]) * atlasCount);
     for (i32 i = 0; i < atlasCount; ++i)
     {
         atlases[i] = atlas_new(atlasSize);
     }
+    for (i32 i = 0; i < chartCount; ++i)
+    {
+        charts[i].atlasIndex = 0;
+        charts[i].translation = i2_s(ROW_RESET);
+    }
 
+    // each batch searches in parallel against the atlases as they were,
+    // then commits serially in chart order. a chart whose spot was taken
+    // by an earlier chart of its batch resumes searching from that spot.
     atlastask_t* task = tmp_calloc(sizeof(*task));
-    task->atlasCount = atlasCount;
-    task->atlases = atlases;
-    task->charts = charts;
-    task->chartCount = chartCount;
-    task->nodeHead = 0;
-    task_run(&task->task, AtlasFn, chartCount);
+    for (i32 iBatch = 0; iBatch < chartCount; iBatch += ATLAS_BATCH)
+    {
+        const i32 batchLen = i1_min(ATLAS_BATCH, chartCount - iBatch);
+        task->charts = charts + iBatch;
+        task->atlases = atlases;
+        task->atlasCount = atlasCount;
+        task_run(&task->task, AtlasFn, batchLen);
+
+        for (i32 iChart = iBatch; iChart < (iBatch + batchLen); ++iChart)
+        {
+            chart_t* chart = charts + iChart;
+            bool placed = false;
+            while (!placed)
+            {
+                if (chart->atlasIndex >= atlasCount)
+                {
+                    ++atlasCount;
+                    PermGrow(atlases, atlasCount);
+                    atlases[atlasCount - 1] = atlas_new(atlasSize);
+                }
+                atlas_t* atlas = atlases + chart->atlasIndex;
+                placed = mask_fits(atlas->mask, chart->mask, chart->translation);
+                if (!placed && !atlas_search(atlases, atlasCount, chart) && (atlas->chartCount == 0))
+                {
+                    // only reachable when the chart is larger than an atlas.
+                    // charts wider than a third of an atlas were split already,
+                    // so this is a single huge triangle: leave it unmapped.
+                    con_logf(LogSev_Error, "lm", "chart of %d texels does not fit in an empty atlas, leaving it unmapped", chart->mask.count);
+                    chart->atlasIndex = -1;
+                    chart->translation = i2_0;
+                    break;
+                }
+                if (placed)
+                {
+                    mask_write(&atlas->mask, chart->mask, chart->translation);
+                    atlas->chartCount++;
+                }
+            }
+            mask_del(&chart->mask);
+        }
+    }
 
     i32 usedAtlases = 0;
     for (i32 i = 0; i < atlasCount; ++i)
     {
         if (atlases[i].chartCount > 0)
         {
-            ++usedAtlases;
+            usedAtlases = i + 1;
         }
         atlas_del(atlases + i);
     }
     pim_free(atlases);
 
+    ProfileEnd(pm_AtlasesCreate);
     return usedAtlases;
 }
 
@@ -914,7 +1059,9 @@ static void chartnodes_assign(
         chart_t chart = charts[iChart];
         chartnode_t* pim_noalias nodes = chart.nodes;
         i32 nodeCount = chart.nodeCount;
-        i32 size = lightmaps[chart.atlasIndex].size;
+        // rejected charts still reset their faces, which may hold a stale index
+        const bool mapped = chart.atlasIndex >= 0;
+        i32 size = mapped ? lightmaps[chart.atlasIndex].size : 1;
         const float scale = 1.0f / size;
         const float2 tr = i2_f2(chart.translation);
 
@@ -938,6 +1085,13 @@ static void chartnodes_assign(
                     lm_uvs_new(lmUvs, vertCount);
                 }
                 lmUvs->indices[node.vertIndex / 3] = chart.atlasIndex;
+                if (!mapped)
+                {
+                    lmUvs->uvs[node.vertIndex + 0] = f2_0;
+                    lmUvs->uvs[node.vertIndex + 1] = f2_0;
+                    lmUvs->uvs[node.vertIndex + 2] = f2_0;
+                    continue;
+                }
                 lmUvs->uvs[node.vertIndex + 0] = f2_mulvs(f2_add(node.triCoord.a, tr), scale);
                 lmUvs->uvs[node.vertIndex + 1] = f2_mulvs(f2_add(node.triCoord.b, tr), scale);
                 lmUvs->uvs[node.vertIndex + 2] = f2_mulvs(f2_add(node.triCoord.c, tr), scale);
@@ -950,203 +1104,192 @@ static void chartnodes_assign(
     }
 }
 
-typedef struct quadtree_s
+typedef struct uvtri_s
+{
+    tri2d_t tri;                        // lightmap UV
+    int2 ind;                           // iDrawable, iVert
+} uvtri_t;
+
+// bounding volume hierarchy over the UV triangles of one lightmap
+typedef struct uvbvh_s
 {
-    i32 maxDepth;
     i32 nodeCount;
+    i32 triCount;
     box2d_t* pim_noalias boxes;         // bounding box of node
-    i32* pim_noalias listLens;          // number of triangles in this node
-    tri2d_t** pim_noalias triLists;     // lightmap UV
-    int2** pim_noalias indexLists;      // iDrawable, iVert
-} quadtree_t;
+    int2* pim_noalias nodes;            // leaf: first tri, tri count. inner: first child, 0
+    uvtri_t* pim_noalias tris;
+} uvbvh_t;
 
-pim_inline i32 CalcNodeCount(i32 maxDepth)
+pim_inline box2d_t VEC_CALL tri_bounds(tri2d_t tri)
 {
-    i32 nodeCount = 0;
-    for (i32 i = 0; i < maxDepth; ++i)
-    {
-        nodeCount += 1 << (2 * i);
-    }
-    return nodeCount;
+    box2d_t box;
+    box.lo = f2_min(f2_min(tri.a, tri.b), tri.c);
+    box.hi = f2_max(f2_max(tri.a, tri.b), tri.c);
+    return box;
 }
 
-pim_inline i32 GetChild(i32 parent, i32 i)
+pim_inline i32 uvtri_cmp(const void* plhs, const void* prhs, void* usr)
 {
-    return (parent << 2) | (i + 1);
+    const uvtri_t* lhs = plhs;
+    const uvtri_t* rhs = prhs;
+    const i32 axis = *(const i32*)usr;
+    float2 a = tri_center(lhs->tri);
+    float2 b = tri_center(rhs->tri);
+    float x = axis ? a.y : a.x;
+    float y = axis ? b.y : b.x;
+    if (x != y)
+    {
+        return x < y ? -1 : 1;
+    }
+    return 0;
 }
 
-pim_inline i32 GetParent(i32 c)
+pim_inline void uvbvh_add(uvbvh_t* bvh, tri2d_t tri, i32 iDrawable, i32 iVert)
 {
-    return (c - 1) >> 2;
+    i32 len = bvh->triCount + 1;
+    bvh->triCount = len;
+    PermReserve(bvh->tris, len);
+    bvh->tris[len - 1].tri = tri;
+    bvh->tris[len - 1].ind = i2_v(iDrawable, iVert);
 }
 
-static void SetupBounds(box2d_t* pim_noalias boxes, i32 p, i32 nodeCount)
+static void uvbvh_split(uvbvh_t* pim_noalias bvh, i32 n, i32 first, i32 count)
 {
-    const i32 c0 = GetChild(p, 0);
-    if ((c0 + 4) <= nodeCount)
+    box2d_t box = tri_bounds(bvh->tris[first].tri);
+    for (i32 i = first + 1; i < (first + count); ++i)
     {
-        {
-            float2 pcenter = f2_lerp(boxes[p].lo, boxes[p].hi, 0.5f);
-            float2 pextents = f2_sub(boxes[p].hi, pcenter);
-            float2 cextents = f2_mulvs(pextents, 0.5f);
-            for (i32 i = 0; i < 4; ++i)
-            {
-                float2 sign;
-                sign.x = (i & 1) ? -1.0f : 1.0f;
-                sign.y = (i & 2) ? -1.0f : 1.0f;
-                float2 ccenter = f2_add(pcenter, f2_mul(sign, cextents));
-                boxes[c0 + i].lo = f2_sub(ccenter, cextents);
-                boxes[c0 + i].hi = f2_add(ccenter, cextents);
-            }
-        }
-        for (i32 i = 0; i < 4; ++i)
-        {
-            SetupBounds(boxes, c0 + i, nodeCount);
-        }
+        box2d_t triBox = tri_bounds(bvh->tris[i].tri);
+        box.lo = f2_min(box.lo, triBox.lo);
+        box.hi = f2_max(box.hi, triBox.hi);
     }
-}
+    bvh->boxes[n] = box;
 
-pim_inline void quadtree_new(quadtree_t* qt, i32 maxDepth, box2d_t bounds)
-{
-    i32 len = CalcNodeCount(maxDepth);
-    qt->maxDepth = maxDepth;
-    qt->nodeCount = len;
-    qt->boxes = perm_calloc(sizeof(qt->boxes[0]) * len);
-    qt->listLens = perm_calloc(sizeof(qt->listLens[0]) * len);
-    qt->triLists = perm_calloc(sizeof(qt->triLists[0]) * len);
-    qt->indexLists = perm_calloc(sizeof(qt->indexLists[0]) * len);
-    if (len > 0)
+    if (count <= BVH_LEAF)
     {
-        qt->boxes[0] = bounds;
-        SetupBounds(qt->boxes, 0, len);
+        bvh->nodes[n] = i2_v(first, count);
+        return;
     }
-}
 
-pim_inline void quadtree_del(quadtree_t* qt)
-{
-    if (qt)
-    {
-        pim_free(qt->boxes);
-        pim_free(qt->listLens);
-        i32 len = qt->nodeCount;
-        for (i32 i = 0; i < len; ++i)
-        {
-            pim_free(qt->triLists[i]);
-            pim_free(qt->indexLists[i]);
-        }
-        pim_free(qt->triLists);
-        pim_free(qt->indexLists);
-        memset(qt, 0, sizeof(*qt));
-    }
-}
+    // median split along the longest axis
+    float2 size = f2_sub(box.hi, box.lo);
+    i32 axis = (size.y > size.x) ? 1 : 0;
+    pimsort(bvh->tris + first, count, sizeof(bvh->tris[0]), uvtri_cmp, &axis);
 
-pim_inline bool VEC_CALL BoxHoldsTri(box2d_t box, tri2d_t tri)
-{
-    float2 lo = box.lo;
-    float2 hi = box.hi;
-    bool2 a = b2_and(b2_and(f2_gteq(tri.a, lo), f2_gteq(tri.b, lo)), f2_gteq(tri.c, lo));
-    bool2 b = b2_and(b2_and(f2_lteq(tri.a, hi), f2_lteq(tri.b, hi)), f2_lteq(tri.c, hi));
-    return b2_all(b2_and(a, b));
+    const i32 child = bvh->nodeCount;
+    bvh->nodeCount += 2;
+    bvh->nodes[n] = i2_v(child, 0);
+    const i32 half = count / 2;
+    uvbvh_split(bvh, child + 0, first, half);
+    uvbvh_split(bvh, child + 1, first + half, count - half);
 }
 
-pim_inline bool VEC_CALL BoxHoldsPt(box2d_t box, float2 pt)
+static void uvbvh_build(uvbvh_t* bvh)
 {
-    return b2_all(b2_and(f2_gteq(pt, box.lo), f2_lteq(pt, box.hi)));
+    const i32 triCount = bvh->triCount;
+    if (triCount > 0)
+    {
+        const i32 maxNodes = triCount * 2;
+        bvh->boxes = perm_calloc(sizeof(bvh->boxes[0]) * maxNodes);
+        bvh->nodes = perm_calloc(sizeof(bvh->nodes[0]) * maxNodes);
+        bvh->nodeCount = 1;
+        uvbvh_split(bvh, 0, 0, triCount);
+        ASSERT(bvh->nodeCount <= maxNodes);
+    }
 }
 
-static bool quadtree_insert(quadtree_t* pim_noalias qt, i32 n, tri2d_t tri, i32 iDrawable, i32 iVert)
+pim_inline void uvbvh_del(uvbvh_t* bvh)
 {
-    if (n < qt->nodeCount)
+    if (bvh)
     {
-        if (BoxHoldsTri(qt->boxes[n], tri))
-        {
-            for (i32 i = 0; i < 4; ++i)
-            {
-                if (quadtree_insert(qt, GetChild(n, i), tri, iDrawable, iVert))
-                {
-                    return true;
-                }
-            }
-            i32 len = qt->listLens[n] + 1;
-            qt->listLens[n] = len;
-            PermReserve(qt->triLists[n], len);
-            qt->triLists[n][len - 1] = tri;
-            PermReserve(qt->indexLists[n], len);
-            qt->indexLists[n][len - 1] = i2_v(iDrawable, iVert);
-            return true;
-        }
+        pim_free(bvh->boxes);
+        pim_free(bvh->nodes);
+        pim_free(bvh->tris);
+        memset(bvh, 0, sizeof(*bvh));
     }
-    return false;
 }
 
-static float quadtree_find(
-    const quadtree_t* qt,
-    i32 n,
+// nearest triangle closer than limit
+static float uvbvh_find(
+    const uvbvh_t* bvh,
     float2 pt,
     float limit,
     int2* pim_noalias indOut)
 {
-    if (n < qt->nodeCount)
+    int2 ind = { -1, -1 };
+    i32 stack[BVH_STACK];
+    i32 top = 0;
+    if (bvh->nodeCount > 0)
+    {
+        stack[top++] = 0;
+    }
+    while (top > 0)
     {
-        if (BoxHoldsPt(qt->boxes[n], pt))
+        const i32 n = stack[--top];
+        // triangles are never closer than their bounds
+        if (sdBox2D(bvh->boxes[n], pt) > f1_max(limit, 0.0f))
         {
-            i32 chosen = -1;
-            float chosenDist = limit;
-            i32 len = qt->listLens[n];
-            const tri2d_t* triList = qt->triLists[n];
-            for (i32 i = 0; i < len; ++i)
-            {
-                tri2d_t tri = triList[i];
-                float dist = sdTriangle2D(tri.a, tri.b, tri.c, pt);
-                if (dist < chosenDist)
-                {
-                    chosenDist = dist;
-                    chosen = i;
-                }
-            }
-
-            int2 ind = { -1, -1 };
-            if (chosenDist < limit)
-            {
-                limit = chosenDist;
-                ind = qt->indexLists[n][chosen];
-            }
-
-            for (i32 i = 0; i < 4; ++i)
+            continue;
+        }
+        const int2 node = bvh->nodes[n];
+        if (node.y > 0)
+        {
+            for (i32 i = node.x; i < (node.x + node.y); ++i)
             {
-                int2 childInd = { -1, -1 };
-                float childDist = quadtree_find(qt, GetChild(n, i), pt, limit, &childInd);
-                if (childDist < limit)
+                const uvtri_t tri = bvh->tris[i];
+                float dist = sdTriangle2D(tri.tri.a, tri.tri.b, tri.tri.c, pt);
+                if (dist < limit)
                 {
-                    limit = childDist;
-                    ind = childInd;
+                    limit = dist;
+                    ind = tri.ind;
                 }
             }
-            *indOut = ind;
+        }
+        else
+        {
+            ASSERT((top + 2) <= BVH_STACK);
+            stack[top++] = node.x + 1;
+            stack[top++] = node.x + 0;
         }
     }
+    *indOut = ind;
     return limit;
 }
 
+typedef struct uvbvhtask_s
+{
+    task_t task;
+    uvbvh_t* bvhs;
+} uvbvhtask_t;
+
+static void UvBvhFn(task_t* pbase, i32 begin, i32 end)
+{
+    uvbvhtask_t* task = (uvbvhtask_t*)pbase;
+    uvbvh_t* pim_noalias bvhs = task->bvhs;
+    for (i32 i = begin; i < end; ++i)
+    {
+        uvbvh_build(bvhs + i);
+    }
+}
+
 typedef struct embed_s
 {
     task_t task;
     lightmap_t* lightmaps;
-    const quadtree_t* trees;
+    const uvbvh_t* bvhs;
     i32 lmCount;
     float texelsPerMeter;
-    const pt_scene_t* scene;
+    bool keepSamples;       // only move texels, the atlas layout is unchanged
 } embed_t;
 
 static void EmbedAttributesFn(task_t* pbase, i32 begin, i32 end)
 {
     embed_t* task = (embed_t*)pbase;
     lightmap_t* pim_noalias lightmaps = task->lightmaps;
-    const quadtree_t* pim_noalias trees = task->trees;
-    const pt_scene_t* scene = task->scene;
+    const uvbvh_t* pim_noalias bvhs = task->bvhs;
     const i32 lmCount = task->lmCount;
     const float texelsPerMeter = task->texelsPerMeter;
     const float metersPerTexel = 1.0f / texelsPerMeter;
+    const bool keepSamples = task->keepSamples;
     const i32 lmSize = lightmaps[0].size;
     const i32 lmLen = lmSize * lmSize;
     const int2 size = { lmSize, lmSize };
@@ -1167,12 +1310,22 @@ static void EmbedAttributesFn(task_t* pbase, i32 begin, i32 end)
         const i32 y = iTexel / lmSize;
         const float2 uv = CoordToUv(size, i2_v(x, y));
         lightmap_t lightmap = lightmaps[iLightmap];
-        const quadtree_t* qt = trees + iLightmap;
+        const uvbvh_t* bvh = bvhs + iLightmap;
 
-        lightmap.sampleCounts[iTexel] = 0.0f;
+        if (keepSamples)
+        {
+            if (lightmap.sampleCounts[iTexel] == 0.0f)
+            {
+                continue;
+            }
+        }
+        else
+        {
+            lightmap.sampleCounts[iTexel] = 0.0f;
+        }
 
         int2 ind;
-        float dist = quadtree_find(qt, 0, uv, limit, &ind);
+        float dist = uvbvh_find(bvh, uv, limit, &ind);
         if ((dist < limit) && (ind.x != -1) && (ind.y != -1))
         {
             i32 iDraw = ind.x;
@@ -1230,28 +1383,25 @@ static void EmbedAttributesFn(task_t* pbase, i32 begin, i32 end)
 
             lightmap.position[iTexel] = f4_f3(P);
             lightmap.normal[iTexel] = f4_f3(N);
-            lightmap.sampleCounts[iTexel] = 1.0f;
+            if (!keepSamples)
+            {
+                lightmap.sampleCounts[iTexel] = 1.0f;
+            }
         }
     }
 }
 
+ProfileMark(pm_EmbedAttributes, EmbedAttributes)
 static void EmbedAttributes(
-    const pt_scene_t* scene,
     lightmap_t* lightmaps,
     i32 lmCount,
-    float texelsPerMeter)
+    float texelsPerMeter,
+    bool keepSamples)
 {
+    ProfileBegin(pm_EmbedAttributes);
     if (lmCount > 0)
     {
-        quadtree_t* trees = tmp_calloc(sizeof(trees[0]) * lmCount);
-        {
-            const float eps = 0.01f;
-            box2d_t bounds = { f2_s(0.0f - eps), f2_s(1.0f + eps) };
-            for (i32 i = 0; i < lmCount; ++i)
-            {
-                quadtree_new(trees + i, 5, bounds);
-            }
-        }
+        uvbvh_t* bvhs = tmp_calloc(sizeof(bvhs[0]) * lmCount);
 
         {
             const drawables_t* drawables = drawables_get();
@@ -1282,27 +1432,30 @@ static void EmbedAttributes(
                         float2 B = lmUvs.uvs[iVert + 1];
                         float2 C = lmUvs.uvs[iVert + 2];
                         tri2d_t tri = { A, B, C };
-                        quadtree_t* tree = trees + iMap;
-                        bool inserted = quadtree_insert(tree, 0, tri, iDraw, iVert);
-                        ASSERT(inserted);
+                        uvbvh_add(bvhs + iMap, tri, iDraw, iVert);
                     }
                 }
             }
         }
 
+        uvbvhtask_t* bvhTask = tmp_calloc(sizeof(*bvhTask));
+        bvhTask->bvhs = bvhs;
+        task_run(&bvhTask->task, UvBvhFn, lmCount);
+
         embed_t* task = tmp_calloc(sizeof(*task));
         task->lightmaps = lightmaps;
-        task->trees = trees;
+        task->bvhs = bvhs;
         task->lmCount = lmCount;
         task->texelsPerMeter = texelsPerMeter;
-        task->scene = scene;
+        task->keepSamples = keepSamples;
         task_run(&task->task, EmbedAttributesFn, TexelCount(lightmaps, lmCount));
 
         for (i32 i = 0; i < lmCount; ++i)
         {
-            quadtree_del(trees + i);
+            uvbvh_del(bvhs + i);
         }
     }
+    ProfileEnd(pm_EmbedAttributes);
 }
 
 lmpack_t lmpack_pack(
@@ -1315,11 +1468,7 @@ lmpack_t lmpack_pack(
     ASSERT(scene);
     ASSERT(atlasSize > 0);
 
-    if (!ms_once)
-    {
-        ms_once = true;
-        cmd_reg("lm_print", CmdPrintLm);
-    }
+    RegCmds();
 
     float maxWidth = atlasSize / 3.0f;
 
@@ -1348,7 +1497,8 @@ lmpack_t lmpack_pack(
 
     chartnodes_assign(charts, chartCount, pack.lightmaps, atlasCount);
 
-    EmbedAttributes(scene, pack.lightmaps, atlasCount, texelsPerUnit);
+    EmbedAttributes(pack.lightmaps, atlasCount, texelsPerUnit, false);
+    CompactTexels(&pack);
 
     pim_free(nodes);
     for (i32 i = 0; i < chartCount; ++i)
@@ -1369,51 +1519,244 @@ void lmpack_del(lmpack_t* pack)
             lightmap_del(pack->lightmaps + i);
         }
         pim_free(pack->lightmaps);
+        if (fmap_isopen(pack->map))
+        {
+            fd_t fd = pack->map.fd;
+            fmap_destroy(&pack->map);
+            fd_close(&fd);
+        }
+        pim_free(pack->texels);
+        pim_free(pack->lumMoments);
+        pim_free(pack->priorities);
         memset(pack, 0, sizeof(*pack));
     }
 }
 
+// relative deviation of a texel's luminance samples, 1 until it is known
+pim_inline float VEC_CALL RelDeviation(float3 lumMoments)
+{
+    if (lumMoments.z < 2.0f)
+    {
+        return 1.0f;
+    }
+    const float mean = lumMoments.x;
+    const float variance = f1_max(0.0f, lumMoments.y - mean * mean);
+    return sqrtf(variance) / f1_max(mean, kMilli);
+}
+
+// approximate relative error of a texel's estimate: variance raises it and
+// every sample lowers it, so low variance texels are refined eventually too
+pim_inline float VEC_CALL BakePriority(float3 lumMoments, float sampleCount)
+{
+    return (1.0f + RelDeviation(lumMoments)) / sqrtf(sampleCount);
+}
+
+pim_inline i32 VEC_CALL PriorityBucket(float priority)
+{
+    i32 bucket = (BAKE_BUCKETS / 2) + (i32)floorf(log2f(f1_max(priority, kEpsilon)) * 8.0f);
+    return i1_clamp(bucket, 0, BAKE_BUCKETS - 1);
+}
+
+ProfileMark(pm_CompactTexels, CompactTexels)
+static void CompactTexels(lmpack_t* pack)
+{
+    ProfileBegin(pm_CompactTexels);
+
+    const i32 lmCount = pack->lmCount;
+    const i32 lmSize = pack->lmSize;
+    const i32 lmLen = lmSize * lmSize;
+    i32 mortonSize = 1;
+    while (mortonSize < lmSize)
+    {
+        mortonSize <<= 1;
+    }
+    const u32 mortonLen = (u32)(mortonSize * mortonSize);
+
+    i32 count = 0;
+    for (i32 i = 0; i < lmCount; ++i)
+    {
+        const float* pim_noalias sampleCounts = pack->lightmaps[i].sampleCounts;
+        for (i32 j = 0; j < lmLen; ++j)
+        {
+            count += sampleCounts[j] != 0.0f;
+        }
+    }
+
+    i32* pim_noalias texels = perm_malloc(sizeof(texels[0]) * count);
+    float3* pim_noalias lumMoments = perm_calloc(sizeof(lumMoments[0]) * count);
+    float* pim_noalias priorities = perm_malloc(sizeof(priorities[0]) * count);
+    i32 k = 0;
+    for (i32 i = 0; i < lmCount; ++i)
+    {
+        const float* pim_noalias sampleCounts = pack->lightmaps[i].sampleCounts;
+        for (u32 m = 0; m < mortonLen; ++m)
+        {
+            const i32 x = (i32)MortonCompact(m);
+            const i32 y = (i32)MortonCompact(m >> 1);
+            if ((x >= lmSize) || (y >= lmSize))
+            {
+                continue;
+            }
+            const i32 iTexel = x + y * lmSize;
+            const float sampleCount = sampleCounts[iTexel];
+            if (sampleCount != 0.0f)
+            {
+                // moments of loaded texels are unknown until they are traced again
+                texels[k] = i * lmLen + iTexel;
+                priorities[k] = BakePriority(lumMoments[k], sampleCount);
+                ++k;
+            }
+        }
+    }
+    ASSERT(k == count);
+
+    pim_free(pack->texels);
+    pim_free(pack->lumMoments);
+    pim_free(pack->priorities);
+    pack->texels = texels;
+    pack->lumMoments = lumMoments;
+    pack->priorities = priorities;
+    pack->texelCount = count;
+
+    ProfileEnd(pm_CompactTexels);
+}
+
+typedef struct histogram_s
+{
+    task_t task;
+    i32 counts[BAKE_BUCKETS];
+} histogram_t;
+
+static void HistogramFn(task_t* pbase, i32 begin, i32 end)
+{
+    histogram_t* task = (histogram_t*)pbase;
+    const float* pim_noalias priorities = lmpack_get()->priorities;
+
+    i32 counts[BAKE_BUCKETS] = { 0 };
+    for (i32 i = begin; i < end; ++i)
+    {
+        ++counts[PriorityBucket(priorities[i])];
+    }
+    for (i32 i = 0; i < BAKE_BUCKETS; ++i)
+    {
+        if (counts[i])
+        {
+            fetch_add_i32(task->counts + i, counts[i], MO_Relaxed);
+        }
+    }
+}
+
 typedef struct bake_s
 {
     task_t task;
     pt_scene_t* scene;
-    float timeSlice;
+    i32 minBucket;          // texels below this bucket are not traced
+    float edgeFraction;     // fraction of minBucket that is traced
+    u32 bakeIndex;
 } bake_t;
 
-static void BakeFn(task_t* pbase, i32 begin, i32 end)
+static void BakeAccumulate(lmpack_t* pack, i32 iCompact, float4 Lws, float3 color)
 {
-    const i32 tid = task_thread_id();
+    const i32 lmLen = pack->lmSize * pack->lmSize;
+    const i32 iWork = pack->texels[iCompact];
+    const i32 iLightmap = iWork / lmLen;
+    const i32 iTexel = iWork % lmLen;
+    lightmap_t lightmap = pack->lightmaps[iLightmap];
+
+    const float sampleCount = lightmap.sampleCounts[iTexel];
+    const float weight = 1.0f / sampleCount;
+    const float4 N = f4_normalize3(f3_f4(lightmap.normal[iTexel], 0.0f));
+    const float3x3 TBN = NormalToTBN(N);
 
+    float4 probe[kGiDirections];
+    float4 axii[kGiDirections];
+    for (i32 i = 0; i < kGiDirections; ++i)
+    {
+        probe[i] = lightmap.probes[i][iTexel];
+        float4 ax = pack->axii[i];
+        float sharpness = ax.w;
+        ax = TbnToWorld(TBN, ax);
+        ax.w = sharpness;
+        axii[i] = ax;
+    }
+    SG_Accumulate(weight, Lws, f3_f4(color, 0.0f), axii, probe, kGiDirections);
+    for (i32 i = 0; i < kGiDirections; ++i)
+    {
+        lightmap.probes[i][iTexel] = probe[i];
+    }
+    lightmap.sampleCounts[iTexel] = sampleCount + 1.0f;
+
+    const float lum = f4_perlum(f3_f4(color, 0.0f));
+    float3 moments = pack->lumMoments[iCompact];
+    moments.z += 1.0f;
+    const float momentWeight = 1.0f / moments.z;
+    moments.x = f1_lerp(moments.x, lum, momentWeight);
+    moments.y = f1_lerp(moments.y, lum * lum, momentWeight);
+    pack->lumMoments[iCompact] = moments;
+    pack->priorities[iCompact] = BakePriority(moments, sampleCount + 1.0f);
+}
+
+static void BakeBatch(
+    pt_sampler_t* samplers,
+    pt_scene_t* scene,
+    lmpack_t* pack,
+    const ray_t* rays,
+    pt_result_t* results,
+    const i32* works,
+    i32 count)
+{
+    if (count > 0)
+    {
+        pt_trace_rays(samplers, scene, rays, results, count, false, 0.0f);
+        for (i32 i = 0; i < count; ++i)
+        {
+            BakeAccumulate(pack, works[i], rays[i].rd, results[i].color);
+        }
+    }
+}
+
+static void BakeFn(task_t* pbase, i32 begin, i32 end)
+{
     bake_t* task = (bake_t*)pbase;
     pt_scene_t* scene = task->scene;
-    const float timeSlice = task->timeSlice;
+    const i32 minBucket = task->minBucket;
+    const float edgeFraction = task->edgeFraction;
+    const u32 bakeIndex = task->bakeIndex;
 
     lmpack_t* pack = lmpack_get();
     const i32 lmSize = pack->lmSize;
     const i32 lmLen = lmSize * lmSize;
-    const float rcpSize = 1.0f / lmSize;
-    const int2 size = { lmSize, lmSize };
+    const i32* pim_noalias texels = pack->texels;
+    const float* pim_noalias priorities = pack->priorities;
 
-    pt_sampler_t sampler = pt_sampler_get();
-    for (i32 iWork = begin; iWork < end; ++iWork)
-    {
-        i32 iLightmap = iWork / lmLen;
-        i32 iTexel = iWork % lmLen;
-        lightmap_t lightmap = pack->lightmaps[iLightmap];
+    // texels are gathered into batches that are traced together
+    ray_t rays[BAKE_BATCH];
+    pt_result_t results[BAKE_BATCH];
+    i32 works[BAKE_BATCH];
+    pt_sampler_t samplers[BAKE_BATCH];
+    i32 count = 0;
 
-        float sampleCount = lightmap.sampleCounts[iTexel];
-        if (sampleCount == 0.0f)
+    for (i32 i = begin; i < end; ++i)
+    {
+        const i32 bucket = PriorityBucket(priorities[i]);
+        if (bucket < minBucket)
         {
             continue;
         }
-
-        float weight = 1.0f / sampleCount;
-        float prob = f1_lerp(timeSlice, timeSlice * 2.0f, weight);
-        if (pt_sample_1d(&sampler) > prob)
+        const i32 iWork = texels[i];
+        if ((bucket == minBucket) &&
+            (U32ToUnorm(HashCombine32(HashU32(iWork), bakeIndex)) >= edgeFraction))
         {
             continue;
         }
 
+        i32 iLightmap = iWork / lmLen;
+        i32 iTexel = iWork % lmLen;
+        lightmap_t lightmap = pack->lightmaps[iLightmap];
+
+        float sampleCount = lightmap.sampleCounts[iTexel];
+        pt_sampler_t sampler = pt_sampler_pixel(iWork, (u32)sampleCount - 1u);
+
         float3 P3 = lightmap.position[iTexel];
         float3 N3 = lightmap.normal[iTexel];
 
@@ -1425,28 +1768,18 @@ static void BakeFn(task_t* pbase, i32 begin, i32 end)
         float4 Lts = SampleUnitHemisphere(pt_sample_2d(&sampler));
         float4 Lws = TbnToWorld(TBN, Lts);
 
-        ray_t ray = { P, Lws };
-        pt_result_t result = pt_trace_ray(&sampler, scene, ray);
+        rays[count] = (ray_t) { P, Lws };
+        works[count] = i;
+        samplers[count] = sampler;
+        ++count;
 
-        float4 probe[kGiDirections];
-        float4 axii[kGiDirections];
-        for (i32 i = 0; i < kGiDirections; ++i)
-        {
-            probe[i] = lightmap.probes[i][iTexel];
-            float4 ax = pack->axii[i];
-            float sharpness = ax.w;
-            ax = TbnToWorld(TBN, ax);
-            ax.w = sharpness;
-            axii[i] = ax;
-        }
-        SG_Accumulate(weight, Lws, f3_f4(result.color, 0.0f), axii, probe, kGiDirections);
-        for (i32 i = 0; i < kGiDirections; ++i)
+        if (count == BAKE_BATCH)
         {
-            lightmap.probes[i][iTexel] = probe[i];
+            BakeBatch(samplers, scene, pack, rays, results, works, count);
+            count = 0;
         }
-        lightmap.sampleCounts[iTexel] = sampleCount + 1.0f;
     }
-    pt_sampler_set(sampler);
+    BakeBatch(samplers, scene, pack, rays, results, works, count);
 }
 
 ProfileMark(pm_Bake, lmpack_bake)
@@ -1456,25 +1789,168 @@ void lmpack_bake(pt_scene_t* scene, float timeSlice)
     ASSERT(scene);
 
     const lmpack_t* pack = lmpack_get();
-    i32 texelCount = TexelCount(pack->lightmaps, pack->lmCount);
+    const i32 texelCount = pack->texelCount;
     if (texelCount > 0)
     {
-        bake_t* task = perm_calloc(sizeof(*task));
+        // refine the timeSlice fraction of texels with the highest priority
+        histogram_t* histogram = tmp_calloc(sizeof(*histogram));
+        task_run(&histogram->task, HistogramFn, texelCount);
+
+        const i32 budget = i1_max(1, (i32)ceilf(texelCount * f1_sat(timeSlice)));
+        i32 minBucket = 0;
+        float edgeFraction = 1.0f;
+        i32 selected = 0;
+        for (i32 i = BAKE_BUCKETS - 1; i >= 0; --i)
+        {
+            const i32 bucketCount = histogram->counts[i];
+            if ((selected + bucketCount) >= budget)
+            {
+                minBucket = i;
+                edgeFraction = (float)(budget - selected) / (float)bucketCount;
+                break;
+            }
+            selected += bucketCount;
+        }
+
+        bake_t* task = tmp_calloc(sizeof(*task));
         task->scene = scene;
-        task->timeSlice = timeSlice;
+        task->minBucket = minBucket;
+        task->edgeFraction = edgeFraction;
+        task->bakeIndex = ms_bakeIndex++;
         task_run(&task->task, BakeFn, texelCount);
     }
 
     ProfileEnd(pm_Bake);
 }
 
+lmprogress_t lmpack_progress(const lmpack_t* pack)
+{
+    ASSERT(pack);
+    lmprogress_t progress = { 0 };
+    const i32 texelCount = pack->texelCount;
+    if (texelCount > 0)
+    {
+        const i32 lmLen = pack->lmSize * pack->lmSize;
+        const i32* pim_noalias texels = pack->texels;
+        const float3* pim_noalias lumMoments = pack->lumMoments;
+
+        float minSamples = 1 << 30;
+        double sumSamples = 0.0;
+        float maxError = 0.0f;
+        for (i32 i = 0; i < texelCount; ++i)
+        {
+            const i32 iWork = texels[i];
+            const lightmap_t lightmap = pack->lightmaps[iWork / lmLen];
+            // sampleCounts begin at 1 for occupied texels
+            const float samples = lightmap.sampleCounts[iWork % lmLen] - 1.0f;
+            minSamples = f1_min(minSamples, samples);
+            sumSamples += samples;
+
+            const float3 moments = lumMoments[i];
+            const float error = (moments.z < 2.0f) ?
+                (1 << 30) : (RelDeviation(moments) / sqrtf(moments.z));
+            maxError = f1_max(maxError, error);
+        }
+
+        progress.texelCount = texelCount;
+        progress.minSamples = minSamples;
+        progress.meanSamples = (float)(sumSamples / texelCount);
+        progress.maxError = maxError;
+    }
+    return progress;
+}
+
+void lmpack_embed(lmpack_t* pack)
+{
+    ASSERT(pack);
+    // runtime packs have no texel attributes
+    if (!fmap_isopen(pack->map))
+    {
+        EmbedAttributes(pack->lightmaps, pack->lmCount, pack->texelsPerMeter, true);
+    }
+}
+
+typedef struct invalidate_s
+{
+    task_t task;
+    lmpack_t* pack;
+    box_t bounds;
+    i32 count;
+} invalidate_t;
+
+static void InvalidateFn(task_t* pbase, i32 begin, i32 end)
+{
+    invalidate_t* task = (invalidate_t*)pbase;
+    lmpack_t* pack = task->pack;
+    const box_t bounds = task->bounds;
+    const i32 lmSize = pack->lmSize;
+    const i32 lmLen = lmSize * lmSize;
+    const i32* pim_noalias texels = pack->texels;
+    float3* pim_noalias lumMoments = pack->lumMoments;
+    float* pim_noalias priorities = pack->priorities;
+    // restarted texels rank with the least converged ones
+    const float priority = BakePriority(f3_0, 1.0f);
+
+    i32 count = 0;
+    for (i32 i = begin; i < end; ++i)
+    {
+        const i32 iWork = texels[i];
+        const i32 iTexel = iWork % lmLen;
+        lightmap_t lightmap = pack->lightmaps[iWork / lmLen];
+        if (box_contains(bounds, f3_f4(lightmap.position[iTexel], 1.0f)))
+        {
+            for (i32 j = 0; j < kGiDirections; ++j)
+            {
+                lightmap.probes[j][iTexel] = f4_0;
+            }
+            lightmap.sampleCounts[iTexel] = 1.0f;
+            lumMoments[i] = f3_0;
+            priorities[i] = priority;
+            ++count;
+        }
+    }
+    if (count)
+    {
+        fetch_add_i32(&task->count, count, MO_Relaxed);
+    }
+}
+
+ProfileMark(pm_Invalidate, lmpack_invalidate)
+i32 lmpack_invalidate(lmpack_t* pack, box_t bounds)
+{
+    ASSERT(pack);
+    if (fmap_isopen(pack->map) || (pack->texelCount == 0))
+    {
+        return 0;
+    }
+    ProfileBegin(pm_Invalidate);
+
+    invalidate_t* task = tmp_calloc(sizeof(*task));
+    task->pack = pack;
+    task->bounds = bounds;
+    task_run(&task->task, InvalidateFn, pack->texelCount);
+
+    ProfileEnd(pm_Invalidate);
+    return task->count;
+}
+
 bool lmpack_save(const lmpack_t* pack, guid_t name)
 {
     ASSERT(pack);
+    if (fmap_isopen(pack->map))
+    {
+        // runtime packs hold no editing data, keep the existing file
+        return false;
+    }
     char filename[PIM_PATH] = "data/";
     guid_tofile(ARGS(filename), name, ".lmpack");
+    // written aside and swapped in, an interrupted save keeps the old file
+    char tmpname[PIM_PATH] = { 0 };
+    SPrintf(ARGS(tmpname), "%s.tmp", filename);
+    // dir errors are sticky per thread, drop any left by earlier calls
+    dir_errno();
 
-    fstr_t fd = fstr_open(filename, "wb");
+    fstr_t fd = fstr_open(tmpname, "wb");
     if (fstr_isopen(fd))
     {
         const i32 lmcount = pack->lmCount;
@@ -1538,17 +2014,151 @@ bool lmpack_save(const lmpack_t* pack, guid_t name)
             ASSERT(wrote == sizeof(lm.sampleCounts[0]) * texelcount);
         }
 
+        // only swap in a file that fully reached the disk
+        const bool synced = fstr_sync(fd) == 0;
         fstr_close(&fd);
-        return true;
+        if (!synced)
+        {
+            return false;
+        }
+        pim_rename(tmpname, filename);
+        return dir_errno() == 0;
     }
     return false;
 }
 
+bool lmpack_save_runtime(const lmpack_t* pack, guid_t name)
+{
+    ASSERT(pack);
+    if (fmap_isopen(pack->map))
+    {
+        // already in the runtime format
+        return false;
+    }
+
+    char filename[PIM_PATH] = "data/";
+    guid_tofile(ARGS(filename), name, ".lmrt");
+    char tmpname[PIM_PATH] = { 0 };
+    SPrintf(ARGS(tmpname), "%s.tmp", filename);
+    // dir errors are sticky per thread, drop any left by earlier calls
+    dir_errno();
+
+    fstr_t fd = fstr_open(tmpname, "wb");
+    if (!fstr_isopen(fd))
+    {
+        return false;
+    }
+
+    const i32 lmcount = pack->lmCount;
+    const i32 lmSize = pack->lmSize;
+    const i32 texelcount = lmSize * lmSize;
+
+    dlmruntime_t hdr = { 0 };
+    hdr.version = kLmRuntimeVersion;
+    hdr.directions = kGiDirections;
+    hdr.lmCount = lmcount;
+    hdr.lmSize = lmSize;
+    memcpy(hdr.axii, pack->axii, sizeof(pack->axii));
+    hdr.texelsPerMeter = pack->texelsPerMeter;
+    hdr.probesOffset = sizeof(hdr);
+    i32 wrote = fstr_write(fd, &hdr, sizeof(hdr));
+    ASSERT(wrote == sizeof(hdr));
+
+    u32* pim_noalias plane = perm_malloc(sizeof(plane[0]) * texelcount);
+    for (i32 i = 0; i < lmcount; ++i)
+    {
+        const lightmap_t lm = pack->lightmaps[i];
+        ASSERT(lm.size == lmSize);
+        for (i32 j = 0; j < kGiDirections; ++j)
+        {
+            const float4* pim_noalias probes = lm.probes[j];
+            for (i32 k = 0; k < texelcount; ++k)
+            {
+                plane[k] = f4_rgb9e5(probes[k]);
+            }
+            wrote = fstr_write(fd, plane, sizeof(plane[0]) * texelcount);
+            ASSERT(wrote == sizeof(plane[0]) * texelcount);
+        }
+    }
+    pim_free(plane);
+
+    const bool synced = fstr_sync(fd) == 0;
+    fstr_close(&fd);
+    if (!synced)
+    {
+        return false;
+    }
+    pim_rename(tmpname, filename);
+    return dir_errno() == 0;
+}
+
+bool lmpack_load_runtime(lmpack_t* pack, guid_t name)
+{
+    ASSERT(pack);
+    RegCmds();
+    char filename[PIM_PATH] = "data/";
+    guid_tofile(ARGS(filename), name, ".lmrt");
+
+    lmpack_del(pack);
+
+    fd_t fd = fd_open(filename, false);
+    if (!fd_isopen(fd))
+    {
+        return false;
+    }
+    fmap_t map = fmap_create(fd, false);
+    if (!fmap_isopen(map))
+    {
+        fd_close(&fd);
+        return false;
+    }
+
+    const dlmruntime_t* hdr = map.ptr;
+    bool valid = map.size >= sizeof(*hdr);
+    valid = valid && (hdr->version == kLmRuntimeVersion);
+    valid = valid && (hdr->directions == kGiDirections);
+    valid = valid && (hdr->lmCount >= 0) && (hdr->lmSize > 0);
+    valid = valid && ((hdr->probesOffset & 15) == 0);
+    const i32 texelcount = valid ? hdr->lmSize * hdr->lmSize : 0;
+    const i64 expected = valid ?
+        (hdr->probesOffset + (i64)sizeof(u32) * texelcount * kGiDirections * hdr->lmCount) : 0;
+    valid = valid && (map.size >= expected);
+    if (!valid)
+    {
+        con_logf(LogSev_Error, "lm", "'%s' is not a valid runtime lightmap pack", filename);
+        fmap_destroy(&map);
+        fd_close(&fd);
+        return false;
+    }
+
+    const i32 lmcount = hdr->lmCount;
+    pack->lmCount = lmcount;
+    pack->lmSize = hdr->lmSize;
+    pack->texelsPerMeter = hdr->texelsPerMeter;
+    memcpy(pack->axii, hdr->axii, sizeof(hdr->axii));
+    pack->lightmaps = perm_calloc(sizeof(pack->lightmaps[0]) * lmcount);
+
+    const u32* planes = (const u32*)((const u8*)map.ptr + hdr->probesOffset);
+    for (i32 i = 0; i < lmcount; ++i)
+    {
+        lightmap_t* lm = pack->lightmaps + i;
+        lm->size = hdr->lmSize;
+        for (i32 j = 0; j < kGiDirections; ++j)
+        {
+            lm->packed[j] = planes + (i * kGiDirections + j) * texelcount;
+        }
+    }
+    pack->map = map;
+
+    return true;
+}
+
 bool lmpack_load(lmpack_t* pack, guid_t name)
 {
     bool loaded = false;
 
     ASSERT(pack);
+    RegCmds();
     char filename[PIM_PATH] = "data/";
     guid_tofile(ARGS(filename), name, ".lmpack");
 
@@ -1612,6 +2222,7 @@ bool lmpack_load(lmpack_t* pack, guid_t name)
                 pack->lightmaps[i] = lm;
             }
 
+            CompactTexels(pack);
             loaded = true;
         }
     }
@@ -1625,6 +2236,223 @@ cleanup:
     return loaded;
 }
 
+// ----------------------------------------------------------------------------
+// lm_pack_check: packs the loaded drawables with atlases_create and with a
+// plain serial first fit over byte grids, then checks that the packer's
+// layout has no overlap and needs no more atlases than the reference.
+
+pim_inline mask_t VEC_CALL mask_clone(mask_t src)
+{
+    mask_t dst = src;
+    const i32 wordCount = src.stride * src.size.y;
+    dst.bits = perm_malloc(sizeof(dst.bits[0]) * wordCount);
+    memcpy(dst.bits, src.bits, sizeof(dst.bits[0]) * wordCount);
+    dst.rowCounts = perm_malloc(sizeof(dst.rowCounts[0]) * src.size.y);
+    memcpy(dst.rowCounts, src.rowCounts, sizeof(dst.rowCounts[0]) * src.size.y);
+    return dst;
+}
+
+// coordinates of the set texels, temp allocated
+static int2* mask_texels(mask_t mask)
+{
+    int2* pim_noalias texels = tmp_malloc(sizeof(texels[0]) * i1_max(1, mask.count));
+    i32 count = 0;
+    for (i32 y = mask.lo.y; y <= mask.hi.y; ++y)
+    {
+        const u64* pim_noalias row = mask.bits + y * mask.stride;
+        for (i32 x = mask.lo.x; x <= mask.hi.x; ++x)
+        {
+            if ((row[x >> 6] >> (x & 63)) & 1)
+            {
+                texels[count++] = i2_v(x, y);
+            }
+        }
+    }
+    ASSERT(count == mask.count);
+    return texels;
+}
+
+// the original packer: every translation in row major order, one chart at
+// a time. charts larger than an atlas are rejected with atlasIndex -1.
+static i32 atlases_create_ref(i32 atlasSize, chart_t* charts, i32 chartCount)
+{
+    const i32 atlasLen = atlasSize * atlasSize;
+    u8** grids = NULL;
+    i32 gridCount = 0;
+    for (i32 iChart = 0; iChart < chartCount; ++iChart)
+    {
+        chart_t* chart = charts + iChart;
+        const mask_t mask = chart->mask;
+        chart->atlasIndex = -1;
+        chart->translation = i2_0;
+        const int2 lo = i2_neg(mask.lo);
+        const int2 hi = i2_sub(i2_subvs(i2_s(atlasSize), 1), mask.hi);
+        if ((mask.count > 0) && ((hi.x < lo.x) || (hi.y < lo.y)))
+        {
+            continue;
+        }
+        const int2* pim_noalias texels = mask_texels(mask);
+        for (i32 i = 0; chart->atlasIndex < 0; ++i)
+        {
+            if (i == gridCount)
+            {
+                ++gridCount;
+                PermGrow(grids, gridCount);
+                grids[i] = perm_calloc(sizeof(grids[i][0]) * atlasLen);
+            }
+            if (mask.count == 0)
+            {
+                chart->atlasIndex = i;
+                break;
+            }
+            u8* pim_noalias grid = grids[i];
+            for (i32 y = lo.y; (y <= hi.y) && (chart->atlasIndex < 0); ++y)
+            {
+                for (i32 x = lo.x; x <= hi.x; ++x)
+                {
+                    bool fits = true;
+                    for (i32 j = 0; fits && (j < mask.count); ++j)
+                    {
+                        fits = !grid[(texels[j].x + x) + (texels[j].y + y) * atlasSize];
+                    }
+                    if (fits)
+                    {
+                        for (i32 j = 0; j < mask.count; ++j)
+                        {
+                            grid[(texels[j].x + x) + (texels[j].y + y) * atlasSize] = 1;
+                        }
+                        chart->atlasIndex = i;
+                        chart->translation = i2_v(x, y);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    for (i32 i = 0; i < gridCount; ++i)
+    {
+        pim_free(grids[i]);
+    }
+    pim_free(grids);
+    return gridCount;
+}
+
+// texels placed outside of their atlas or on top of another chart
+static i32 atlases_overlaps(
+    i32 atlasSize,
+    i32 atlasCount,
+    const chart_t* charts,
+    const mask_t* masks,
+    i32 chartCount)
+{
+    const i32 atlasLen = atlasSize * atlasSize;
+    u8* pim_noalias grid = perm_calloc(sizeof(grid[0]) * atlasLen * i1_max(1, atlasCount));
+    i32 overlaps = 0;
+    for (i32 iChart = 0; iChart < chartCount; ++iChart)
+    {
+        const chart_t chart = charts[iChart];
+        if (chart.atlasIndex < 0)
+        {
+            continue;
+        }
+        if (chart.atlasIndex >= atlasCount)
+        {
+            overlaps += masks[iChart].count;
+            continue;
+        }
+        const int2* pim_noalias texels = mask_texels(masks[iChart]);
+        u8* pim_noalias atlas = grid + chart.atlasIndex * atlasLen;
+        for (i32 j = 0; j < masks[iChart].count; ++j)
+        {
+            const int2 c = i2_add(texels[j], chart.translation);
+            if ((c.x < 0) || (c.y < 0) || (c.x >= atlasSize) || (c.y >= atlasSize))
+            {
+                ++overlaps;
+                continue;
+            }
+            u8* pim_noalias texel = atlas + c.x + c.y * atlasSize;
+            overlaps += *texel;
+            *texel = 1;
+        }
+    }
+    pim_free(grid);
+    return overlaps;
+}
+
+pim_inline i32 charts_rejected(const chart_t* charts, i32 chartCount)
+{
+    i32 rejected = 0;
+    for (i32 i = 0; i < chartCount; ++i)
+    {
+        rejected += charts[i].atlasIndex < 0;
+    }
+    return rejected;
+}
+
+static cmdstat_t CmdPackCheck(i32 argc, const char** argv)
+{
+    const lmpack_t* pack = lmpack_get();
+    float texelsPerUnit = pack->texelsPerMeter;
+    i32 atlasSize = (pack->lmSize > 0) ? pack->lmSize : 1024;
+    if (argc > 1)
+    {
+        texelsPerUnit = (float)atof(argv[1]);
+    }
+    if (argc > 2)
+    {
+        atlasSize = atoi(argv[2]);
+    }
+    if ((texelsPerUnit <= 0.0f) || (atlasSize <= 0))
+    {
+        con_logf(LogSev_Error, "lm", "usage: lm_pack_check [texels per meter] [atlas size]; defaults to the loaded pack's.");
+        return cmdstat_err;
+    }
+
+    i32 nodeCount = 0;
+    chartnode_t* nodes = chartnodes_create(texelsPerUnit, &nodeCount);
+    i32 chartCount = 0;
+    chart_t* charts = chart_group(nodes, nodeCount, &chartCount, 0.1f, 15.0f, atlasSize / 3.0f);
+    chart_sort(charts, chartCount);
+
+    // atlases_create frees the masks, keep copies for both packers
+    chart_t* refCharts = perm_malloc(sizeof(refCharts[0]) * i1_max(1, chartCount));
+    mask_t* masks = perm_malloc(sizeof(masks[0]) * i1_max(1, chartCount));
+    for (i32 i = 0; i < chartCount; ++i)
+    {
+        refCharts[i] = charts[i];
+        refCharts[i].mask = mask_clone(charts[i].mask);
+        masks[i] = mask_clone(charts[i].mask);
+    }
+
+    const i32 refCount = atlases_create_ref(atlasSize, refCharts, chartCount);
+    const i32 atlasCount = atlases_create(atlasSize, charts, chartCount);
+    const i32 overlaps = atlases_overlaps(atlasSize, atlasCount, charts, masks, chartCount);
+    const i32 refRejected = charts_rejected(refCharts, chartCount);
+    const i32 rejected = charts_rejected(charts, chartCount);
+
+    con_logf(LogSev_Info, "lm", "lm_pack_check: %d charts; reference %d atlases, %d rejected; packer %d atlases, %d rejected, %d overlapping texels",
+        chartCount, refCount, refRejected, atlasCount, rejected, overlaps);
+    const bool passed = (overlaps == 0) && (atlasCount <= refCount) && (rejected == refRejected);
+
+    for (i32 i = 0; i < chartCount; ++i)
+    {
+        mask_del(&refCharts[i].mask);
+        mask_del(masks + i);
+        chart_del(charts + i);
+    }
+    pim_free(refCharts);
+    pim_free(masks);
+    pim_free(charts);
+    pim_free(nodes);
+
+    if (!passed)
+    {
+        con_logf(LogSev_Error, "lm", "lm_pack_check failed, the packer overlaps charts or needs more atlases than the reference");
+        return cmdstat_err;
+    }
+    return cmdstat_ok;
+}
+
 static cmdstat_t CmdPrintLm(i32 argc, const char** argv)
 {
     char filename[PIM_PATH] = { 0 };
@@ -1658,8 +2486,14 @@ static cmdstat_t CmdPrintLm(i32 argc, const char** argv)
         }
     }
 
-    u32* buffer = NULL;
     const lmpack_t* pack = lmpack_get();
+    if (fmap_isopen(pack->map))
+    {
+        con_logf(LogSev_Error, "lm", "runtime lightmap packs have no position or normal data");
+        return cmdstat_err;
+    }
+
+    u32* buffer = NULL;
     for (i32 i = 0; i < pack->lmCount; ++i)
     {
         const lightmap_t lm = pack->lightmaps[i];
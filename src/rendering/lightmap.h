@@ -4,22 +4,27 @@
 #include "common/dbytes.h"
 #include "math/types.h"
 #include "common/guid.h"
+#include "io/fmap.h"
 
 PIM_C_BEGIN
 
 #define kLightmapVersion    1
 #define kLmPackVersion      1
+#define kLmRuntimeVersion   1
 #define kGiDirections       5
 
 typedef struct task_s task_t;
 typedef struct pt_scene_s pt_scene_t;
 
+// editing lightmaps own the float arrays.
+// runtime lightmaps only have rgb9e5 probes, pointing into the mapped file.
 typedef struct lightmap_s
 {
     float4* pim_noalias probes[kGiDirections];
     float3* pim_noalias position;
     float3* pim_noalias normal;
     float* pim_noalias sampleCounts;
+    const u32* pim_noalias packed[kGiDirections];
     i32 size;
 } lightmap_t;
 
@@ -38,9 +43,16 @@ typedef struct lmpack_s
 {
     float4 axii[kGiDirections];
     lightmap_t* pim_noalias lightmaps;
+    // occupied texels in morton order, as iLightmap * lmSize^2 + iTexel.
+    // rebuilt on pack and load, not serialized.
+    i32* pim_noalias texels;
+    float3* pim_noalias lumMoments;     // luminance mean, mean square and sample count per entry of texels
+    float* pim_noalias priorities;      // refinement priority per entry of texels
+    i32 texelCount;
     i32 lmCount;
     i32 lmSize;
     float texelsPerMeter;
+    fmap_t map;         // open for runtime packs, which are read only
 } lmpack_t;
 
 typedef struct dlmpack_s
@@ -53,6 +65,20 @@ typedef struct dlmpack_s
     float texelsPerMeter;
 } dlmpack_t;
 
+// runtime format: header, then kGiDirections rgb9e5 probe planes per
+// lightmap, each lmSize^2 texels. drawn straight from the mapped file.
+typedef struct dlmruntime_s
+{
+    i32 version;
+    i32 directions;
+    i32 lmCount;
+    i32 lmSize;
+    float4 axii[kGiDirections];
+    float texelsPerMeter;
+    i32 probesOffset;   // 16 byte aligned
+    i32 pad[2];
+} dlmruntime_t;
+
 typedef struct lm_uvs_s
 {
     i32 length;
@@ -81,8 +107,29 @@ void lmpack_del(lmpack_t* pack);
 
 void lmpack_bake(pt_scene_t* scene, float timeSlice);
 
+typedef struct lmprogress_s
+{
+    i32 texelCount;
+    float minSamples;       // fewest samples taken by any texel
+    float meanSamples;
+    float maxError;         // largest relative standard error, huge until every texel has 2 samples since pack or load
+} lmprogress_t;
+
+lmprogress_t lmpack_progress(const lmpack_t* pack);
+
+// after drawables move, recomputes texel positions and normals in place.
+// the atlas layout and baked samples are kept.
+void lmpack_embed(lmpack_t* pack);
+// restarts baking of texels positioned within bounds, at top priority.
+// returns the number of texels restarted.
+i32 lmpack_invalidate(lmpack_t* pack, box_t bounds);
+
+// false for mapped runtime packs, which have no editing data to save
 bool lmpack_save(const lmpack_t* src, guid_t name);
 bool lmpack_load(lmpack_t* dst, guid_t name);
+// runtime format, about 5x smaller than the editing format and not bakeable
+bool lmpack_save_runtime(const lmpack_t* src, guid_t name);
+bool lmpack_load_runtime(lmpack_t* dst, guid_t name);
 
 void lm_uvs_new(lm_uvs_t* uvs, i32 length);
 void lm_uvs_del(lm_uvs_t* uvs);
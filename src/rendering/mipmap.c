@@ -152,6 +152,66 @@ void mipmap_c32(u32* mipChain, int2 size)
     ProfileEnd(pm_mipmap_c32);
 }
 
+typedef struct task_mipdir8_s
+{
+    task_t task;
+    const u32* srcMip;
+    u32* dstMip;
+    int2 srcSize;
+    int2 dstSize;
+} task_mipdir8_t;
+
+static void mipmap_dir8fn(task_t* pbase, i32 begin, i32 end)
+{
+    task_mipdir8_t* task = (task_mipdir8_t*)pbase;
+    const u32* pim_noalias srcMip = task->srcMip;
+    u32* pim_noalias dstMip = task->dstMip;
+    const int2 srcSize = task->srcSize;
+    const int2 dstSize = task->dstSize;
+
+    for (i32 i = begin; i < end; ++i)
+    {
+        int2 coord = IndexToCoord(dstSize, i);
+        int2 ca = { coord.x * 2 + 0, coord.y * 2 + 0 };
+        int2 cb = { coord.x * 2 + 1, coord.y * 2 + 0 };
+        int2 cc = { coord.x * 2 + 0, coord.y * 2 + 1 };
+        int2 cd = { coord.x * 2 + 1, coord.y * 2 + 1 };
+
+        i32 ia = Clamp(srcSize, ca);
+        i32 ib = Clamp(srcSize, cb);
+        i32 ic = Clamp(srcSize, cc);
+        i32 id = Clamp(srcSize, cd);
+
+        float4 va = ColorToDirection(srcMip[ia]);
+        float4 vb = ColorToDirection(srcMip[ib]);
+        float4 vc = ColorToDirection(srcMip[ic]);
+        float4 vd = ColorToDirection(srcMip[id]);
+
+        // DirectionToColor renormalizes
+        float4 v = f4_add(f4_add(f4_add(va, vb), vc), vd);
+
+        dstMip[i] = DirectionToColor(v);
+    }
+}
+
+ProfileMark(pm_mipmap_dir8, mipmap_dir8)
+void mipmap_dir8(u32* mipChain, int2 size)
+{
+    ProfileBegin(pm_mipmap_dir8);
+    i32 mipCount = CalcMipCount(size);
+    for (i32 dstMip = 1; dstMip < mipCount; ++dstMip)
+    {
+        i32 srcMip = dstMip - 1;
+        task_mipdir8_t* task = tmp_calloc(sizeof(*task));
+        task->srcMip = mipChain + CalcMipOffset(size, srcMip);
+        task->dstMip = mipChain + CalcMipOffset(size, dstMip);
+        task->srcSize = CalcMipSize(size, srcMip);
+        task->dstSize = CalcMipSize(size, dstMip);
+        task_run(&task->task, mipmap_dir8fn, CalcMipLen(size, dstMip));
+    }
+    ProfileEnd(pm_mipmap_dir8);
+}
+
 typedef struct task_mipf32_s
 {
     task_t task;
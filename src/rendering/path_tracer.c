@@ -6,7 +6,9 @@
 #include "rendering/lights.h"
 #include "rendering/drawable.h"
 #include "rendering/librtc.h"
+#include "rendering/blas.h"
 #include "rendering/cubemap.h"
+#include "rendering/screentile.h"
 
 #include "math/float2_funcs.h"
 #include "math/float4_funcs.h"
@@ -28,6 +30,7 @@
 #include "threading/task.h"
 #include "common/random.h"
 #include "common/profiler.h"
+#include "common/profcounter.h"
 #include "common/console.h"
 #include "common/cvar.h"
 #include "common/stringutil.h"
@@ -38,6 +41,8 @@
 #include <string.h>
 
 #define kPixelRadius    2.0f
+#define kStreamSize     128
+#define kMaxBounces     666
 
 // ----------------------------------------------------------------------------
 
@@ -64,6 +69,19 @@ typedef struct scatter_s
     float pdf;
 } scatter_t;
 
+// state of one path between bounces
+typedef struct path_s
+{
+    ray_t ray;
+    float4 light;
+    float4 attenuation;
+    float4 albedo;
+    float4 normal;
+    float coneWidth;    // ray cone footprint at ray.ro
+    float coneSpread;   // ray cone spread angle, in radians
+    bool useNEE;
+} path_t;
+
 typedef struct lightsample_s
 {
     float4 direction;
@@ -118,6 +136,13 @@ typedef struct pt_scene_s
     // [vertCount]
     i32* pim_noalias matIds;
 
+    // first vertex of each mesh instance in the tlas
+    // [matCount]
+    i32* pim_noalias instOffsets;
+    // object to world normal matrix of each instance
+    // [matCount]
+    float3x3* pim_noalias instNormals;
+
     // emissive triangle indices
     // [emissiveCount]
     i32* pim_noalias emissives;
@@ -148,11 +173,33 @@ typedef struct pt_scene_s
 // ----------------------------------------------------------------------------
 
 static cvar_t cv_pt_nee = { cvart_float, 0, "pt_nee", "1", "ratio of next event estimation to unidirectional tracing" };
+static cvar_t cv_pt_stream = { cvart_bool, 0, "pt_stream", "1", "trace batches of paths one bounce at a time through the embree stream api" };
+static cvar_t cv_pt_target_error = { cvart_float, 0, "pt_target_error", "0", "relative standard error at which a screen tile stops tracing, 0 traces every tile" };
+static cvar_t cv_pt_min_samples = { cvart_int, 0, "pt_min_samples", "16", "samples per pixel before a tile may be considered converged" };
+static cvar_t cv_pt_max_tile_spp = { cvart_int, 0, "pt_max_tile_spp", "8", "most samples per pixel a noisy tile may take in one pass" };
+static cvar_t cv_pt_sobol = { cvart_bool, 0, "pt_sobol", "1", "sample pixels with owen scrambled sobol sequences instead of random streams" };
+
+// ----------------------------------------------------------------------------
+
+ProfileCounter(pc_trace_ray, pt_trace_ray)
+ProfileCounter(pc_trace_rays, pt_trace_rays)
+ProfileCounter(pc_scatter_ray, pt_ScatterRay)
+ProfileCounter(pc_get_surface, pt_GetSurface)
+ProfileCounter(pc_sample_lights, pt_SampleLights)
+ProfileCounter(pc_brdf_scatter, pt_BrdfScatter)
+ProfileCounter(pc_occluded, pt_occluded)
+
+// intersection cost per bounce, the last slot collects all deeper bounces
+static profctr_t pc_intersect[] =
+{
+    { "pt_intersect_b0" },
+    { "pt_intersect_b1" },
+    { "pt_intersect_b2" },
+    { "pt_intersect_b3+" },
+};
 
 // ----------------------------------------------------------------------------
 
-static void OnRtcError(void* user, RTCError error, const char* msg);
-static bool InitRTC(void);
 static void InitSamplers(void);
 static void InitPixelDist(void);
 static void ShutdownPixelDist(void);
@@ -162,6 +209,17 @@ pim_inline RTCRayHit VEC_CALL RtcIntersect(
     ray_t ray,
     float tNear,
     float tFar);
+static void RtcIntersectStream(
+    RTCScene scene,
+    const path_t* paths,
+    RTCRayHit* rayHits,
+    i32 count,
+    bool coherent);
+pim_inline bool VEC_CALL RtcOccluded(
+    RTCScene scene,
+    ray_t ray,
+    float tNear,
+    float tFar);
 static RTCScene RtcNewScene(const pt_scene_t* scene);
 static void FlattenDrawables(pt_scene_t* scene);
 static float EmissionPdf(
@@ -194,12 +252,23 @@ pim_inline surfhit_t VEC_CALL GetSurface(
     const pt_scene_t* scene,
     ray_t rin,
     rayhit_t hit,
-    i32 bounce);
+    i32 bounce,
+    float coneWidth);
+pim_inline float VEC_CALL ConeUvLod(
+    const pt_scene_t* scene,
+    rayhit_t hit,
+    float4 rd,
+    float4 M,
+    float coneWidth);
 pim_inline rayhit_t VEC_CALL pt_intersect_local(
     const pt_scene_t* scene,
     ray_t ray,
     float tNear,
     float tFar);
+pim_inline rayhit_t VEC_CALL RtcToHit(
+    const pt_scene_t* scene,
+    ray_t ray,
+    const RTCRayHit* rtcHit);
 pim_inline float4 VEC_CALL SampleSpecular(
     pt_sampler_t* sampler,
     float4 I,
@@ -286,6 +355,19 @@ pim_inline scatter_t VEC_CALL ScatterRay(
     float4 ro,
     float4 rd,
     float rayLen);
+pim_inline path_t VEC_CALL PathNew(pt_sampler_t* sampler, ray_t ray, float spread);
+pim_inline bool VEC_CALL PathBounce(
+    pt_sampler_t* sampler,
+    const pt_scene_t* scene,
+    path_t* path,
+    rayhit_t hit,
+    i32 bounce);
+static pt_result_t VEC_CALL TracePath(
+    pt_sampler_t* sampler,
+    const pt_scene_t* scene,
+    ray_t ray,
+    float spread);
+pim_inline pt_result_t VEC_CALL PathResult(const path_t* path);
 static void TraceFn(task_t* pbase, i32 begin, i32 end);
 static void RayGenFn(task_t* pBase, i32 begin, i32 end);
 pim_inline float VEC_CALL Sample1D(pt_sampler_t* sampler);
@@ -300,37 +382,13 @@ static cvar_t* cv_r_sun_az;
 static cvar_t* cv_r_sun_ze;
 static cvar_t* cv_r_sun_rad;
 
-static RTCDevice ms_device;
 static dist1d_t ms_pixeldist;
 static pt_sampler_t ms_samplers[256];
+static u32 ms_pixelSeed;
+static u32 ms_raygenIndex;
 
 // ----------------------------------------------------------------------------
 
-static void OnRtcError(void* user, RTCError error, const char* msg)
-{
-    if (error != RTC_ERROR_NONE)
-    {
-        con_logf(LogSev_Error, "rtc", "%s", msg);
-        ASSERT(false);
-    }
-}
-
-static bool InitRTC(void)
-{
-    if (!rtc_init())
-    {
-        return false;
-    }
-    ms_device = rtc.NewDevice(NULL);
-    if (!ms_device)
-    {
-        OnRtcError(NULL, rtc.GetDeviceError(NULL), "Failed to create device");
-        return false;
-    }
-    rtc.SetDeviceErrorFunction(ms_device, OnRtcError, NULL);
-    return true;
-}
-
 static void InitPixelDist(void)
 {
     const i32 kSamples = 16;
@@ -351,27 +409,36 @@ static void ShutdownPixelDist(void)
     dist1d_del(&ms_pixeldist);
 }
 
-static void InitSamplers(void)
+static void SeedSamplers(prng_t* rng)
 {
     const i32 numthreads = task_thread_ct();
-
-    prng_t rng = prng_get();
     for (i32 i = 0; i < numthreads; ++i)
     {
-        ms_samplers[i].rng.state = prng_u64(&rng);
+        ms_samplers[i].rng.state = prng_u64(rng);
     }
+}
+
+static void InitSamplers(void)
+{
+    prng_t rng = prng_get();
+    SeedSamplers(&rng);
+    ms_pixelSeed = prng_u32(&rng);
     prng_set(rng);
 }
 
 void pt_sys_init(void)
 {
     cvar_reg(&cv_pt_nee);
+    cvar_reg(&cv_pt_stream);
+    cvar_reg(&cv_pt_target_error);
+    cvar_reg(&cv_pt_min_samples);
+    cvar_reg(&cv_pt_max_tile_spp);
+    cvar_reg(&cv_pt_sobol);
     cv_pt_lgrid_mpc = cvar_find("pt_lgrid_mpc");
     cv_r_sun_az = cvar_find("r_sun_az");
     cv_r_sun_ze = cvar_find("r_sun_ze");
     cv_r_sun_rad = cvar_find("r_sun_rad");
 
-    InitRTC();
     InitSamplers();
     InitPixelDist();
 }
@@ -383,11 +450,33 @@ void pt_sys_update(void)
 
 void pt_sys_shutdown(void)
 {
-    rtc.ReleaseDevice(ms_device);
-    ms_device = NULL;
     ShutdownPixelDist();
 }
 
+void pt_sampler_seed(u64 seed)
+{
+    prng_t rng = { seed };
+    SeedSamplers(&rng);
+    ms_pixelSeed = prng_u32(&rng);
+    ms_raygenIndex = 0;
+}
+
+pt_sampler_t VEC_CALL pt_sampler_pixel(u32 pixel, u32 index)
+{
+    pt_sampler_t sampler = { 0 };
+    const u32 seed = HashCombine32(ms_pixelSeed, pixel);
+    if (cvar_get_bool(&cv_pt_sobol))
+    {
+        sampler.seed = seed | 1u;
+        sampler.index = index;
+    }
+    else
+    {
+        sampler.rng.state = ((u64)HashCombine32(seed, index) << 32) | seed;
+    }
+    return sampler;
+}
+
 pt_sampler_t VEC_CALL pt_sampler_get(void) { return GetSampler(); }
 void VEC_CALL pt_sampler_set(pt_sampler_t sampler) { SetSampler(sampler); }
 float2 VEC_CALL pt_sample_2d(pt_sampler_t* sampler) { return Sample2D(sampler); }
@@ -428,71 +517,69 @@ pim_inline RTCRayHit VEC_CALL RtcIntersect(
     return rayHit;
 }
 
+// any hit within [tNear, tFar] ends traversal
+pim_inline bool VEC_CALL RtcOccluded(
+    RTCScene scene,
+    ray_t ray,
+    float tNear,
+    float tFar)
+{
+    RTCIntersectContext ctx;
+    rtcInitIntersectContext(&ctx);
+    RTCRay rtcRay = RtcNewRay(ray, tNear, tFar);
+    rtc.Occluded1(scene, &ctx, &rtcRay);
+    // tfar is set to -inf on a hit
+    return rtcRay.tfar < 0.0f;
+}
+
+// embree repacks the stream into simd packets of its native width
+static void RtcIntersectStream(
+    RTCScene scene,
+    const path_t* paths,
+    RTCRayHit* rayHits,
+    i32 count,
+    bool coherent)
+{
+    RTCIntersectContext ctx;
+    rtcInitIntersectContext(&ctx);
+    ctx.flags = coherent ?
+        RTC_INTERSECT_CONTEXT_FLAG_COHERENT :
+        RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT;
+    for (i32 i = 0; i < count; ++i)
+    {
+        rayHits[i].ray = RtcNewRay(paths[i].ray, 0.0f, 1 << 20);
+        rayHits[i].hit.primID = RTC_INVALID_GEOMETRY_ID;
+        rayHits[i].hit.geomID = RTC_INVALID_GEOMETRY_ID;
+        rayHits[i].hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+    }
+    rtc.Intersect1M(scene, &ctx, rayHits, count, sizeof(rayHits[0]));
+}
+
+// instances the shared mesh blas, in the same order FlattenDrawables used
 static RTCScene RtcNewScene(const pt_scene_t* scene)
 {
-    RTCScene rtcScene = rtc.NewScene(ms_device);
+    RTCScene rtcScene = rtc.NewScene(blas_device());
     ASSERT(rtcScene);
     if (!rtcScene)
     {
         return NULL;
     }
 
-    RTCGeometry geom = rtc.NewGeometry(ms_device, RTC_GEOMETRY_TYPE_TRIANGLE);
-    ASSERT(geom);
-
-    const i32 vertCount = scene->vertCount;
-    const i32 triCount = vertCount / 3;
-
-    if (vertCount > 0)
-    {
-        float3* pim_noalias dstPositions = rtc.SetNewGeometryBuffer(
-            geom,
-            RTC_BUFFER_TYPE_VERTEX,
-            0,
-            RTC_FORMAT_FLOAT3,
-            sizeof(float3),
-            vertCount);
-        if (!dstPositions)
-        {
-            ASSERT(false);
-            rtc.ReleaseGeometry(geom);
-            rtc.ReleaseScene(rtcScene);
-            return NULL;
-        }
-        const float4* pim_noalias srcPositions = scene->positions;
-        for (i32 i = 0; i < vertCount; ++i)
-        {
-            dstPositions[i] = f4_f3(srcPositions[i]);
-        }
-    }
+    const drawables_t* drawTable = drawables_get();
+    const i32 drawCount = drawTable->count;
+    const meshid_t* meshes = drawTable->meshes;
+    const float4x4* matrices = drawTable->matrices;
 
-    if (triCount > 0)
+    i32 instCount = 0;
+    for (i32 i = 0; i < drawCount; ++i)
     {
-        // kind of wasteful
-        i32* pim_noalias dstIndices = rtc.SetNewGeometryBuffer(
-            geom,
-            RTC_BUFFER_TYPE_INDEX,
-            0,
-            RTC_FORMAT_UINT3,
-            sizeof(int3),
-            triCount);
-        if (!dstIndices)
+        if (mesh_exists(meshes[i]))
         {
-            ASSERT(false);
-            rtc.ReleaseGeometry(geom);
-            rtc.ReleaseScene(rtcScene);
-            return NULL;
-        }
-        for (i32 i = 0; i < vertCount; ++i)
-        {
-            dstIndices[i] = i;
+            blas_instance(rtcScene, instCount, meshes[i], matrices + i);
+            ++instCount;
         }
     }
-
-    rtc.CommitGeometry(geom);
-    rtc.AttachGeometry(rtcScene, geom);
-    rtc.ReleaseGeometry(geom);
-    geom = NULL;
+    ASSERT(instCount == scene->matCount);
 
     rtc.CommitScene(rtcScene);
 
@@ -515,6 +602,8 @@ static void FlattenDrawables(pt_scene_t* scene)
 
     i32 matCount = 0;
     material_t* sceneMats = NULL;
+    i32* instOffsets = NULL;
+    float3x3* instNormals = NULL;
 
     for (i32 i = 0; i < drawCount; ++i)
     {
@@ -535,8 +624,12 @@ static void FlattenDrawables(pt_scene_t* scene)
             PermReserve(uvs, vertCount);
             PermReserve(matIds, vertCount);
             PermReserve(sceneMats, matCount);
+            PermReserve(instOffsets, matCount);
+            PermReserve(instNormals, matCount);
 
             sceneMats[matBack] = material;
+            instOffsets[matBack] = vertBack;
+            instNormals[matBack] = IM;
 
             for (i32 j = 0; j < mesh.length; ++j)
             {
@@ -573,6 +666,8 @@ static void FlattenDrawables(pt_scene_t* scene)
 
     scene->matCount = matCount;
     scene->materials = sceneMats;
+    scene->instOffsets = instOffsets;
+    scene->instNormals = instNormals;
 }
 
 static float EmissionPdf(
@@ -606,7 +701,7 @@ static float EmissionPdf(
             {
                 float4 wuv = SampleBaryCoord(Sample2D(sampler));
                 float2 uv = f2_blend(UA, UB, UC, wuv);
-                float sample = UvWrap_c32(romeMap.texels, romeMap.size, uv).w;
+                float sample = TexUvWrap_c32(&romeMap, uv).w;
                 float em = sample * rome.w;
                 if (em > kThreshold)
                 {
@@ -795,8 +890,8 @@ static void UpdateScene(pt_scene_t* scene)
 
 pt_scene_t* pt_scene_new(void)
 {
-    ASSERT(ms_device);
-    if (!ms_device)
+    ASSERT(blas_device());
+    if (!blas_device())
     {
         return NULL;
     }
@@ -830,6 +925,8 @@ void pt_scene_del(pt_scene_t* scene)
         pim_free(scene->matIds);
 
         pim_free(scene->materials);
+        pim_free(scene->instOffsets);
+        pim_free(scene->instNormals);
 
         pim_free(scene->emissives);
         pim_free(scene->emPdfs);
@@ -885,6 +982,13 @@ void pt_trace_new(
         trace->color = perm_calloc(sizeof(trace->color[0]) * texelCount);
         trace->albedo = perm_calloc(sizeof(trace->albedo[0]) * texelCount);
         trace->normal = perm_calloc(sizeof(trace->normal[0]) * texelCount);
+        trace->lumMoment = perm_calloc(sizeof(trace->lumMoment[0]) * texelCount);
+        trace->sampleCounts = perm_calloc(sizeof(trace->sampleCounts[0]) * texelCount);
+        trace->tileCount = screentiles_tilecount(imageSize);
+        trace->tileSpp = perm_malloc(sizeof(trace->tileSpp[0]) * trace->tileCount);
+        memset(trace->tileSpp, 1, sizeof(trace->tileSpp[0]) * trace->tileCount);
+        trace->tileError = perm_calloc(sizeof(trace->tileError[0]) * trace->tileCount);
+        trace->tilesDone = 0;
         dofinfo_new(&trace->dofinfo);
     }
 }
@@ -896,6 +1000,10 @@ void pt_trace_del(pt_trace_t* trace)
         pim_free(trace->color);
         pim_free(trace->albedo);
         pim_free(trace->normal);
+        pim_free(trace->lumMoment);
+        pim_free(trace->sampleCounts);
+        pim_free(trace->tileSpp);
+        pim_free(trace->tileError);
         memset(trace, 0, sizeof(*trace));
     }
 }
@@ -905,6 +1013,7 @@ void pt_trace_gui(pt_trace_t* trace)
     if (trace && igCollapsingHeader1("pt trace"))
     {
         igIndent(0.0f);
+        igText("Converged Tiles: %d / %d", trace->tilesDone, trace->tileCount);
         dofinfo_gui(&trace->dofinfo);
         pt_scene_gui(trace->scene);
         igUnindent(0.0f);
@@ -992,11 +1101,45 @@ pim_inline float4 VEC_CALL GetSky(
     return f4_0;
 }
 
+// texture lod of a ray cone of the given width hitting the triangle,
+// in log2 texels of a 1x1 texture; add 0.5 * log2(texel count) per texture.
+// [Akenine-Moller et al. 2019, "Texture Level of Detail Strategies for Real-Time Ray Tracing"]
+pim_inline float VEC_CALL ConeUvLod(
+    const pt_scene_t* scene,
+    rayhit_t hit,
+    float4 rd,
+    float4 M,
+    float coneWidth)
+{
+    const i32 a = hit.index;
+    const float4 A = scene->positions[a + 0];
+    const float4 B = scene->positions[a + 1];
+    const float4 C = scene->positions[a + 2];
+    const float2 UA = scene->uvs[a + 0];
+    const float2 UB = scene->uvs[a + 1];
+    const float2 UC = scene->uvs[a + 2];
+
+    float worldArea = f4_length3(f4_cross3(f4_sub(B, A), f4_sub(C, A)));
+    float2 e1 = f2_sub(UB, UA);
+    float2 e2 = f2_sub(UC, UA);
+    float uvArea = f1_abs(e1.x * e2.y - e1.y * e2.x);
+    float cosTheta = f1_max(f1_abs(f4_dot3(rd, M)), 0.01f);
+    float w = coneWidth / cosTheta;
+    float ratio = uvArea / f1_max(worldArea, kEpsilon);
+    return 0.5f * log2f(f1_max(ratio * w * w, 1e-12f));
+}
+
+pim_inline float VEC_CALL TexLod(int2 size, float lod)
+{
+    return lod + 0.5f * log2f((float)(size.x * size.y));
+}
+
 pim_inline surfhit_t VEC_CALL GetSurface(
     const pt_scene_t* scene,
     ray_t rin,
     rayhit_t hit,
-    i32 bounce)
+    i32 bounce,
+    float coneWidth)
 {
     surfhit_t surf = { 0 };
 
@@ -1009,12 +1152,14 @@ pim_inline surfhit_t VEC_CALL GetSurface(
     surf.P = f4_add(rin.ro, f4_mulvs(rin.rd, hit.wuvt.w));
     surf.P = f4_add(surf.P, f4_mulvs(surf.M, kMilli));
 
+    const float lod = ConeUvLod(scene, hit, rin.rd, surf.M, coneWidth);
+
     texture_t tex;
     if (bounce == 0)
     {
         if (texture_get(mat->normal, &tex))
         {
-            float4 Nts = UvBilinearWrap_dir8(tex.texels, tex.size, uv);
+            float4 Nts = TexTrilinearWrap_dir8(&tex, uv, TexLod(tex.size, lod));
             surf.N = TanToWorld(surf.N, Nts);
         }
     }
@@ -1025,11 +1170,11 @@ pim_inline surfhit_t VEC_CALL GetSurface(
         float4 sample;
         if (bounce == 0)
         {
-            sample = UvBilinearWrap_c32(tex.texels, tex.size, uv);
+            sample = TexTrilinearWrap_c32(&tex, uv, TexLod(tex.size, lod));
         }
         else
         {
-            sample = UvWrap_c32(tex.texels, tex.size, uv);
+            sample = TexUvWrapMip_c32(&tex, uv, TexLod(tex.size, lod));
         }
         surf.albedo = f4_mul(surf.albedo, sample);
     }
@@ -1040,11 +1185,11 @@ pim_inline surfhit_t VEC_CALL GetSurface(
         float4 sample;
         if (bounce == 0)
         {
-            sample = UvBilinearWrap_c32(tex.texels, tex.size, uv);
+            sample = TexTrilinearWrap_c32(&tex, uv, TexLod(tex.size, lod));
         }
         else
         {
-            sample = UvWrap_c32(tex.texels, tex.size, uv);
+            sample = TexUvWrapMip_c32(&tex, uv, TexLod(tex.size, lod));
         }
         rome = f4_mul(rome, sample);
     }
@@ -1066,34 +1211,46 @@ pim_inline rayhit_t VEC_CALL pt_intersect_local(
     ray_t ray,
     float tNear,
     float tFar)
+{
+    RTCRayHit rtcHit = RtcIntersect(scene->rtcScene, ray, tNear, tFar);
+    return RtcToHit(scene, ray, &rtcHit);
+}
+
+pim_inline rayhit_t VEC_CALL RtcToHit(
+    const pt_scene_t* scene,
+    ray_t ray,
+    const RTCRayHit* rtcHit)
 {
     rayhit_t hit = { 0 };
     hit.wuvt.w = -1.0f;
     hit.index = -1;
 
-    RTCRayHit rtcHit = RtcIntersect(scene->rtcScene, ray, tNear, tFar);
-    hit.normal = f4_v(rtcHit.hit.Ng_x, rtcHit.hit.Ng_y, rtcHit.hit.Ng_z, 0.0f);
+    hit.normal = f4_v(rtcHit->hit.Ng_x, rtcHit->hit.Ng_y, rtcHit->hit.Ng_z, 0.0f);
     bool hitNothing =
-        (rtcHit.hit.geomID == RTC_INVALID_GEOMETRY_ID) ||
-        (rtcHit.ray.tfar <= 0.0f);
+        (rtcHit->hit.geomID == RTC_INVALID_GEOMETRY_ID) ||
+        (rtcHit->ray.tfar <= 0.0f);
     if (hitNothing)
     {
         hit.type = hit_nothing;
         return hit;
     }
+    // mesh instance, Ng is in object space
+    const u32 iInst = rtcHit->hit.instID[0];
+    ASSERT(iInst < (u32)scene->matCount);
+    hit.normal = f3x3_mul_col(scene->instNormals[iInst], hit.normal);
     hit.type = hit_triangle;
     if (f4_dot3(hit.normal, ray.rd) > 0.0f)
     {
         hit.type = hit_backface;
     }
-    ASSERT(rtcHit.hit.primID != RTC_INVALID_GEOMETRY_ID);
-    i32 iVert = rtcHit.hit.primID * 3;
+    ASSERT(rtcHit->hit.primID != RTC_INVALID_GEOMETRY_ID);
+    i32 iVert = scene->instOffsets[iInst] + rtcHit->hit.primID * 3;
     ASSERT(iVert >= 0);
     ASSERT(iVert < scene->vertCount);
-    float u = f1_sat(rtcHit.hit.u);
-    float v = f1_sat(rtcHit.hit.v);
+    float u = f1_sat(rtcHit->hit.u);
+    float v = f1_sat(rtcHit->hit.v);
     float w = f1_sat(1.0f - (u + v));
-    float t = rtcHit.ray.tfar;
+    float t = rtcHit->ray.tfar;
 
     hit.index = iVert;
     hit.wuvt = f4_v(w, u, v, t);
@@ -1111,6 +1268,15 @@ rayhit_t VEC_CALL pt_intersect(
     return pt_intersect_local(scene, ray, tNear, tFar);
 }
 
+bool VEC_CALL pt_occluded(
+    const pt_scene_t* scene,
+    ray_t ray,
+    float tNear,
+    float tFar)
+{
+    return RtcOccluded(scene->rtcScene, ray, tNear, tFar);
+}
+
 pim_inline float4 VEC_CALL SampleSpecular(
     pt_sampler_t* sampler,
     float4 I,
@@ -1425,14 +1591,23 @@ pim_inline lightsample_t VEC_CALL LightSample(
     float VoNl = f4_dot3(f4_neg(rd), N);
     if (VoNl > 0.0f)
     {
+        // the light point is known, only visibility is needed.
+        // stop just short of it so the light itself does not occlude.
         ray_t ray = { ro, rd };
-        rayhit_t hit = pt_intersect_local(scene, ray, 0.0f, 1 << 20);
-        if ((hit.type != hit_nothing) && (hit.index == iLight))
+        const float tFar = distance * (1.0f - kMilli);
+        const u64 ctrBegin = CounterBegin(pc_occluded);
+        const bool occluded = RtcOccluded(scene->rtcScene, ray, 0.0f, tFar);
+        CounterEnd(pc_occluded, ctrBegin);
+        if (!occluded)
         {
+            rayhit_t hit = { 0 };
+            hit.type = hit_triangle;
+            hit.index = iLight;
+            hit.wuvt = wuv;
             sample.pdf = LightPdf(area, VoNl, distSq);
-            surfhit_t surf = GetSurface(scene, ray, hit, 1);
+            surfhit_t surf = GetSurface(scene, ray, hit, 1, 0.0f);
             sample.irradiance = surf.emission;
-            float4 Tr = CalcTransmittance(sampler, scene, ro, rd, hit.wuvt.w);
+            float4 Tr = CalcTransmittance(sampler, scene, ro, rd, distance);
             sample.irradiance = f4_mul(sample.irradiance, Tr);
         }
     }
@@ -1509,7 +1684,7 @@ pim_inline float4 VEC_CALL EstimateDirect(
             {
                 float weight = PowerHeuristic(brdfPdf, lightPdf);
                 float4 Tr = CalcTransmittance(sampler, scene, ray.ro, ray.rd, hit.wuvt.w);
-                surfhit_t surf = GetSurface(scene, ray, hit, 1);
+                surfhit_t surf = GetSurface(scene, ray, hit, 1, 0.0f);
                 float4 Li = surf.emission;
                 Li = f4_mulvs(Li, weight);
                 Li = f4_mul(Li, Tr);
@@ -1946,114 +2121,253 @@ pim_inline scatter_t VEC_CALL ScatterRay(
     return result;
 }
 
-pt_result_t VEC_CALL pt_trace_ray(
-    pt_sampler_t* sampler,
-    const pt_scene_t* scene,
-    ray_t ray)
+// spread: angle between neighboring primary rays, 0 for point sampled rays
+pim_inline path_t VEC_CALL PathNew(pt_sampler_t* sampler, ray_t ray, float spread)
 {
-    pt_result_t result = { 0 };
-    float4 light = f4_0;
-    float4 attenuation = f4_1;
+    path_t path = { 0 };
+    path.ray = ray;
+    path.coneWidth = 0.0f;
+    path.coneSpread = spread;
+    path.light = f4_0;
+    path.attenuation = f4_1;
     const float amtNee = f1_sat(cv_pt_nee.asFloat);
-    bool useNEE = Sample1D(sampler) < amtNee;
+    path.useNEE = Sample1D(sampler) < amtNee;
+    return path;
+}
 
-    for (i32 b = 0; b < 666; ++b)
+// shades one bounce of a path at its closest hit.
+// returns false once the path has terminated.
+pim_inline bool VEC_CALL PathBounce(
+    pt_sampler_t* sampler,
+    const pt_scene_t* scene,
+    path_t* path,
+    rayhit_t hit,
+    i32 b)
+{
+    if (hit.type == hit_nothing)
     {
-        rayhit_t hit = pt_intersect_local(scene, ray, 0.0f, 1 << 20);
-        if (hit.type == hit_nothing)
-        {
-            break;
-        }
+        return false;
+    }
 
+    {
+        u64 ctrBegin = CounterBegin(pc_scatter_ray);
+        scatter_t scatter = ScatterRay(sampler, scene, path->ray.ro, path->ray.rd, hit.wuvt.w);
+        CounterEnd(pc_scatter_ray, ctrBegin);
+        path->light = f4_add(path->light, f4_mul(scatter.irradiance, path->attenuation));
+        if (scatter.pdf > 0.0f)
         {
-            scatter_t scatter = ScatterRay(sampler, scene, ray.ro, ray.rd, hit.wuvt.w);
-            light = f4_add(light, f4_mul(scatter.irradiance, attenuation));
-            if (scatter.pdf > 0.0f)
+            if (b == 0)
             {
-                if (b == 0)
-                {
-                    result.albedo = f4_f3(Media_Albedo(&scene->mediaDesc, scatter.pos));
-                }
-                attenuation = f4_mul(attenuation, f4_divvs(scatter.attenuation, scatter.pdf));
-                ray.ro = scatter.pos;
-                ray.rd = scatter.dir;
-                goto roulette;
-            }
-            else
-            {
-                attenuation = f4_mul(attenuation, scatter.attenuation);
+                path->albedo = Media_Albedo(&scene->mediaDesc, scatter.pos);
             }
+            path->attenuation = f4_mul(path->attenuation, f4_divvs(scatter.attenuation, scatter.pdf));
+            path->coneWidth += path->coneSpread * f4_distance3(path->ray.ro, scatter.pos);
+            path->ray.ro = scatter.pos;
+            path->ray.rd = scatter.dir;
+            goto roulette;
         }
-
-        if (hit.flags & matflag_sky)
+        else
         {
-            light = f4_add(light, f4_mul(GetSky(scene, ray.ro, ray.rd), attenuation));
-            break;
+            path->attenuation = f4_mul(path->attenuation, scatter.attenuation);
         }
+    }
+
+    if (hit.flags & matflag_sky)
+    {
+        path->light = f4_add(path->light, f4_mul(GetSky(scene, path->ray.ro, path->ray.rd), path->attenuation));
+        return false;
+    }
 
-        surfhit_t surf = GetSurface(scene, ray, hit, b);
+    {
+        u64 ctrBegin = CounterBegin(pc_get_surface);
+        const float coneWidth = path->coneWidth + path->coneSpread * hit.wuvt.w;
+        surfhit_t surf = GetSurface(scene, path->ray, hit, b, coneWidth);
+        CounterEnd(pc_get_surface, ctrBegin);
         if (b == 0)
         {
-            result.albedo = f4_f3(surf.albedo);
-            result.normal = f4_f3(surf.N);
+            path->albedo = surf.albedo;
+            path->normal = surf.N;
         }
         // next event estimation is a bit wonky with refraction
         if (surf.flags & matflag_refractive)
         {
-            useNEE = false;
+            path->useNEE = false;
         }
 
-        if ((b == 0) || !useNEE)
+        if ((b == 0) || !path->useNEE)
         {
-            light = f4_add(light, f4_mul(surf.emission, attenuation));
+            path->light = f4_add(path->light, f4_mul(surf.emission, path->attenuation));
         }
-        if (useNEE)
+        if (path->useNEE)
         {
-            float4 direct = SampleLights(sampler, scene, &surf, &hit, ray.rd);
-            light = f4_add(light, f4_mul(direct, attenuation));
+            ctrBegin = CounterBegin(pc_sample_lights);
+            float4 direct = SampleLights(sampler, scene, &surf, &hit, path->ray.rd);
+            CounterEnd(pc_sample_lights, ctrBegin);
+            path->light = f4_add(path->light, f4_mul(direct, path->attenuation));
         }
 
-        scatter_t scatter = BrdfScatter(sampler, &surf, ray.rd);
+        ctrBegin = CounterBegin(pc_brdf_scatter);
+        scatter_t scatter = BrdfScatter(sampler, &surf, path->ray.rd);
+        CounterEnd(pc_brdf_scatter, ctrBegin);
         if (scatter.pdf <= 0.0f)
+        {
+            return false;
+        }
+        path->ray.ro = scatter.pos;
+        path->ray.rd = scatter.dir;
+        // rough lobes widen the cone, approximating the brdf's angular spread
+        path->coneWidth = coneWidth;
+        path->coneSpread += surf.roughness * surf.roughness;
+
+        path->attenuation = f4_mul(path->attenuation, f4_divvs(scatter.attenuation, scatter.pdf));
+    }
+
+roulette:
+    {
+        float p = f1_clamp(f4_avglum(path->attenuation), 0.0f, 0.95f);
+        if (Sample1D(sampler) < p)
+        {
+            path->attenuation = f4_divvs(path->attenuation, p);
+            return true;
+        }
+        return false;
+    }
+}
+
+pim_inline pt_result_t VEC_CALL PathResult(const path_t* path)
+{
+    pt_result_t result;
+    result.color = f4_f3(path->light);
+    result.albedo = f4_f3(path->albedo);
+    result.normal = f4_f3(path->normal);
+    return result;
+}
+
+pt_result_t VEC_CALL pt_trace_ray(
+    pt_sampler_t* sampler,
+    const pt_scene_t* scene,
+    ray_t ray)
+{
+    return TracePath(sampler, scene, ray, 0.0f);
+}
+
+static pt_result_t VEC_CALL TracePath(
+    pt_sampler_t* sampler,
+    const pt_scene_t* scene,
+    ray_t ray,
+    float spread)
+{
+    const u64 traceBegin = CounterBegin(pc_trace_ray);
+
+    path_t path = PathNew(sampler, ray, spread);
+    for (i32 b = 0; b < kMaxBounces; ++b)
+    {
+        const i32 iCounter = i1_min(b, NELEM(pc_intersect) - 1);
+        const u64 ctrBegin = CounterBegin(pc_intersect[iCounter]);
+        rayhit_t hit = pt_intersect_local(scene, path.ray, 0.0f, 1 << 20);
+        CounterEnd(pc_intersect[iCounter], ctrBegin);
+        if (!PathBounce(sampler, scene, &path, hit, b))
         {
             break;
         }
-        ray.ro = scatter.pos;
-        ray.rd = scatter.dir;
+    }
+
+    CounterEnd(pc_trace_ray, traceBegin);
+
+    return PathResult(&path);
+}
 
-        attenuation = f4_mul(attenuation, f4_divvs(scatter.attenuation, scatter.pdf));
+// traces a batch of paths a bounce at a time: every live path is intersected
+// in one embree stream call, shaded, and the survivors compacted.
+void pt_trace_rays(
+    pt_sampler_t* samplers,
+    const pt_scene_t* scene,
+    const ray_t* rays,
+    pt_result_t* results,
+    i32 count,
+    bool coherent,
+    float spread)
+{
+    ASSERT(samplers);
+    ASSERT(rays);
+    ASSERT(results);
+    ASSERT(count >= 0);
 
-    roulette:
+    if (!cvar_get_bool(&cv_pt_stream))
+    {
+        for (i32 i = 0; i < count; ++i)
         {
-            float p = f1_clamp(f4_avglum(attenuation), 0.0f, 0.95f);
-            if (Sample1D(sampler) < p)
-            {
-                attenuation = f4_divvs(attenuation, p);
-            }
-            else
+            results[i] = TracePath(samplers + i, scene, rays[i], spread);
+        }
+        return;
+    }
+
+    const u64 traceBegin = CounterBegin(pc_trace_rays);
+
+    path_t paths[kStreamSize];
+    RTCRayHit rayHits[kStreamSize];
+    i32 indices[kStreamSize];
+
+    for (i32 base = 0; base < count; base += kStreamSize)
+    {
+        i32 active = i1_min(kStreamSize, count - base);
+        for (i32 i = 0; i < active; ++i)
+        {
+            paths[i] = PathNew(samplers + base + i, rays[base + i], spread);
+            indices[i] = base + i;
+        }
+
+        for (i32 b = 0; (b < kMaxBounces) && (active > 0); ++b)
+        {
+            const i32 iCounter = i1_min(b, NELEM(pc_intersect) - 1);
+            const u64 ctrBegin = CounterBegin(pc_intersect[iCounter]);
+            RtcIntersectStream(scene->rtcScene, paths, rayHits, active, coherent && (b == 0));
+            CounterEnd(pc_intersect[iCounter], ctrBegin);
+
+            i32 alive = 0;
+            for (i32 i = 0; i < active; ++i)
             {
-                break;
+                rayhit_t hit = RtcToHit(scene, paths[i].ray, rayHits + i);
+                if (PathBounce(samplers + indices[i], scene, paths + i, hit, b))
+                {
+                    paths[alive] = paths[i];
+                    indices[alive] = indices[i];
+                    ++alive;
+                }
+                else
+                {
+                    results[indices[i]] = PathResult(paths + i);
+                }
             }
+            active = alive;
+        }
+
+        for (i32 i = 0; i < active; ++i)
+        {
+            results[indices[i]] = PathResult(paths + i);
         }
     }
 
-    result.color = f4_f3(light);
-    return result;
+    CounterEnd(pc_trace_rays, traceBegin);
 }
 
 pim_inline float2 VEC_CALL SampleUv(
     pt_sampler_t* sampler,
     const dist1d_t* dist)
 {
+    // the low half of each axis picks the sign, then is rescaled to [0, 1)
+    // so the sequence stays stratified, and sobol streams decorrelate per pixel
     float2 Xi = Sample2D(sampler);
-    Xi.x = dist1d_samplec(dist, Xi.x);
-    Xi.y = dist1d_samplec(dist, Xi.y);
-    Xi = f2_mulvs(Xi, kPixelRadius);
     float2 b =
     {
-        prng_bool(&sampler->rng) ? 1.0f : -1.0f,
-        prng_bool(&sampler->rng) ? 1.0f : -1.0f,
+        Xi.x < 0.5f ? 1.0f : -1.0f,
+        Xi.y < 0.5f ? 1.0f : -1.0f,
     };
+    Xi.x = f1_frac(Xi.x * 2.0f);
+    Xi.y = f1_frac(Xi.y * 2.0f);
+    Xi.x = dist1d_samplec(dist, Xi.x);
+    Xi.y = dist1d_samplec(dist, Xi.y);
+    Xi = f2_mulvs(Xi, kPixelRadius);
     Xi = f2_mul(Xi, b);
     return Xi;
 }
@@ -2069,12 +2383,12 @@ pim_inline ray_t VEC_CALL CalculateDof(
     float2 offset;
     if (dof->bladeCount == 666)
     {
-        offset = SamplePentagram(&sampler->rng);
+        offset = SamplePentagram(Sample2D(sampler));
     }
     else
     {
         offset = SampleNGon(
-            &sampler->rng,
+            Sample2D(sampler),
             dof->bladeCount,
             dof->bladeRot);
     }
@@ -2095,6 +2409,7 @@ typedef struct trace_task_s
     task_t task;
     pt_trace_t* trace;
     camera_t camera;
+    screentiles_t tiles;
 } trace_task_t;
 
 static void TraceFn(task_t* pbase, i32 begin, i32 end)
@@ -2103,15 +2418,18 @@ static void TraceFn(task_t* pbase, i32 begin, i32 end)
 
     pt_trace_t* trace = task->trace;
     const camera_t camera = task->camera;
+    const screentiles_t tiles = task->tiles;
 
     const pt_scene_t* scene = trace->scene;
     float3* pim_noalias color = trace->color;
     float3* pim_noalias albedo = trace->albedo;
     float3* pim_noalias normal = trace->normal;
+    float* pim_noalias lumMoment = trace->lumMoment;
+    i32* pim_noalias sampleCounts = trace->sampleCounts;
+    const u8* pim_noalias tileSpp = trace->tileSpp;
 
     const int2 size = trace->imageSize;
     const float2 rcpSize = f2_rcp(i2_f2(size));
-    const float sampleWeight = trace->sampleWeight;
 
     const quat rot = camera.rotation;
     const float4 eye = camera.position;
@@ -2121,26 +2439,214 @@ static void TraceFn(task_t* pbase, i32 begin, i32 end)
     const float2 slope = proj_slope(f1_radians(camera.fovy), (float)size.x / (float)size.y);
     const dofinfo_t dof = trace->dofinfo;
     const dist1d_t dist = ms_pixeldist;
+    // angle subtended by one pixel, seeds the primary ray cones
+    const float spread = 2.0f * slope.y * rcpSize.y;
+
+    i32 texels[kStreamSize];
+    ray_t rays[kStreamSize];
+    pt_result_t results[kStreamSize];
+    pt_sampler_t samplers[kStreamSize];
+
+    // passes of work item i already traced, a noisy texel may span streams
+    i32 pass = 0;
+    for (i32 i = begin; i < end; )
+    {
+        i32 count = 0;
+        // passes of work item i queued in this stream
+        i32 queued = 0;
+        while ((i < end) && (count < kStreamSize))
+        {
+            const i32 iTile = screentiles_tile(i);
+            const i32 spp = tileSpp[iTile];
+            if (spp == 0)
+            {
+                // skip to the next tile
+                i = (iTile + 1) * kScreenTileArea;
+                continue;
+            }
+            const i32 iTexel = screentiles_texel(&tiles, i);
+            if (iTexel < 0)
+            {
+                ++i;
+                continue;
+            }
+            int2 coord = { iTexel % size.x, iTexel / size.x };
+            pt_sampler_t sampler = pt_sampler_pixel(iTexel, sampleCounts[iTexel] + queued);
+            ++queued;
+            if (++pass >= spp)
+            {
+                pass = 0;
+                queued = 0;
+                ++i;
+            }
 
-    pt_sampler_t sampler = GetSampler();
-    for (i32 i = begin; i < end; ++i)
+            // gaussian AA filter
+            float2 uv = { (coord.x + 0.5f), (coord.y + 0.5f) };
+            float2 Xi = SampleUv(&sampler, &dist);
+            uv = f2_snorm(f2_mul(f2_add(uv, Xi), rcpSize));
+
+            ray_t ray = { eye, proj_dir(right, up, fwd, slope, uv) };
+            texels[count] = iTexel;
+            rays[count] = CalculateDof(&sampler, &dof, right, up, fwd, ray);
+            samplers[count] = sampler;
+            ++count;
+        }
+
+        pt_trace_rays(samplers, scene, rays, results, count, true, spread);
+
+        for (i32 j = 0; j < count; ++j)
+        {
+            const i32 t = texels[j];
+            const float sampleWeight = 1.0f / ++sampleCounts[t];
+            const float lum = f4_perlum(f3_f4(results[j].color, 0.0f));
+            color[t] = f3_lerp(color[t], results[j].color, sampleWeight);
+            albedo[t] = f3_lerp(albedo[t], results[j].albedo, sampleWeight);
+            normal[t] = f3_lerp(normal[t], results[j].normal, sampleWeight);
+            lumMoment[t] = f1_lerp(lumMoment[t], lum * lum, sampleWeight);
+        }
+    }
+}
+
+typedef struct converge_task_s
+{
+    task_t task;
+    pt_trace_t* trace;
+    screentiles_t tiles;
+    float targetError;
+    i32 minSamples;
+} converge_task_t;
+
+// measures each live tile's worst standard error of the mean luminance,
+// relative to the target, and marks tiles at or below it converged
+static void ConvergeFn(task_t* pbase, i32 begin, i32 end)
+{
+    converge_task_t* task = (converge_task_t*)pbase;
+    pt_trace_t* trace = task->trace;
+    const screentiles_t tiles = task->tiles;
+    const float targetError = task->targetError;
+    const i32 minSamples = task->minSamples;
+
+    const float3* pim_noalias color = trace->color;
+    const float* pim_noalias lumMoment = trace->lumMoment;
+    const i32* pim_noalias sampleCounts = trace->sampleCounts;
+    u8* pim_noalias tileSpp = trace->tileSpp;
+    float* pim_noalias tileError = trace->tileError;
+
+    for (i32 iTile = begin; iTile < end; ++iTile)
     {
-        int2 coord = { i % size.x, i / size.x };
+        if (tileSpp[iTile] == 0)
+        {
+            continue;
+        }
+        bool sampled = true;
+        float error = 0.0f;
+        for (i32 j = 0; j < kScreenTileArea; ++j)
+        {
+            const i32 t = screentiles_texel(&tiles, iTile * kScreenTileArea + j);
+            if (t < 0)
+            {
+                continue;
+            }
+            const i32 n = sampleCounts[t];
+            if (n < 2)
+            {
+                sampled = false;
+                continue;
+            }
+            sampled &= n >= minSamples;
+            const float mean = f4_perlum(f3_f4(color[t], 0.0f));
+            const float variance = f1_max(0.0f, lumMoment[t] - mean * mean);
+            const float stdError = sqrtf(variance / n);
+            // dark texels are held to an absolute error instead
+            error = f1_max(error, stdError / (targetError * f1_max(mean, 0.01f)));
+        }
+        // too few samples to trust the estimate, keep at least the target's share
+        if (!sampled)
+        {
+            error = f1_max(error, 1.0f);
+        }
+        tileError[iTile] = error;
+        if (sampled && (error <= 1.0f))
+        {
+            tileSpp[iTile] = 0;
+        }
+    }
+}
 
-        // gaussian AA filter
-        float2 uv = { (coord.x + 0.5f), (coord.y + 0.5f) };
-        float2 Xi = SampleUv(&sampler, &dist);
-        uv = f2_snorm(f2_mul(f2_add(uv, Xi), rcpSize));
+// splits one pass worth of samples, a sample per pixel of the image,
+// across the live tiles in proportion to their error
+static void AllocateSamples(pt_trace_t* trace)
+{
+    const i32 tileCount = trace->tileCount;
+    const i32 maxSpp = i1_clamp((i32)cv_pt_max_tile_spp.asFloat, 1, 255);
+    u8* pim_noalias tileSpp = trace->tileSpp;
+    const float* pim_noalias tileError = trace->tileError;
 
-        ray_t ray = { eye, proj_dir(right, up, fwd, slope, uv) };
-        ray = CalculateDof(&sampler, &dof, right, up, fwd, ray);
+    i32 tilesDone = 0;
+    float errorSum = 0.0f;
+    for (i32 i = 0; i < tileCount; ++i)
+    {
+        if (tileSpp[i] == 0)
+        {
+            ++tilesDone;
+        }
+        else
+        {
+            errorSum += tileError[i];
+        }
+    }
+    trace->tilesDone = tilesDone;
+    if (errorSum <= 0.0f)
+    {
+        return;
+    }
 
-        pt_result_t result = pt_trace_ray(&sampler, scene, ray);
-        color[i] = f3_lerp(color[i], result.color, sampleWeight);
-        albedo[i] = f3_lerp(albedo[i], result.albedo, sampleWeight);
-        normal[i] = f3_lerp(normal[i], result.normal, sampleWeight);
+    const float scale = (float)tileCount / errorSum;
+    // carry the rounding error so the allocations sum to the budget
+    float carry = 0.0f;
+    for (i32 i = 0; i < tileCount; ++i)
+    {
+        if (tileSpp[i] != 0)
+        {
+            const float share = tileError[i] * scale + carry;
+            const i32 spp = i1_clamp((i32)share, 1, maxSpp);
+            carry = share - (float)spp;
+            tileSpp[i] = (u8)spp;
+        }
     }
-    SetSampler(sampler);
+}
+
+ProfileMark(pm_converge, Converge)
+static void UpdateConvergence(pt_trace_t* trace, const screentiles_t* tiles)
+{
+    const float targetError = cv_pt_target_error.asFloat;
+    if (targetError <= 0.0f)
+    {
+        memset(trace->tileSpp, 1, sizeof(trace->tileSpp[0]) * trace->tileCount);
+        trace->tilesDone = 0;
+        return;
+    }
+
+    ProfileBegin(pm_converge);
+
+    converge_task_t* task = tmp_calloc(sizeof(*task));
+    task->trace = trace;
+    task->tiles = *tiles;
+    task->targetError = targetError;
+    task->minSamples = i1_max(2, (i32)cv_pt_min_samples.asFloat);
+    task_run(&task->task, ConvergeFn, tiles->tileCount);
+
+    AllocateSamples(trace);
+
+    ProfileEnd(pm_converge);
+}
+
+static void ResetAccumulation(pt_trace_t* trace)
+{
+    const i32 texelCount = trace->imageSize.x * trace->imageSize.y;
+    memset(trace->sampleCounts, 0, sizeof(trace->sampleCounts[0]) * texelCount);
+    memset(trace->tileSpp, 1, sizeof(trace->tileSpp[0]) * trace->tileCount);
+    trace->tilesDone = 0;
 }
 
 ProfileMark(pm_trace, pt_trace)
@@ -2160,9 +2666,17 @@ void pt_trace(pt_trace_t* desc)
     trace_task_t* task = tmp_calloc(sizeof(*task));
     task->trace = desc;
     task->camera = desc->camera[0];
+    task->tiles = screentiles_new(desc->imageSize);
+    ASSERT(task->tiles.tileCount == desc->tileCount);
 
-    const i32 workSize = desc->imageSize.x * desc->imageSize.y;
-    task_run(&task->task, TraceFn, workSize);
+    if (desc->sampleWeight >= 1.0f)
+    {
+        ResetAccumulation(desc);
+    }
+
+    task_run(&task->task, TraceFn, screentiles_worksize(&task->tiles));
+
+    UpdateConvergence(desc, &task->tiles);
 
     ProfileEnd(pm_trace);
 }
@@ -2174,6 +2688,7 @@ typedef struct pt_raygen_s
     float4 origin;
     float4* colors;
     float4* directions;
+    u32 sampleIndex;
 } pt_raygen_t;
 
 static void RayGenFn(task_t* pBase, i32 begin, i32 end)
@@ -2185,16 +2700,17 @@ static void RayGenFn(task_t* pBase, i32 begin, i32 end)
     float4* pim_noalias colors = task->colors;
     float4* pim_noalias directions = task->directions;
 
-    pt_sampler_t sampler = GetSampler();
+    const u32 sampleIndex = task->sampleIndex;
+
     for (i32 i = begin; i < end; ++i)
     {
+        pt_sampler_t sampler = pt_sampler_pixel(i, sampleIndex);
         float2 Xi = Sample2D(&sampler);
         float4 rd = SampleUnitSphere(Xi);
         directions[i] = rd;
         pt_result_t result = pt_trace_ray(&sampler, scene, (ray_t) { ro, rd });
         colors[i] = f3_f4(result.color, 1.0f);
     }
-    SetSampler(sampler);
 }
 
 ProfileMark(pm_raygen, pt_raygen)
@@ -2215,6 +2731,7 @@ pt_results_t pt_raygen(
     task->origin = origin;
     task->colors = tmp_malloc(sizeof(task->colors[0]) * count);
     task->directions = tmp_malloc(sizeof(task->directions[0]) * count);
+    task->sampleIndex = ms_raygenIndex++;
     task_run(&task->task, RayGenFn, count);
 
     pt_results_t results =
@@ -2230,11 +2747,21 @@ pt_results_t pt_raygen(
 
 pim_inline float VEC_CALL Sample1D(pt_sampler_t* sampler)
 {
+    if (sampler->seed)
+    {
+        const u32 seed = HashCombine32(sampler->seed, sampler->dim++);
+        return OwenSobol1D(sampler->index, seed);
+    }
     return prng_f32(&sampler->rng);
 }
 
 pim_inline float2 VEC_CALL Sample2D(pt_sampler_t* sampler)
 {
+    if (sampler->seed)
+    {
+        const u32 seed = HashCombine32(sampler->seed, sampler->dim++);
+        return OwenSobol2D(sampler->index, seed);
+    }
     return f2_rand(&sampler->rng);
 }
 
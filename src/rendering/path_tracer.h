@@ -11,9 +11,14 @@ typedef struct camera_s camera_t;
 
 typedef struct pt_scene_s pt_scene_t;
 
+// either a plain random stream, or one sample of a pixel's owen scrambled
+// sobol sequence that is independent of the thread drawing from it.
 typedef struct pt_sampler_s
 {
     prng_t rng;
+    u32 seed;       // per pixel sequence, 0 draws from rng instead
+    u32 index;      // sample index within the sequence
+    u32 dim;        // next dimension of the sample
 } pt_sampler_t;
 
 typedef enum
@@ -50,8 +55,14 @@ typedef struct pt_trace_s
     float3* color;
     float3* albedo;
     float3* normal;
+    float* lumMoment;       // running mean of squared luminance
+    i32* sampleCounts;      // samples accumulated per texel
+    u8* tileSpp;            // samples per pixel of each screen tile next pass, 0 once converged
+    float* tileError;       // standard error of each screen tile relative to the target
+    i32 tileCount;
+    i32 tilesDone;
     int2 imageSize;
-    float sampleWeight;
+    float sampleWeight;     // 1 restarts accumulation
     dofinfo_t dofinfo;
 } pt_trace_t;
 
@@ -72,6 +83,10 @@ void pt_sys_init(void);
 void pt_sys_update(void);
 void pt_sys_shutdown(void);
 
+// reseeds every thread's sampler and the pixel sequences, for reproducible runs
+void pt_sampler_seed(u64 seed);
+// sampler for sample 'index' of a pixel or texel, the same on every thread
+pt_sampler_t VEC_CALL pt_sampler_pixel(u32 pixel, u32 index);
 pt_sampler_t VEC_CALL pt_sampler_get(void);
 void VEC_CALL pt_sampler_set(pt_sampler_t sampler);
 float2 VEC_CALL pt_sample_2d(pt_sampler_t* sampler);
@@ -89,12 +104,26 @@ void dofinfo_new(dofinfo_t* dof);
 void dofinfo_gui(dofinfo_t* dof);
 
 rayhit_t VEC_CALL pt_intersect(const pt_scene_t* scene, ray_t ray, float tNear, float tFar);
+// true if anything lies between tNear and tFar, cheaper than pt_intersect
+bool VEC_CALL pt_occluded(const pt_scene_t* scene, ray_t ray, float tNear, float tFar);
 
 pt_result_t VEC_CALL pt_trace_ray(
     pt_sampler_t* sampler,
     const pt_scene_t* scene,
     ray_t ray);
 
+// traces count paths together, results[i] belongs to rays[i] and draws
+// from samplers[i]. coherent hints that the primary rays are similar, eg. from a camera.
+// spread is the angle between neighboring rays, used to filter textures.
+void pt_trace_rays(
+    pt_sampler_t* samplers,
+    const pt_scene_t* scene,
+    const ray_t* rays,
+    pt_result_t* results,
+    i32 count,
+    bool coherent,
+    float spread);
+
 void pt_trace(pt_trace_t* traceDesc);
 
 pt_results_t pt_raygen(
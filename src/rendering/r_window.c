@@ -19,6 +19,8 @@ static cvar_t cv_FpsLimit =
 };
 
 static GLFWwindow* ms_window;
+static bool ms_headless;
+static bool ms_shouldClose;
 static i32 ms_width;
 static i32 ms_height;
 static i32 ms_target;
@@ -30,11 +32,18 @@ static void OnGlfwError(i32 error_code, const char* description);
 
 // ----------------------------------------------------------------------------
 
-void window_sys_init(void)
+void window_sys_init(bool headless)
 {
     cvar_reg(&cv_FpsLimit);
     ms_lastSwap = time_now();
 
+    ms_headless = headless;
+    ms_shouldClose = false;
+    if (headless)
+    {
+        return;
+    }
+
     glfwSetErrorCallback(OnGlfwError);
     i32 rv = glfwInit();
     ASSERT(rv);
@@ -56,14 +65,21 @@ void window_sys_update(void)
 {
     ProfileBegin(pm_update);
 
-    ASSERT(ms_window);
-    glfwGetWindowSize(ms_window, &ms_width, &ms_height);
+    if (!ms_headless)
+    {
+        ASSERT(ms_window);
+        glfwGetWindowSize(ms_window, &ms_width, &ms_height);
+    }
 
     ProfileEnd(pm_update);
 }
 
 void window_sys_shutdown(void)
 {
+    if (ms_headless)
+    {
+        return;
+    }
     ASSERT(ms_window);
     glfwDestroyWindow(ms_window);
     ms_window = NULL;
@@ -82,14 +98,28 @@ i32 window_height(void)
     return ms_height;
 }
 
+bool window_headless(void)
+{
+    return ms_headless;
+}
+
 bool window_is_open(void)
 {
+    if (ms_headless)
+    {
+        return !ms_shouldClose;
+    }
     ASSERT(ms_window);
     return !glfwWindowShouldClose(ms_window);
 }
 
 void window_close(bool shouldClose)
 {
+    if (ms_headless)
+    {
+        ms_shouldClose = shouldClose;
+        return;
+    }
     ASSERT(ms_window);
     glfwSetWindowShouldClose(ms_window, shouldClose);
 }
@@ -127,9 +157,13 @@ void window_swapbuffers(void)
 {
     ProfileBegin(pm_swapbuffers);
 
-    ASSERT(ms_window);
-    glfwSwapBuffers(ms_window);
-    wait_for_target_fps();
+    // headless frames run back to back
+    if (!ms_headless)
+    {
+        ASSERT(ms_window);
+        glfwSwapBuffers(ms_window);
+        wait_for_target_fps();
+    }
 
     ProfileEnd(pm_swapbuffers);
 }
@@ -4,10 +4,14 @@
 
 PIM_C_BEGIN
 
-void window_sys_init(void);
+// headless: creates no window or gl context, for batch bakes and renders.
+// window_is_open then only tracks window_close.
+void window_sys_init(bool headless);
 void window_sys_update(void);
 void window_sys_shutdown(void);
 
+bool window_headless(void);
+
 i32 window_width(void);
 i32 window_height(void);
 bool window_is_open(void);
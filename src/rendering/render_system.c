@@ -29,6 +29,7 @@
 #include "math/lighting.h"
 #include "math/cubic_fit.h"
 #include "math/atmosphere.h"
+#include "math/box.h"
 
 #include "rendering/constants.h"
 #include "rendering/r_window.h"
@@ -45,9 +46,11 @@
 #include "rendering/lightmap.h"
 #include "rendering/denoise.h"
 #include "rendering/rtcdraw.h"
+#include "rendering/blas.h"
 #include "rendering/exposure.h"
 #include "rendering/mesh.h"
 #include "rendering/material.h"
+#include "rendering/bench.h"
 
 #include "rendering/vulkan/vkr.h"
 
@@ -71,6 +74,11 @@ static cvar_t cv_r_sw = { cvart_bool, 0, "r_sw", "1", "use software renderer" };
 
 static cvar_t cv_lm_density = { cvart_float, 0, "lm_density", "8", "lightmap texels per unit" };
 static cvar_t cv_lm_timeslice = { cvart_int, 0, "lm_timeslice", "10", "number of frames required to add 1 lighting sample to all lightmap texels" };
+static cvar_t cv_lm_target_samples = { cvart_int, 0, "lm_target_samples", "0", "lm_bake completes once every texel has this many samples, 0 disables" };
+static cvar_t cv_lm_target_error = { cvart_float, 0, "lm_target_error", "0", "lm_bake completes once every texel's relative standard error is below this, 0 disables" };
+static cvar_t cv_lm_checkpoint = { cvart_float, 0, "lm_checkpoint", "300", "seconds between lm_bake checkpoints, 0 only saves on completion" };
+static cvar_t cv_lm_bake_quit = { cvart_bool, 0, "lm_bake_quit", "0", "quit once lm_bake completes" };
+static cvar_t cv_lm_edit_radius = { cvart_float, 0, "lm_edit_radius", "4", "texels this far from an edited drawable are rebaked, negative rebakes all texels" };
 
 static cvar_t cv_r_sun_az = { cvart_float, 0, "r_sun_az", "0.75", "Sun Heading" };
 static cvar_t cv_r_sun_ze = { cvart_float, 0, "r_sun_ze", "0.5", "Sun Altitude" };
@@ -91,6 +99,11 @@ static void RegCVars(void)
     cvar_reg(&cv_lm_gen);
     cvar_reg(&cv_lm_density);
     cvar_reg(&cv_lm_timeslice);
+    cvar_reg(&cv_lm_target_samples);
+    cvar_reg(&cv_lm_target_error);
+    cvar_reg(&cv_lm_checkpoint);
+    cvar_reg(&cv_lm_bake_quit);
+    cvar_reg(&cv_lm_edit_radius);
 
     cvar_reg(&cv_cm_gen);
 
@@ -112,6 +125,7 @@ static cmdstat_t CmdPtStdDev(i32 argc, const char** argv);
 static cmdstat_t CmdLoadTest(i32 argc, const char** argv);
 static cmdstat_t CmdLoadMap(i32 argc, const char** argv);
 static cmdstat_t CmdSaveMap(i32 argc, const char** argv);
+static cmdstat_t CmdLmBake(i32 argc, const char** argv);
 
 // ----------------------------------------------------------------------------
 
@@ -185,9 +199,15 @@ static void ShutdownPtScene(void)
     }
 }
 
+static bool ms_editValid;
+// drawables of the loaded map, names its editing lightmaps
+static guid_t ms_mapGuid;
+
 static void LightmapShutdown(void)
 {
     lmpack_del(lmpack_get());
+    // the next pack takes a new edit snapshot
+    ms_editValid = false;
 }
 
 static void LightmapRepack(void)
@@ -271,6 +291,15 @@ static void Lightmap_Trace(void)
         ProfileBegin(pm_Lightmap_Trace);
         EnsurePtScene();
 
+        // runtime packs can not be baked into, swap in the map's editing pack
+        if (fmap_isopen(lmpack_get()->map))
+        {
+            LightmapShutdown();
+            if (!guid_isnull(ms_mapGuid) && lmpack_load(lmpack_get(), ms_mapGuid))
+            {
+                con_logf(LogSev_Info, "lm", "loaded editing lightmaps to bake into");
+            }
+        }
         bool dirty = lmpack_get()->lmCount == 0;
         dirty |= cvar_check_dirty(&cv_lm_density);
         if (dirty)
@@ -285,6 +314,297 @@ static void Lightmap_Trace(void)
     }
 }
 
+// ----------------------------------------------------------------------------
+// incremental rebake: moving a drawable, changing its material or the sun
+// keeps the atlas and converged texels, and only restarts texels near the edit
+// and, for moved drawables, along the sun shadow they cast. edits of emitters
+// and sun changes restart every texel.
+// adding or removing drawables, or swapping meshes, still repacks.
+
+static i32 ms_editCount;
+static meshid_t* ms_editMeshes;
+static u64* ms_editHashes;
+static material_t* ms_editMaterials;
+static box_t* ms_editBounds;
+static float4 ms_editSun;
+
+pim_inline float4 VEC_CALL SunSettings(void)
+{
+    return f4_v(cv_r_sun_az.asFloat, cv_r_sun_ze.asFloat, cv_r_sun_rad.asFloat, 0.0f);
+}
+
+// same direction the path tracer traces sun shadows along
+pim_inline float4 VEC_CALL SunDirection(void)
+{
+    const float4 kUp = { 0.0f, 1.0f, 0.0f, 0.0f };
+    float azimuth = f1_sat(cv_r_sun_az.asFloat);
+    float zenith = f1_sat(cv_r_sun_ze.asFloat);
+    return TanToWorld(kUp, SampleUnitHemisphere(f2_v(azimuth, zenith)));
+}
+
+// emitted light reaches the whole scene, as does any edit of an emitter
+pim_inline bool VEC_CALL EmissionEdited(material_t prev, material_t cur)
+{
+    if ((prev.flags | cur.flags) & matflag_emissive)
+    {
+        return true;
+    }
+    // emission is the alpha channel of rome
+    bool edited = (prev.flatRome >> 24) != (cur.flatRome >> 24);
+    edited |= memcmp(&prev.rome, &cur.rome, sizeof(prev.rome)) != 0;
+    return edited;
+}
+
+// box swept away from the sun across the scene, covering the shadow it casts.
+// texels all lie within the scene, so the sweep may overshoot it.
+pim_inline box_t VEC_CALL SweepShadow(box_t box, box_t scene, float4 sunDir)
+{
+    const float dist = f4_length3(box_size(scene));
+    const float4 offset = f4_mulvs(sunDir, -dist);
+    box_t shadow = box_new(f4_add(box.lo, offset), f4_add(box.hi, offset));
+    return box_union(box, shadow);
+}
+
+pim_inline box_t VEC_CALL DrawableBounds(const drawables_t* dr, i32 i)
+{
+    mesh_t mesh;
+    if (mesh_get(dr->meshes[i], &mesh))
+    {
+        return box_transform(dr->matrices[i], mesh.bounds);
+    }
+    return box_empty();
+}
+
+static void LightmapEdits_Snapshot(void)
+{
+    const drawables_t* dr = drawables_get();
+    const i32 len = dr->count;
+    PermReserve(ms_editMeshes, len);
+    PermReserve(ms_editHashes, len);
+    PermReserve(ms_editMaterials, len);
+    PermReserve(ms_editBounds, len);
+    if (len > 0)
+    {
+        memcpy(ms_editMeshes, dr->meshes, sizeof(ms_editMeshes[0]) * len);
+        memcpy(ms_editHashes, dr->hashes, sizeof(ms_editHashes[0]) * len);
+        memcpy(ms_editMaterials, dr->materials, sizeof(ms_editMaterials[0]) * len);
+    }
+    for (i32 i = 0; i < len; ++i)
+    {
+        ms_editBounds[i] = DrawableBounds(dr, i);
+    }
+    ms_editCount = len;
+    ms_editSun = SunSettings();
+    ms_editValid = true;
+}
+
+static void LightmapEdits_Shutdown(void)
+{
+    pim_free(ms_editMeshes);
+    pim_free(ms_editHashes);
+    pim_free(ms_editMaterials);
+    pim_free(ms_editBounds);
+    ms_editMeshes = NULL;
+    ms_editHashes = NULL;
+    ms_editMaterials = NULL;
+    ms_editBounds = NULL;
+    ms_editCount = 0;
+    ms_editValid = false;
+}
+
+// runs before the frame's stages, as it may rebuild the scene they share
+ProfileMark(pm_LightmapEdits, LightmapEdits)
+static void LightmapEdits(void)
+{
+    lmpack_t* pack = lmpack_get();
+    if ((pack->lmCount == 0) || fmap_isopen(pack->map))
+    {
+        // nothing to keep, Lightmap_Trace repacks
+        ms_editValid = false;
+        return;
+    }
+
+    ProfileBegin(pm_LightmapEdits);
+
+    drawables_t* dr = drawables_get();
+    drawables_trs(dr);
+    if (!ms_editValid)
+    {
+        LightmapEdits_Snapshot();
+        goto end;
+    }
+
+    const i32 len = dr->count;
+    bool repack = len != ms_editCount;
+    const float4 sun = SunSettings();
+    bool global = memcmp(&ms_editSun, &sun, sizeof(sun)) != 0;
+    box_t bounds = box_empty();
+    box_t moved = box_empty();
+    box_t scene = box_empty();
+    i32 edits = 0;
+    for (i32 i = 0; (i < len) && !repack; ++i)
+    {
+        repack |= memcmp(ms_editMeshes + i, dr->meshes + i, sizeof(ms_editMeshes[0])) != 0;
+        const box_t prevBounds = ms_editBounds[i];
+        const box_t curBounds = DrawableBounds(dr, i);
+        scene = box_union(scene, box_union(prevBounds, curBounds));
+        const bool transformed = ms_editHashes[i] != dr->hashes[i];
+        const bool retextured = memcmp(ms_editMaterials + i, dr->materials + i, sizeof(ms_editMaterials[0])) != 0;
+        if (transformed || retextured)
+        {
+            global |= EmissionEdited(ms_editMaterials[i], dr->materials[i]);
+            // where it was and where it is now
+            const box_t edit = box_union(prevBounds, curBounds);
+            bounds = box_union(bounds, edit);
+            if (transformed)
+            {
+                moved = box_union(moved, edit);
+            }
+            ++edits;
+        }
+    }
+
+    if (repack)
+    {
+        con_logf(LogSev_Info, "lm", "drawables were added or removed, repacking lightmaps");
+        ShutdownPtScene();
+        LightmapRepack();
+        LightmapEdits_Snapshot();
+    }
+    else if (global || (edits > 0))
+    {
+        // the scene is flattened, rebuild it to trace the edit
+        ShutdownPtScene();
+        if (edits > 0)
+        {
+            lmpack_embed(pack);
+        }
+        const float radius = cv_lm_edit_radius.asFloat;
+        if (global || (radius < 0.0f))
+        {
+            const float kBig = 1 << 30;
+            bounds = box_new(f4_s(-kBig), f4_s(kBig));
+        }
+        else
+        {
+            // a moved occluder changes the sun shadow it casts, however far
+            if (moved.lo.x <= moved.hi.x)
+            {
+                bounds = box_union(bounds, SweepShadow(moved, scene, SunDirection()));
+            }
+            bounds.lo = f4_subvs(bounds.lo, radius);
+            bounds.hi = f4_addvs(bounds.hi, radius);
+        }
+        i32 restarted = lmpack_invalidate(pack, bounds);
+        con_logf(LogSev_Verbose, "lm", "%d edits restarted %d of %d lightmap texels", edits, restarted, pack->texelCount);
+        LightmapEdits_Snapshot();
+    }
+
+end:
+    ProfileEnd(pm_LightmapEdits);
+}
+
+// ----------------------------------------------------------------------------
+// offline bake job: lm_bake bakes a map's lightmaps until a target is met,
+// checkpointing through mapsave. mapload resumes from the last checkpoint.
+
+// lmpack_progress walks every texel, the job polls it at this interval
+#define kBakeJobPollSeconds 1.0
+
+static char ms_bakeJobMap[PIM_PATH];
+static bool ms_bakeJob;
+static u64 ms_bakeCheckpoint;
+static u64 ms_bakeJobPoll;
+
+static cmdstat_t CmdLmBake(i32 argc, const char** argv)
+{
+    if (argc != 2)
+    {
+        con_logf(LogSev_Error, "cmd", "lm_bake <map name>; map name is missing.");
+        return cmdstat_err;
+    }
+
+    // set first, so that mapload loads the bakeable editing format
+    cvar_set_bool(&cv_lm_gen, true);
+    char cmd[PIM_PATH];
+    SPrintf(ARGS(cmd), "mapload %s", argv[1]);
+    if (cmd_exec(cmd) != cmdstat_ok)
+    {
+        cvar_set_bool(&cv_lm_gen, false);
+        return cmdstat_err;
+    }
+    // a pending density change would repack, discarding resumed progress
+    cvar_check_dirty(&cv_lm_density);
+
+    StrCpy(ARGS(ms_bakeJobMap), argv[1]);
+    ms_bakeJob = true;
+    ms_bakeCheckpoint = time_now();
+    ms_bakeJobPoll = ms_bakeCheckpoint;
+
+    const lmpack_t* pack = lmpack_get();
+    if (pack->lmCount > 0)
+    {
+        const lmprogress_t progress = lmpack_progress(pack);
+        con_logf(LogSev_Info, "cmd", "lm_bake is resuming '%s' at %.1f samples per texel.",
+            argv[1], progress.meanSamples);
+    }
+    else
+    {
+        con_logf(LogSev_Info, "cmd", "lm_bake is baking '%s' from scratch.", argv[1]);
+    }
+    return cmdstat_ok;
+}
+
+ProfileMark(pm_BakeJob_Update, BakeJob_Update)
+static void BakeJob_Update(void)
+{
+    const lmpack_t* pack = lmpack_get();
+    if (!ms_bakeJob || (pack->lmCount == 0))
+    {
+        return;
+    }
+    if (time_sec(time_now() - ms_bakeJobPoll) < kBakeJobPollSeconds)
+    {
+        return;
+    }
+    ProfileBegin(pm_BakeJob_Update);
+    ms_bakeJobPoll = time_now();
+
+    const lmprogress_t progress = lmpack_progress(pack);
+    const float targetSamples = cv_lm_target_samples.asFloat;
+    const float targetError = cv_lm_target_error.asFloat;
+    bool done = false;
+    done |= (targetSamples > 0.0f) && (progress.minSamples >= targetSamples);
+    done |= (targetError > 0.0f) && (progress.maxError <= targetError);
+
+    const float interval = cv_lm_checkpoint.asFloat;
+    const double elapsed = time_sec(time_now() - ms_bakeCheckpoint);
+    if (done || ((interval > 0.0f) && (elapsed >= interval)))
+    {
+        ms_bakeCheckpoint = time_now();
+        char cmd[PIM_PATH];
+        SPrintf(ARGS(cmd), "mapsave %s", ms_bakeJobMap);
+        if (cmd_exec(cmd) == cmdstat_ok)
+        {
+            con_logf(LogSev_Info, "cmd", "lm_bake checkpointed '%s': %d texels, %.1f min / %.1f mean samples, %.4f max error.",
+                ms_bakeJobMap, progress.texelCount, progress.minSamples, progress.meanSamples, progress.maxError);
+        }
+    }
+
+    if (done)
+    {
+        con_logf(LogSev_Info, "cmd", "lm_bake completed '%s'.", ms_bakeJobMap);
+        ms_bakeJob = false;
+        cvar_set_bool(&cv_lm_gen, false);
+        if (cvar_get_bool(&cv_lm_bake_quit))
+        {
+            con_exec("quit");
+        }
+    }
+
+    ProfileEnd(pm_BakeJob_Update);
+}
+
 ProfileMark(pm_CubemapTrace, Cubemap_Trace)
 static void Cubemap_Trace(void)
 {
@@ -300,23 +620,42 @@ static void Cubemap_Trace(void)
 
         Cubemaps_t* table = Cubemaps_Get();
         float weight = 1.0f / ++ms_cmapSampleCount;
-        float pfweight = f1_min(1.0f, weight * 2.0f);
         for (i32 i = 0; i < table->count; ++i)
         {
             Cubemap* cubemap = table->cubemaps + i;
             sphere_t bounds = table->bounds[i];
             Cubemap_Bake(cubemap, ms_ptscene, bounds.value, weight);
-            Cubemap_Convolve(cubemap, 256, pfweight);
         }
 
         ProfileEnd(pm_CubemapTrace);
     }
 }
 
+ProfileMark(pm_CubemapConvolve, Cubemap_Convolve)
+static void Cubemap_Convolve_All(void)
+{
+    if (cv_cm_gen.asFloat != 0.0f)
+    {
+        ProfileBegin(pm_CubemapConvolve);
+
+        // convolved mips are not read by any later stage of the frame,
+        // so this is free to overlap with drawing.
+        Cubemaps_t* table = Cubemaps_Get();
+        float weight = 1.0f / i1_max(1, ms_cmapSampleCount);
+        float pfweight = f1_min(1.0f, weight * 2.0f);
+        for (i32 i = 0; i < table->count; ++i)
+        {
+            Cubemap_Convolve(table->cubemaps + i, 256, pfweight);
+        }
+
+        ProfileEnd(pm_CubemapConvolve);
+    }
+}
+
 ProfileMark(pm_PathTrace, PathTrace)
 ProfileMark(pm_ptDenoise, Denoise)
 ProfileMark(pm_ptBlit, Blit)
-static bool PathTrace(void)
+static void PathTrace(void)
 {
     if (cv_pt_trace.asFloat != 0.0f)
     {
@@ -390,9 +729,14 @@ static bool PathTrace(void)
         }
 
         ProfileEnd(pm_PathTrace);
-        return true;
     }
-    return false;
+}
+
+static camera_t ms_rastercam;
+
+static void ClusterLights(void)
+{
+    RtcDrawClusterLights(GetFrontBuf(), &ms_rastercam);
 }
 
 ProfileMark(pm_Rasterize, Rasterize)
@@ -400,14 +744,7 @@ static void Rasterize(void)
 {
     ProfileBegin(pm_Rasterize);
 
-    framebuf_t* frontBuf = GetFrontBuf();
-    framebuf_t* backBuf = GetBackBuf();
-
-    camera_t camera;
-    camera_get(&camera);
-
-    drawables_trs(drawables_get());
-    RtcDraw(frontBuf, &camera);
+    RtcDrawScene(GetFrontBuf(), &ms_rastercam);
 
     ProfileEnd(pm_Rasterize);
 }
@@ -483,7 +820,10 @@ static void Present(void)
     ms_exposure.deltaTime = (float)time_dtf();
     ExposeImage(size, frontBuf->light, &ms_exposure);
     ResolveTile(frontBuf, ms_tonemapper, ms_toneParams);
-    screenblit_blit(frontBuf->color, frontBuf->width, frontBuf->height);
+    if (!window_headless())
+    {
+        screenblit_blit(frontBuf->color, frontBuf->width, frontBuf->height);
+    }
     TakeScreenshot();
     SwapBuffers();
     ProfileEnd(pm_Present);
@@ -517,6 +857,7 @@ static cmdstat_t CmdLoadMap(i32 argc, const char** argv)
     drawables_clear(drawables_get());
     ShutdownPtScene();
     LightmapShutdown();
+    ms_mapGuid = (guid_t) { 0 };
 
     camera_reset();
 
@@ -528,7 +869,17 @@ static cmdstat_t CmdLoadMap(i32 argc, const char** argv)
     bool loaded = drawables_load(drawables_get(), guid);
     if (loaded)
     {
-        lmpack_load(lmpack_get(), guid);
+        ms_mapGuid = guid;
+        // baking needs the float editing format, drawing maps the runtime one
+        bool lmloaded = false;
+        if (!cvar_get_bool(&cv_lm_gen))
+        {
+            lmloaded = lmpack_load_runtime(lmpack_get(), guid);
+        }
+        if (!lmloaded)
+        {
+            lmpack_load(lmpack_get(), guid);
+        }
     }
 
     if (!loaded)
@@ -578,12 +929,22 @@ static cmdstat_t CmdSaveMap(i32 argc, const char** argv)
         con_logf(LogSev_Error, "cmd", "mapsave failed to saved '%s' drawables.", mapname);
     }
 
-    if (saved)
+    if (saved && fmap_isopen(lmpack_get()->map))
+    {
+        // nothing was baked into a runtime pack, the files on disk are current
+        con_logf(LogSev_Info, "cmd", "mapsave kept '%s' lightmaps, runtime lightmaps are read only.", mapname);
+    }
+    else if (saved)
     {
         saved = lmpack_save(lmpack_get(), guid);
         if (saved)
         {
             con_logf(LogSev_Info, "cmd", "mapsave saved '%s' lightmaps.", mapname);
+            // the editing format is kept for rebakes, runtime is what mapload prefers
+            if (!lmpack_save_runtime(lmpack_get(), guid))
+            {
+                con_logf(LogSev_Warning, "cmd", "mapsave failed to save '%s' runtime lightmaps.", mapname);
+            }
         }
         else
         {
@@ -661,6 +1022,89 @@ static void BakeSky(void)
     }
 }
 
+// ----------------------------------------------------------------------------
+
+typedef void(*stage_fn)(void);
+
+typedef struct task_Stage
+{
+    task_t task;
+    stage_fn stage;
+} task_Stage;
+
+static void StageFn(task_t* pbase, i32 begin, i32 end)
+{
+    task_Stage* task = (task_Stage*)pbase;
+    task->stage();
+}
+
+static i32 AddStage(taskgraph_t* graph, stage_fn stage)
+{
+    task_Stage* task = tmp_calloc(sizeof(*task));
+    task->stage = stage;
+    return taskgraph_add(graph, &task->task, StageFn, 1);
+}
+
+// Describes the frame as a DAG of stages, so that independent stages
+// can overlap instead of joining all workers at every stage boundary.
+// Stages that read the sky must wait on the stages that write it.
+ProfileMark(pm_Frame, Frame)
+static void Frame(void)
+{
+    ProfileBegin(pm_Frame);
+
+    const bool tracing = cv_pt_trace.asFloat != 0.0f;
+    const bool rasterizing = !tracing && (cv_r_sw.asFloat != 0.0f);
+
+    if (cv_lm_gen.asFloat != 0.0f)
+    {
+        LightmapEdits();
+    }
+    // stages share the scene, create it before any of them run
+    if (tracing || (cv_lm_gen.asFloat != 0.0f) || (cv_cm_gen.asFloat != 0.0f))
+    {
+        EnsurePtScene();
+    }
+    if (rasterizing)
+    {
+        camera_get(&ms_rastercam);
+        drawables_trs(drawables_get());
+    }
+
+    taskgraph_t graph;
+    taskgraph_new(&graph, EAlloc_Temp);
+
+    const i32 sky = AddStage(&graph, BakeSky);
+    const i32 lmap = AddStage(&graph, Lightmap_Trace);
+    const i32 cmap = AddStage(&graph, Cubemap_Trace);
+    const i32 convolve = AddStage(&graph, Cubemap_Convolve_All);
+
+    taskgraph_depend(&graph, sky, lmap);
+    // cubemap baking writes to the sky, which lightmap baking reads
+    taskgraph_depend(&graph, lmap, cmap);
+    taskgraph_depend(&graph, sky, cmap);
+    taskgraph_depend(&graph, cmap, convolve);
+
+    if (tracing)
+    {
+        const i32 trace = AddStage(&graph, PathTrace);
+        taskgraph_depend(&graph, cmap, trace);
+    }
+    else if (rasterizing)
+    {
+        const i32 cluster = AddStage(&graph, ClusterLights);
+        const i32 draw = AddStage(&graph, Rasterize);
+        taskgraph_depend(&graph, cluster, draw);
+        taskgraph_depend(&graph, lmap, draw);
+        taskgraph_depend(&graph, cmap, draw);
+    }
+
+    taskgraph_run(&graph);
+    taskgraph_del(&graph);
+
+    ProfileEnd(pm_Frame);
+}
+
 void render_sys_init(void)
 {
     ms_iFrame = 0;
@@ -676,17 +1120,27 @@ void render_sys_init(void)
     cmd_reg("pt_test", CmdPtTest);
     cmd_reg("pt_stddev", CmdPtStdDev);
     cmd_reg("loadtest", CmdLoadTest);
+    cmd_reg("lm_bake", CmdLmBake);
 
-    vkr_init(1920, 1080);
+    const bool headless = window_headless();
+    if (!headless)
+    {
+        vkr_init(1920, 1080);
+    }
 
     texture_sys_init();
     mesh_sys_init();
 
     framebuf_create(GetFrontBuf(), kDrawWidth, kDrawHeight);
     framebuf_create(GetBackBuf(), kDrawWidth, kDrawHeight);
-    screenblit_init(kDrawWidth, kDrawHeight);
+    if (!headless)
+    {
+        screenblit_init(kDrawWidth, kDrawHeight);
+    }
+    blas_sys_init();
     pt_sys_init();
     RtcDrawInit();
+    bench_sys_init();
 
     ms_toneParams.x = 0.3f; // shoulder
     ms_toneParams.y = 0.5f; // linear str
@@ -714,40 +1168,45 @@ void render_sys_update(void)
     texture_sys_update();
     mesh_sys_update();
     pt_sys_update();
+    bench_sys_update();
 
-    BakeSky();
-    Lightmap_Trace();
-    Cubemap_Trace();
-    if (!PathTrace())
-    {
-        if (cv_r_sw.asFloat != 0.0f)
-        {
-            Rasterize();
-        }
-    }
+    Frame();
+    BakeJob_Update();
     Present();
     Denoise_Evict();
 
-    vkr_update();
+    if (!window_headless())
+    {
+        vkr_update();
+    }
 
     ProfileEnd(pm_update);
 }
 
 void render_sys_shutdown(void)
 {
+    bench_sys_shutdown();
     RtcDrawShutdown();
 
     ShutdownPtScene();
+    LightmapEdits_Shutdown();
 
     pt_sys_shutdown();
-    screenblit_shutdown();
+    blas_sys_shutdown();
+    if (!window_headless())
+    {
+        screenblit_shutdown();
+    }
     framebuf_destroy(GetFrontBuf());
     framebuf_destroy(GetBackBuf());
 
     mesh_sys_shutdown();
     texture_sys_shutdown();
 
-    vkr_shutdown();
+    if (!window_headless())
+    {
+        vkr_shutdown();
+    }
 }
 
 static i32 CmpFloat(const void* lhs, const void* rhs, void* usr)
@@ -1,5 +1,6 @@
 #include "rendering/rtcdraw.h"
 #include "rendering/librtc.h"
+#include "rendering/blas.h"
 #include "math/float4_funcs.h"
 #include "math/float2_funcs.h"
 #include "math/float4x4_funcs.h"
@@ -22,11 +23,11 @@
 #include "rendering/cubemap.h"
 #include "rendering/mesh.h"
 #include "rendering/material.h"
+#include "rendering/screentile.h"
 
 #include "common/cvar.h"
 #include "common/profiler.h"
 #include "common/console.h"
-#include "common/fnv1a.h"
 #include "common/profiler.h"
 
 #include "threading/task.h"
@@ -51,14 +52,12 @@ typedef struct froxels_s
     lightlist_t lights[kFroxelCount];
 } froxels_t;
 
-typedef struct drawhash_s
+// state of a committed drawable geometry
+typedef struct drawgeom_s
 {
-    u64 meshes;
-    u64 materials;
-    u64 translations;
-    u64 rotations;
-    u64 scales;
-} drawhash_t;
+    u64 hash;       // drawables_t::hashes when last committed
+    meshid_t mesh;  // same mesh means only the instance transform changed
+} drawgeom_t;
 
 typedef struct world_s
 {
@@ -66,28 +65,21 @@ typedef struct world_s
     RTCScene scene;
     i32 numDrawables;
     i32 numLights;
-    drawhash_t drawablesHash;
-    u64 lightHash;
+    drawgeom_t* pim_noalias drawGeoms;
+    float4* pim_noalias lightSpheres;
     Cubemap* sky;
     froxels_t froxels;
 } world_t;
 
 static world_t ms_world;
 
-static drawhash_t HashDrawables(void);
 static void CreateScene(world_t* world);
 static void DestroyScene(world_t* world);
 static void UpdateScene(world_t* world);
-static bool AddDrawable(
-    world_t* world,
-    u32 geomId,
-    meshid_t meshid,
-    material_t mat,
-    float4 translation,
-    quat rotation,
-    float4 scale);
+static void RemoveGeometry(world_t* world, u32 geomId);
+static bool UpdateDrawables(world_t* world);
 static bool AddLight(world_t* world, u32 geomId, float4 center, float radius);
-static void UpdateLights(world_t* world);
+static bool UpdateLights(world_t* world);
 static void DrawScene(
     world_t* world,
     framebuf_t* target,
@@ -99,11 +91,7 @@ static void ClusterLights(
 
 void RtcDrawInit(void)
 {
-    if (rtc_init())
-    {
-        ms_world.device = rtc.NewDevice(NULL);
-        ASSERT(ms_world.device);
-    }
+    ms_world.device = blas_device();
 }
 
 void RtcDrawShutdown(void)
@@ -111,8 +99,11 @@ void RtcDrawShutdown(void)
     if (ms_world.device)
     {
         DestroyScene(&ms_world);
-        rtc.ReleaseDevice(ms_world.device);
         ms_world.device = NULL;
+        pim_free(ms_world.drawGeoms);
+        ms_world.drawGeoms = NULL;
+        pim_free(ms_world.lightSpheres);
+        ms_world.lightSpheres = NULL;
     }
 }
 
@@ -126,27 +117,32 @@ void RtcDraw(framebuf_t* target, const camera_t* camera)
     }
     ProfileBegin(pm_rtcdraw);
     UpdateScene(world);
+    ClusterLights(world, target, camera);
     DrawScene(world, target, camera);
     ProfileEnd(pm_rtcdraw);
 }
 
-static drawhash_t HashDrawables(void)
+void RtcDrawClusterLights(framebuf_t* target, const camera_t* camera)
 {
-    const drawables_t* drawables = drawables_get();
-    const i32 count = drawables->count;
-    const meshid_t* meshes = drawables->meshes;
-    const material_t* materials = drawables->materials;
-    const float4* translations = drawables->translations;
-    const quat* rotations = drawables->rotations;
-    const float4* scales = drawables->scales;
-
-    drawhash_t hash = { 0 };
-    hash.meshes = Fnv64Bytes(meshes, sizeof(meshes[0]) * count, Fnv64Bias);
-    hash.materials = Fnv64Bytes(materials, sizeof(materials[0]) * count, Fnv64Bias);
-    hash.translations = Fnv64Bytes(translations, sizeof(translations[0]) * count, Fnv64Bias);
-    hash.rotations = Fnv64Bytes(rotations, sizeof(rotations[0]) * count, Fnv64Bias);
-    hash.scales = Fnv64Bytes(scales, sizeof(scales[0]) * count, Fnv64Bias);
-    return hash;
+    world_t* world = &ms_world;
+    if (!world->device)
+    {
+        return;
+    }
+    ClusterLights(world, target, camera);
+}
+
+void RtcDrawScene(framebuf_t* target, const camera_t* camera)
+{
+    world_t* world = &ms_world;
+    if (!world->device)
+    {
+        return;
+    }
+    ProfileBegin(pm_rtcdraw);
+    UpdateScene(world);
+    DrawScene(world, target, camera);
+    ProfileEnd(pm_rtcdraw);
 }
 
 static void CreateDrawables(world_t* world)
@@ -156,33 +152,21 @@ static void CreateDrawables(world_t* world)
     const drawables_t* drawables = drawables_get();
     const i32 numDrawables = drawables->count;
     const meshid_t* meshes = drawables->meshes;
-    const material_t* materials = drawables->materials;
-    const float4* translations = drawables->translations;
-    const quat* rotations = drawables->rotations;
-    const float4* scales = drawables->scales;
+    const float4x4* matrices = drawables->matrices;
+    const u64* hashes = drawables->hashes;
 
+    if (numDrawables > 0)
+    {
+        PermReserve(world->drawGeoms, numDrawables);
+    }
     for (i32 i = 0; i < numDrawables; ++i)
     {
-        AddDrawable(
-            world,
-            i,
-            meshes[i],
-            materials[i],
-            translations[i],
-            rotations[i],
-            scales[i]);
+        blas_instance(world->scene, i, meshes[i], matrices + i);
+        world->drawGeoms[i].hash = hashes[i];
+        world->drawGeoms[i].mesh = meshes[i];
     }
 
     world->numDrawables = numDrawables;
-    world->drawablesHash = HashDrawables();
-}
-
-static u64 HashLights(void)
-{
-    const lights_t* lights = lights_get();
-    const i32 numLights = lights->ptCount;
-    const pt_light_t* ptLights = lights->ptLights;
-    return Fnv64Bytes(ptLights, sizeof(ptLights[0]) * numLights, Fnv64Bias);
 }
 
 static void CreateLights(world_t* world)
@@ -194,33 +178,33 @@ static void CreateLights(world_t* world)
     const i32 numLights = lights->ptCount;
     const pt_light_t* ptLights = lights->ptLights;
 
+    if (numLights > 0)
+    {
+        PermReserve(world->lightSpheres, numLights);
+    }
     for (i32 i = 0; i < numLights; ++i)
     {
-        AddLight(world, numDrawables + i, ptLights[i].pos, ptLights[i].rad.w);
+        float4 sphere = ptLights[i].pos;
+        sphere.w = ptLights[i].rad.w;
+        world->lightSpheres[i] = sphere;
+        AddLight(world, numDrawables + i, sphere, sphere.w);
     }
 
     world->numLights = numLights;
-    world->lightHash = HashLights();
 }
 
 static void DestroyLights(world_t* world)
 {
     const i32 numDrawables = world->numDrawables;
     const i32 numLights = world->numLights;
-    RTCScene scene = world->scene;
-    if (scene)
+    if (world->scene)
     {
         for (i32 i = 0; i < numLights; ++i)
         {
-            i32 id = numDrawables + i;
-            RTCGeometry geom = rtc.GetGeometry(scene, id);
-            rtc.DetachGeometry(scene, id);
-            if (geom)
-            {
-                rtc.ReleaseGeometry(geom);
-            }
+            RemoveGeometry(world, numDrawables + i);
         }
     }
+    world->numLights = 0;
 }
 
 static void CreateScene(world_t* world)
@@ -231,6 +215,10 @@ static void CreateScene(world_t* world)
     world->scene = scene;
     ASSERT(scene);
 
+    // top level of mesh instances and light spheres,
+    // meshes are shared object space BVHs from the blas cache
+    rtc.SetSceneFlags(scene, RTC_SCENE_FLAG_DYNAMIC);
+
     CreateDrawables(world);
     CreateLights(world);
 
@@ -244,6 +232,8 @@ static void DestroyScene(world_t* world)
         rtc.ReleaseScene(world->scene);
         world->scene = NULL;
     }
+    world->numDrawables = 0;
+    world->numLights = 0;
 }
 
 ProfileMark(pm_updatescene, UpdateScene)
@@ -251,15 +241,22 @@ static void UpdateScene(world_t* world)
 {
     ProfileBegin(pm_updatescene);
 
-    drawhash_t drawHash = HashDrawables();
-    if (memcmp(&world->drawablesHash, &drawHash, sizeof(drawHash)))
+    // light ids are offset by the drawable count,
+    // so adding or removing drawables starts over
+    if (!world->scene || (drawables_get()->count != world->numDrawables))
     {
-        world->drawablesHash = drawHash;
         DestroyScene(world);
         CreateScene(world);
     }
-
-    UpdateLights(world);
+    else
+    {
+        bool dirty = UpdateDrawables(world);
+        dirty |= UpdateLights(world);
+        if (dirty)
+        {
+            rtc.CommitScene(world->scene);
+        }
+    }
 
     const u32 kSkyName = 1;
     i32 iSky = Cubemaps_Find(kSkyName);
@@ -275,86 +272,55 @@ static void UpdateScene(world_t* world)
     ProfileEnd(pm_updatescene);
 }
 
-static bool AddDrawable(
-    world_t* world,
-    u32 geomId,
-    meshid_t meshid,
-    material_t mat,
-    float4 translation,
-    quat rotation,
-    float4 scale)
+static void RemoveGeometry(world_t* world, u32 geomId)
 {
-    ASSERT(world->device);
     ASSERT(world->scene);
 
-    RTCGeometry geom = NULL;
-
-    mesh_t mesh = { 0 };
-    if (!mesh_get(meshid, &mesh))
+    // scene holds the only reference, detaching frees it
+    if (rtc.GetGeometry(world->scene, geomId))
     {
-        goto onfail;
-    }
-
-    geom = rtc.NewGeometry(world->device, RTC_GEOMETRY_TYPE_TRIANGLE);
-    ASSERT(geom);
-    if (!geom)
-    {
-        goto onfail;
+        rtc.DetachGeometry(world->scene, geomId);
     }
+}
 
-    const i32 vertCount = mesh.length;
-    const i32 triCount = vertCount / 3;
+ProfileMark(pm_updatedrawables, UpdateDrawables)
+static bool UpdateDrawables(world_t* world)
+{
+    ProfileBegin(pm_updatedrawables);
 
-    float3* dstPositions = rtc.SetNewGeometryBuffer(
-        geom,
-        RTC_BUFFER_TYPE_VERTEX,
-        0,
-        RTC_FORMAT_FLOAT3,
-        sizeof(float3),
-        vertCount);
-    ASSERT(dstPositions);
-    if (!dstPositions)
-    {
-        goto onfail;
-    }
+    const drawables_t* drawables = drawables_get();
+    const i32 numDrawables = world->numDrawables;
+    ASSERT(drawables->count == numDrawables);
+    const meshid_t* pim_noalias meshes = drawables->meshes;
+    const float4x4* pim_noalias matrices = drawables->matrices;
+    const u64* pim_noalias hashes = drawables->hashes;
+    drawgeom_t* pim_noalias geoms = world->drawGeoms;
 
-    float4x4 M = f4x4_trs(translation, rotation, scale);
-    const float4* srcPositions = mesh.positions;
-    for (i32 i = 0; i < vertCount; ++i)
+    bool dirty = false;
+    for (i32 i = 0; i < numDrawables; ++i)
     {
-        float4 position = f4x4_mul_pt(M, srcPositions[i]);
-        dstPositions[i] = f4_f3(position);
-    }
+        if (geoms[i].hash == hashes[i])
+        {
+            continue;
+        }
+        dirty = true;
 
-    // kind of wasteful
-    i32* dstIndices = rtc.SetNewGeometryBuffer(
-        geom,
-        RTC_BUFFER_TYPE_INDEX,
-        0,
-        RTC_FORMAT_UINT3,
-        sizeof(i32) * 3,
-        triCount);
-    ASSERT(dstIndices);
-    if (!dstIndices)
-    {
-        goto onfail;
-    }
-    for (i32 i = 0; i < vertCount; ++i)
-    {
-        dstIndices[i] = i;
+        bool sameMesh = memcmp(&geoms[i].mesh, meshes + i, sizeof(meshes[0])) == 0;
+        if (sameMesh && rtc.GetGeometry(world->scene, i))
+        {
+            blas_transform(world->scene, i, matrices + i);
+        }
+        else
+        {
+            RemoveGeometry(world, i);
+            blas_instance(world->scene, i, meshes[i], matrices + i);
+        }
+        geoms[i].hash = hashes[i];
+        geoms[i].mesh = meshes[i];
     }
 
-    rtc.CommitGeometry(geom);
-    rtc.AttachGeometryByID(world->scene, geom, geomId);
-    rtc.ReleaseGeometry(geom);
-    return true;
-
-onfail:
-    if (geom)
-    {
-        rtc.ReleaseGeometry(geom);
-    }
-    return false;
+    ProfileEnd(pm_updatedrawables);
+    return dirty;
 }
 
 static bool AddLight(world_t* world, u32 geomId, float4 center, float radius)
@@ -399,17 +365,51 @@ onfail:
     return false;
 }
 
-static void UpdateLights(world_t* world)
+static bool UpdateLights(world_t* world)
 {
     ASSERT(world->device);
     ASSERT(world->scene);
 
-    if (HashLights() != world->lightHash)
+    const lights_t* lights = lights_get();
+    const i32 numLights = lights->ptCount;
+    if (numLights != world->numLights)
     {
         DestroyLights(world);
         CreateLights(world);
-        rtc.CommitScene(world->scene);
+        return true;
     }
+
+    const i32 numDrawables = world->numDrawables;
+    const pt_light_t* pim_noalias ptLights = lights->ptLights;
+    float4* pim_noalias spheres = world->lightSpheres;
+    bool dirty = false;
+    for (i32 i = 0; i < numLights; ++i)
+    {
+        float4 sphere = ptLights[i].pos;
+        sphere.w = ptLights[i].rad.w;
+        if (memcmp(&sphere, spheres + i, sizeof(sphere)) == 0)
+        {
+            continue;
+        }
+        dirty = true;
+        spheres[i] = sphere;
+
+        RTCGeometry geom = rtc.GetGeometry(world->scene, numDrawables + i);
+        float4* dstPositions = geom ?
+            rtc.GetGeometryBufferData(geom, RTC_BUFFER_TYPE_VERTEX, 0) : NULL;
+        if (dstPositions)
+        {
+            dstPositions[0] = sphere;
+            rtc.UpdateGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0);
+            rtc.CommitGeometry(geom);
+        }
+        else
+        {
+            RemoveGeometry(world, numDrawables + i);
+            AddLight(world, numDrawables + i, sphere, sphere.w);
+        }
+    }
+    return dirty;
 }
 
 typedef enum
@@ -501,7 +501,8 @@ static rayhit_t VEC_CALL TraceRay(
     hit.wuvt = f4_v(w, u, v, t);
 
     const u32 numDrawables = world->numDrawables;
-    if (rtcHit.hit.geomID >= numDrawables)
+    const u32 instId = rtcHit.hit.instID[0];
+    if (instId == RTC_INVALID_GEOMETRY_ID)
     {
         hit.type = hit_light;
         hit.iDrawable = rtcHit.hit.geomID - numDrawables;
@@ -510,10 +511,13 @@ static rayhit_t VEC_CALL TraceRay(
     }
     else
     {
+        // mesh instance, Ng is in object space
         hit.type = hit_triangle;
-        hit.iDrawable = rtcHit.hit.geomID;
+        hit.iDrawable = instId;
         hit.iVert = rtcHit.hit.primID * 3;
-        ASSERT((u32)hit.iDrawable < numDrawables);
+        ASSERT(instId < numDrawables);
+        const float3x3 IM = drawables_get()->invMatrices[instId];
+        hit.normal = f4_normalize3(f3x3_mul_col(IM, hit.normal));
     }
     ASSERT(hit.iDrawable >= 0);
     ASSERT(hit.iVert >= 0);
@@ -540,12 +544,61 @@ pim_inline lightlist_t VEC_CALL GetLightList(const froxels_t* froxels, float4 P)
     return froxels->lights[i];
 }
 
+// transfers the ray differentials dddx, dddy of P = ro + s * d
+// onto the plane of triangle ABC, then into its uv space
+pim_inline void VEC_CALL CalcUvDifferentials(
+    float4 A, float4 B, float4 C,
+    float2 UA, float2 UB, float2 UC,
+    float4 N,
+    float4 d,
+    float s,
+    float4 dddx,
+    float4 dddy,
+    float2* duvdxOut,
+    float2* duvdyOut)
+{
+    float NoD = f4_dot3(N, d);
+    NoD = NoD < 0.0f ? f1_min(NoD, -kEpsilon) : f1_max(NoD, kEpsilon);
+    float4 dPdx = f4_mulvs(f4_sub(dddx, f4_mulvs(d, f4_dot3(N, dddx) / NoD)), s);
+    float4 dPdy = f4_mulvs(f4_sub(dddy, f4_mulvs(d, f4_dot3(N, dddy) / NoD)), s);
+
+    // least squares fit of dP onto the triangle edges
+    float4 e1 = f4_sub(B, A);
+    float4 e2 = f4_sub(C, A);
+    float d11 = f4_dot3(e1, e1);
+    float d12 = f4_dot3(e1, e2);
+    float d22 = f4_dot3(e2, e2);
+    float det = d11 * d22 - d12 * d12;
+    if (f1_abs(det) < kEpsilon)
+    {
+        *duvdxOut = f2_0;
+        *duvdyOut = f2_0;
+        return;
+    }
+    float rcpDet = 1.0f / det;
+    float2 t1 = f2_sub(UB, UA);
+    float2 t2 = f2_sub(UC, UA);
+
+    float rx1 = f4_dot3(dPdx, e1);
+    float rx2 = f4_dot3(dPdx, e2);
+    float bx1 = (d22 * rx1 - d12 * rx2) * rcpDet;
+    float bx2 = (d11 * rx2 - d12 * rx1) * rcpDet;
+    *duvdxOut = f2_add(f2_mulvs(t1, bx1), f2_mulvs(t2, bx2));
+
+    float ry1 = f4_dot3(dPdy, e1);
+    float ry2 = f4_dot3(dPdy, e2);
+    float by1 = (d22 * ry1 - d12 * ry2) * rcpDet;
+    float by2 = (d11 * ry2 - d12 * ry1) * rcpDet;
+    *duvdyOut = f2_add(f2_mulvs(t1, by1), f2_mulvs(t2, by2));
+}
+
 typedef struct task_DrawScene
 {
     task_t task;
     framebuf_t* target;
     const camera_t* camera;
     world_t* world;
+    screentiles_t tiles;
 } task_DrawScene;
 
 static void DrawSceneFn(task_t* pbase, i32 begin, i32 end)
@@ -554,6 +607,7 @@ static void DrawSceneFn(task_t* pbase, i32 begin, i32 end)
     framebuf_t* target = task->target;
     const camera_t* camera = task->camera;
     world_t* world = task->world;
+    const screentiles_t tiles = task->tiles;
     RTCScene scene = world->scene;
     const Cubemap* pim_noalias sky = world->sky;
     const froxels_t* pim_noalias froxels = &world->froxels;
@@ -582,12 +636,20 @@ static void DrawSceneFn(task_t* pbase, i32 begin, i32 end)
     const float4 up = quat_up(rotation);
     const float4 fwd = quat_fwd(rotation);
     const float2 slope = proj_slope(fov, aspect);
+    // change in unnormalized ray direction per pixel
+    const float4 dddx = f4_mulvs(right, 2.0f * slope.x * rcpSize.x);
+    const float4 dddy = f4_mulvs(up, 2.0f * slope.y * rcpSize.y);
 
     float4* pim_noalias dstLight = target->light;
 
     prng_t rng = prng_get();
-    for (i32 iTexel = begin; iTexel < end; ++iTexel)
+    for (i32 i = begin; i < end; ++i)
     {
+        const i32 iTexel = screentiles_texel(&tiles, i);
+        if (iTexel < 0)
+        {
+            continue;
+        }
         dstLight[iTexel] = f4_0;
 
         const i32 x = iTexel % size.x;
@@ -646,21 +708,42 @@ static void DrawSceneFn(task_t* pbase, i32 begin, i32 end)
         const float4 P = f4_add(f4_add(ro, f4_mulvs(rd, hit.wuvt.w)), f4_mulvs(N0, kMilli));
         const float2 uv = f2_blend(mesh.uvs[a], mesh.uvs[b], mesh.uvs[c], hit.wuvt);
 
+        float2 duvdx, duvdy;
+        {
+            const float4x4 M = matrices[hit.iDrawable];
+            const float rdz = f4_dot3(rd, fwd);
+            CalcUvDifferentials(
+                f4x4_mul_pt(M, mesh.positions[a]),
+                f4x4_mul_pt(M, mesh.positions[b]),
+                f4x4_mul_pt(M, mesh.positions[c]),
+                mesh.uvs[a], mesh.uvs[b], mesh.uvs[c],
+                hit.normal,
+                f4_divvs(rd, rdz),
+                hit.wuvt.w * rdz,
+                dddx,
+                dddy,
+                &duvdx,
+                &duvdy);
+        }
+
         float4 albedo = ColorToLinear(material.flatAlbedo);
         texture_t tex;
         if (texture_get(material.albedo, &tex))
         {
-            albedo = f4_mul(albedo, UvBilinearWrap_c32(tex.texels, tex.size, uv));
+            float mip = UvMipLevel(tex.size, duvdx, duvdy);
+            albedo = f4_mul(albedo, TexTrilinearWrap_c32(&tex, uv, mip));
         }
         float4 rome = ColorToLinear(material.flatRome);
         if (texture_get(material.rome, &tex))
         {
-            rome = f4_mul(rome, UvBilinearWrap_c32(tex.texels, tex.size, uv));
+            float mip = UvMipLevel(tex.size, duvdx, duvdy);
+            rome = f4_mul(rome, TexTrilinearWrap_c32(&tex, uv, mip));
         }
         float4 N = N0;
         if (texture_get(material.normal, &tex))
         {
-            float4 Nts = UvBilinearWrap_dir8(tex.texels, tex.size, uv);
+            float mip = UvMipLevel(tex.size, duvdx, duvdy);
+            float4 Nts = TexTrilinearWrap_dir8(&tex, uv, mip);
             N = TbnToWorld(TBN, Nts);
         }
 
@@ -699,7 +782,10 @@ static void DrawSceneFn(task_t* pbase, i32 begin, i32 end)
                     float4 axii[kGiDirections];
                     for (i32 i = 0; i < kGiDirections; ++i)
                     {
-                        probe[i] = UvBilinearClamp_f4(lmap.probes[i], i2_s(lmap.size), lmUv);
+                        // runtime packs only carry rgb9e5 probes
+                        probe[i] = lmap.probes[i] ?
+                            UvBilinearClamp_f4(lmap.probes[i], i2_s(lmap.size), lmUv) :
+                            UvBilinearClamp_rgb9e5(lmap.packed[i], i2_s(lmap.size), lmUv);
                         float4 ax = lmpack->axii[i];
                         float sharpness = ax.w;
                         ax = TbnToWorld(TBN, ax);
@@ -734,14 +820,13 @@ static void DrawScene(
     framebuf_t* target,
     const camera_t* camera)
 {
-    ClusterLights(world, target, camera);
-
     ProfileBegin(pm_drawscene);
     task_DrawScene* task = tmp_calloc(sizeof(*task));
     task->target = target;
     task->camera = camera;
     task->world = world;
-    task_run(&task->task, DrawSceneFn, target->width * target->height);
+    task->tiles = screentiles_new((int2) { target->width, target->height });
+    task_run(&task->task, DrawSceneFn, screentiles_worksize(&task->tiles));
     ProfileEnd(pm_drawscene);
 }
 
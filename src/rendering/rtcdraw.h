@@ -12,4 +12,9 @@ void RtcDrawShutdown(void);
 
 void RtcDraw(framebuf_t* target, const camera_t* camera);
 
+// RtcDraw split in two, so that light clustering can overlap other work.
+// RtcDrawScene must not begin until RtcDrawClusterLights completes.
+void RtcDrawClusterLights(framebuf_t* target, const camera_t* camera);
+void RtcDrawScene(framebuf_t* target, const camera_t* camera);
+
 PIM_C_END
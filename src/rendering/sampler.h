@@ -2,6 +2,16 @@
 
 #include "common/macro.h"
 
+// 4 wide texel decode and blend kernels.
+// the project is built with /arch:AVX2 so this is a compile time choice;
+// builds without sse2 fall back to the scalar reference kernels.
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#   define SAMPLER_SIMD 1
+#   include <immintrin.h>
+#else
+#   define SAMPLER_SIMD 0
+#endif // SIMD
+
 PIM_C_BEGIN
 
 #include "math/types.h"
@@ -66,6 +76,15 @@ pim_inline float VEC_CALL CalcMipLevel(float2 stride)
     return f1_max(0.0f, 0.5f * log2f(f2_dot(stride, stride)));
 }
 
+// duvdx, duvdy: uv distance traveled per pixel in x and y
+pim_inline float VEC_CALL UvMipLevel(int2 size, float2 duvdx, float2 duvdy)
+{
+    float2 fsize = i2_f2(size);
+    float2 dx = f2_mul(duvdx, fsize);
+    float2 dy = f2_mul(duvdy, fsize);
+    return CalcMipLevel(f2_dot(dx, dx) > f2_dot(dy, dy) ? dx : dy);
+}
+
 pim_inline i32 VEC_CALL CalcTileMip(int2 tileSize)
 {
     float m = CalcMipLevel(i2_f2(tileSize));
@@ -133,6 +152,66 @@ pim_inline i32 VEC_CALL UvWrap(int2 size, float2 uv)
     return Wrap(size, UvToCoord(size, uv));
 }
 
+// ----------------------------------------------------------------------------
+// tiled layout: each mip is stored as row major kTexTile x kTexTile blocks of
+// row major texels, so a bilinear footprint touches one or two cache lines
+// instead of two rows that are a full mip width apart.
+// mips are padded up to a whole number of tiles.
+
+#define kTexTileShift 2
+#define kTexTile (1 << kTexTileShift)
+#define kTexTileMask (kTexTile - 1)
+
+pim_inline int2 VEC_CALL CalcTileCount(int2 size)
+{
+    int2 y;
+    y.x = (size.x + kTexTileMask) >> kTexTileShift;
+    y.y = (size.y + kTexTileMask) >> kTexTileShift;
+    return y;
+}
+
+pim_inline i32 VEC_CALL CalcTiledMipLen(int2 size, i32 m)
+{
+    int2 tiles = CalcTileCount(CalcMipSize(size, m));
+    return tiles.x * tiles.y * (kTexTile * kTexTile);
+}
+
+pim_inline i32 VEC_CALL CalcTiledMipOffset(int2 size, i32 m)
+{
+    i32 y = 0;
+    m = i1_clamp(m, 0, CalcMipCount(size) - 1);
+    for (i32 i = 0; i < m; ++i)
+    {
+        y += CalcTiledMipLen(size, i);
+    }
+    return y;
+}
+
+pim_inline i32 VEC_CALL TiledMipChainLen(int2 size)
+{
+    return CalcTiledMipOffset(size, CalcMipCount(size) - 1) +
+        CalcTiledMipLen(size, CalcMipCount(size) - 1);
+}
+
+pim_inline i32 VEC_CALL CoordToTiledIndex(int2 size, int2 coord)
+{
+    i32 tilesX = (size.x + kTexTileMask) >> kTexTileShift;
+    i32 tile = (coord.x >> kTexTileShift) + (coord.y >> kTexTileShift) * tilesX;
+    i32 texel = (coord.x & kTexTileMask) + ((coord.y & kTexTileMask) << kTexTileShift);
+    return (tile << (2 * kTexTileShift)) + texel;
+}
+
+pim_inline i32 VEC_CALL TiledWrap(int2 size, int2 coord)
+{
+    return CoordToTiledIndex(size, WrapCoord(size, coord));
+}
+pim_inline i32 VEC_CALL TiledUvWrap(int2 size, float2 uv)
+{
+    return TiledWrap(size, UvToCoord(size, uv));
+}
+
+// ----------------------------------------------------------------------------
+
 pim_inline float4 VEC_CALL Clamp_c32(const u32* buffer, int2 size, int2 coord)
 {
     i32 index = Clamp(size, coord);
@@ -230,17 +309,171 @@ pim_inline float VEC_CALL BilinearBlend_f1(
     return c;
 }
 
+// ----------------------------------------------------------------------------
+// bilinear blends of 4 raw texels (a, b, c, d as in bilinear_t).
+// *_Ref are the scalar reference kernels, the unsuffixed versions use
+// SAMPLER_SIMD when available.
+
+pim_inline float4 VEC_CALL Blend_f4_Ref(
+    const float4* pim_noalias a,
+    const float4* pim_noalias b,
+    const float4* pim_noalias c,
+    const float4* pim_noalias d,
+    float2 frac)
+{
+    return BilinearBlend_f4(*a, *b, *c, *d, frac);
+}
+
+pim_inline float4 VEC_CALL Blend_c32_Ref(u32 a, u32 b, u32 c, u32 d, float2 frac)
+{
+    return BilinearBlend_f4(
+        ColorToLinear(a),
+        ColorToLinear(b),
+        ColorToLinear(c),
+        ColorToLinear(d),
+        frac);
+}
+
+pim_inline float4 VEC_CALL Blend_dir8_Ref(u32 a, u32 b, u32 c, u32 d, float2 frac)
+{
+    float4 N = BilinearBlend_f4(
+        ColorToDirection(a),
+        ColorToDirection(b),
+        ColorToDirection(c),
+        ColorToDirection(d),
+        frac);
+    return f4_normalize3(N);
+}
+
+#if SAMPLER_SIMD
+
+#if defined(__AVX2__)
+#   define SIMD_MADD(a, b, c)   _mm_fmadd_ps((a), (b), (c))
+#else
+#   define SIMD_MADD(a, b, c)   _mm_add_ps(_mm_mul_ps((a), (b)), (c))
+#endif // __AVX2__
+
+// bilinear weights of texels a, b, c, d
+pim_inline __m128 VEC_CALL SimdBilinearWeights(float2 frac)
+{
+    __m128 x = _mm_setr_ps(1.0f - frac.x, frac.x, 1.0f - frac.x, frac.x);
+    __m128 y = _mm_setr_ps(1.0f - frac.y, 1.0f - frac.y, frac.y, frac.y);
+    return _mm_mul_ps(x, y);
+}
+
+// byte lanes to rgba8_f4's unorm
+pim_inline __m128 VEC_CALL SimdUnorm8(__m128i x)
+{
+    __m128 y = _mm_cvtepi32_ps(x);
+    return _mm_mul_ps(_mm_add_ps(y, _mm_set1_ps(0.5f)), _mm_set1_ps(1.0f / 255.0f));
+}
+
+// cubic fit sRGB -> Linear conversion, see f4_tolinear
+pim_inline __m128 VEC_CALL SimdToLinear(__m128 c)
+{
+    __m128 y = _mm_set1_ps(0.324285f);
+    y = SIMD_MADD(y, c, _mm_set1_ps(0.656075f));
+    y = SIMD_MADD(y, c, _mm_set1_ps(0.020883f));
+    return _mm_mul_ps(y, c);
+}
+
+// sums each channel's weighted texels, r holds (r_a, r_b, r_c, r_d) etc
+pim_inline float4 VEC_CALL SimdWeightedSum(__m128 r, __m128 g, __m128 b, __m128 a, __m128 wts)
+{
+    r = _mm_mul_ps(r, wts);
+    g = _mm_mul_ps(g, wts);
+    b = _mm_mul_ps(b, wts);
+    a = _mm_mul_ps(a, wts);
+    _MM_TRANSPOSE4_PS(r, g, b, a);
+    float4 y;
+    _mm_store_ps(&y.x, _mm_add_ps(_mm_add_ps(r, g), _mm_add_ps(b, a)));
+    return y;
+}
+
+pim_inline float4 VEC_CALL Blend_f4(
+    const float4* pim_noalias a,
+    const float4* pim_noalias b,
+    const float4* pim_noalias c,
+    const float4* pim_noalias d,
+    float2 frac)
+{
+    __m128 fx = _mm_set1_ps(frac.x);
+    __m128 fy = _mm_set1_ps(frac.y);
+    __m128 va = _mm_load_ps(&a->x);
+    __m128 vc = _mm_load_ps(&c->x);
+    __m128 ab = SIMD_MADD(_mm_sub_ps(_mm_load_ps(&b->x), va), fx, va);
+    __m128 cd = SIMD_MADD(_mm_sub_ps(_mm_load_ps(&d->x), vc), fx, vc);
+    float4 y;
+    _mm_store_ps(&y.x, SIMD_MADD(_mm_sub_ps(cd, ab), fy, ab));
+    return y;
+}
+
+pim_inline float4 VEC_CALL Blend_c32(u32 a, u32 b, u32 c, u32 d, float2 frac)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    __m128i texels = _mm_setr_epi32((i32)a, (i32)b, (i32)c, (i32)d);
+    __m128 vr = SimdToLinear(SimdUnorm8(_mm_and_si128(texels, mask)));
+    __m128 vg = SimdToLinear(SimdUnorm8(_mm_and_si128(_mm_srli_epi32(texels, 8), mask)));
+    __m128 vb = SimdToLinear(SimdUnorm8(_mm_and_si128(_mm_srli_epi32(texels, 16), mask)));
+    __m128 va = SimdToLinear(SimdUnorm8(_mm_srli_epi32(texels, 24)));
+    return SimdWeightedSum(vr, vg, vb, va, SimdBilinearWeights(frac));
+}
+
+pim_inline float4 VEC_CALL Blend_dir8(u32 a, u32 b, u32 c, u32 d, float2 frac)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128i texels = _mm_setr_epi32((i32)a, (i32)b, (i32)c, (i32)d);
+    __m128 vx = _mm_sub_ps(_mm_mul_ps(SimdUnorm8(_mm_and_si128(texels, mask)), two), one);
+    __m128 vy = _mm_sub_ps(_mm_mul_ps(SimdUnorm8(_mm_and_si128(_mm_srli_epi32(texels, 8), mask)), two), one);
+    __m128 vz = _mm_sub_ps(_mm_mul_ps(SimdUnorm8(_mm_and_si128(_mm_srli_epi32(texels, 16), mask)), two), one);
+    __m128 vw = _mm_sub_ps(_mm_mul_ps(SimdUnorm8(_mm_srli_epi32(texels, 24)), two), one);
+
+    // normalize each texel's direction, see ColorToDirection
+    __m128 len = _mm_mul_ps(vx, vx);
+    len = SIMD_MADD(vy, vy, len);
+    len = SIMD_MADD(vz, vz, len);
+    len = _mm_max_ps(_mm_sqrt_ps(len), _mm_set1_ps(kEpsilon));
+    __m128 wts = _mm_div_ps(SimdBilinearWeights(frac), len);
+
+    float4 N = SimdWeightedSum(vx, vy, vz, vw, wts);
+    return f4_normalize3(N);
+}
+
+#else
+
+pim_inline float4 VEC_CALL Blend_f4(
+    const float4* pim_noalias a,
+    const float4* pim_noalias b,
+    const float4* pim_noalias c,
+    const float4* pim_noalias d,
+    float2 frac)
+{
+    return Blend_f4_Ref(a, b, c, d, frac);
+}
+
+pim_inline float4 VEC_CALL Blend_c32(u32 a, u32 b, u32 c, u32 d, float2 frac)
+{
+    return Blend_c32_Ref(a, b, c, d, frac);
+}
+
+pim_inline float4 VEC_CALL Blend_dir8(u32 a, u32 b, u32 c, u32 d, float2 frac)
+{
+    return Blend_dir8_Ref(a, b, c, d, frac);
+}
+
+#endif // SAMPLER_SIMD
+
+// ----------------------------------------------------------------------------
+
 pim_inline float4 VEC_CALL BilinearClamp_f4(const float4* pim_noalias buffer, int2 size, bilinear_t bi)
 {
     i32 ia = Clamp(size, bi.a);
     i32 ib = Clamp(size, bi.b);
     i32 ic = Clamp(size, bi.c);
     i32 id = Clamp(size, bi.d);
-    float4 a = buffer[ia];
-    float4 b = buffer[ib];
-    float4 c = buffer[ic];
-    float4 d = buffer[id];
-    return BilinearBlend_f4(a, b, c, d, bi.frac);
+    return Blend_f4(buffer + ia, buffer + ib, buffer + ic, buffer + id, bi.frac);
 }
 pim_inline float4 VEC_CALL BilinearWrap_f4(const float4* pim_noalias buffer, int2 size, bilinear_t bi)
 {
@@ -248,11 +481,7 @@ pim_inline float4 VEC_CALL BilinearWrap_f4(const float4* pim_noalias buffer, int
     i32 ib = Wrap(size, bi.b);
     i32 ic = Wrap(size, bi.c);
     i32 id = Wrap(size, bi.d);
-    float4 a = buffer[ia];
-    float4 b = buffer[ib];
-    float4 c = buffer[ic];
-    float4 d = buffer[id];
-    return BilinearBlend_f4(a, b, c, d, bi.frac);
+    return Blend_f4(buffer + ia, buffer + ib, buffer + ic, buffer + id, bi.frac);
 }
 
 pim_inline float3 VEC_CALL BilinearClamp_f3(const float3* pim_noalias buffer, int2 size, bilinear_t bi)
@@ -309,19 +538,19 @@ pim_inline float VEC_CALL BilinearClamp_f1(const float* pim_noalias buffer, int2
 
 pim_inline float4 VEC_CALL BilinearClamp_c32(const u32* pim_noalias buffer, int2 size, bilinear_t bi)
 {
-    float4 a = Clamp_c32(buffer, size, bi.a);
-    float4 b = Clamp_c32(buffer, size, bi.b);
-    float4 c = Clamp_c32(buffer, size, bi.c);
-    float4 d = Clamp_c32(buffer, size, bi.d);
-    return BilinearBlend_f4(a, b, c, d, bi.frac);
+    u32 a = buffer[Clamp(size, bi.a)];
+    u32 b = buffer[Clamp(size, bi.b)];
+    u32 c = buffer[Clamp(size, bi.c)];
+    u32 d = buffer[Clamp(size, bi.d)];
+    return Blend_c32(a, b, c, d, bi.frac);
 }
 pim_inline float4 VEC_CALL BilinearWrap_c32(const u32* pim_noalias buffer, int2 size, bilinear_t bi)
 {
-    float4 a = Wrap_c32(buffer, size, bi.a);
-    float4 b = Wrap_c32(buffer, size, bi.b);
-    float4 c = Wrap_c32(buffer, size, bi.c);
-    float4 d = Wrap_c32(buffer, size, bi.d);
-    return BilinearBlend_f4(a, b, c, d, bi.frac);
+    u32 a = buffer[Wrap(size, bi.a)];
+    u32 b = buffer[Wrap(size, bi.b)];
+    u32 c = buffer[Wrap(size, bi.c)];
+    u32 d = buffer[Wrap(size, bi.d)];
+    return Blend_c32(a, b, c, d, bi.frac);
 }
 
 pim_inline float4 VEC_CALL UvBilinearClamp_f4(const float4* pim_noalias buffer, int2 size, float2 uv)
@@ -364,6 +593,20 @@ pim_inline float VEC_CALL UvBilinearClamp_f1(const float* pim_noalias buffer, in
     return value;
 }
 
+pim_inline float4 VEC_CALL BilinearClamp_rgb9e5(const u32* pim_noalias buffer, int2 size, bilinear_t bi)
+{
+    float4 a = rgb9e5_f4(buffer[Clamp(size, bi.a)]);
+    float4 b = rgb9e5_f4(buffer[Clamp(size, bi.b)]);
+    float4 c = rgb9e5_f4(buffer[Clamp(size, bi.c)]);
+    float4 d = rgb9e5_f4(buffer[Clamp(size, bi.d)]);
+    return BilinearBlend_f4(a, b, c, d, bi.frac);
+}
+pim_inline float4 VEC_CALL UvBilinearClamp_rgb9e5(const u32* pim_noalias buffer, int2 size, float2 uv)
+{
+    bilinear_t bi = Bilinear(size, uv);
+    return BilinearClamp_rgb9e5(buffer, size, bi);
+}
+
 pim_inline float4 VEC_CALL UvBilinearClamp_c32(const u32* pim_noalias buffer, int2 size, float2 uv)
 {
     bilinear_t bi = Bilinear(size, uv);
@@ -380,20 +623,11 @@ pim_inline float4 VEC_CALL UvBilinearWrap_c32(const u32* pim_noalias buffer, int
 pim_inline float4 VEC_CALL UvBilinearWrap_dir8(const u32* pim_noalias buffer, int2 size, float2 uv)
 {
     bilinear_t bi = Bilinear(size, uv);
-    i32 ia = Wrap(size, bi.a);
-    i32 ib = Wrap(size, bi.b);
-    i32 ic = Wrap(size, bi.c);
-    i32 id = Wrap(size, bi.d);
-    u32 ca = buffer[ia];
-    u32 cb = buffer[ib];
-    u32 cc = buffer[ic];
-    u32 cd = buffer[id];
-    float4 a = ColorToDirection(ca);
-    float4 b = ColorToDirection(cb);
-    float4 c = ColorToDirection(cc);
-    float4 d = ColorToDirection(cd);
-    float4 N = BilinearBlend_f4(a, b, c, d, bi.frac);
-    return f4_normalize3(N);
+    u32 a = buffer[Wrap(size, bi.a)];
+    u32 b = buffer[Wrap(size, bi.b)];
+    u32 c = buffer[Wrap(size, bi.c)];
+    u32 d = buffer[Wrap(size, bi.d)];
+    return Blend_dir8(a, b, c, d, bi.frac);
 }
 
 pim_inline float4 VEC_CALL TrilinearClamp_f4(
@@ -402,6 +636,7 @@ pim_inline float4 VEC_CALL TrilinearClamp_f4(
     float2 uv,
     float mip)
 {
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
     i32 m0 = (i32)f1_floor(mip);
     i32 m1 = (i32)f1_ceil(mip);
     float mfrac = f1_frac(mip);
@@ -423,6 +658,7 @@ pim_inline float4 VEC_CALL TrilinearWrap_f4(
     float2 uv,
     float mip)
 {
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
     i32 m0 = (i32)f1_floor(mip);
     i32 m1 = (i32)f1_ceil(mip);
     float mfrac = f1_frac(mip);
@@ -445,6 +681,7 @@ pim_inline float4 VEC_CALL TrilinearClamp_c32(
     float2 uv,
     float mip)
 {
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
     i32 m0 = (i32)f1_floor(mip);
     i32 m1 = (i32)f1_ceil(mip);
     float mfrac = f1_frac(mip);
@@ -466,6 +703,7 @@ pim_inline float4 VEC_CALL TrilinearWrap_c32(
     float2 uv,
     float mip)
 {
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
     i32 m0 = (i32)f1_floor(mip);
     i32 m1 = (i32)f1_ceil(mip);
     float mfrac = f1_frac(mip);
@@ -482,6 +720,168 @@ pim_inline float4 VEC_CALL TrilinearWrap_c32(
     return f4_lerpvs(s0, s1, mfrac);
 }
 
+pim_inline float4 VEC_CALL TrilinearWrap_dir8(
+    const u32* pim_noalias buffer,
+    int2 size,
+    float2 uv,
+    float mip)
+{
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
+    i32 m0 = (i32)f1_floor(mip);
+    i32 m1 = (i32)f1_ceil(mip);
+    float mfrac = f1_frac(mip);
+
+    int2 size0 = CalcMipSize(size, m0);
+    int2 size1 = CalcMipSize(size, m1);
+
+    i32 i0 = CalcMipOffset(size, m0);
+    i32 i1 = CalcMipOffset(size, m1);
+
+    float4 s0 = UvBilinearWrap_dir8(buffer + i0, size0, uv);
+    float4 s1 = UvBilinearWrap_dir8(buffer + i1, size1, uv);
+
+    return f4_normalize3(f4_lerpvs(s0, s1, mfrac));
+}
+
+// nearest texel of the nearest mip
+pim_inline float4 VEC_CALL UvWrapMip_c32(
+    const u32* pim_noalias buffer,
+    int2 size,
+    float2 uv,
+    float mip)
+{
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
+    i32 m = (i32)(mip + 0.5f);
+    return UvWrap_c32(buffer + CalcMipOffset(size, m), CalcMipSize(size, m), uv);
+}
+
+// ----------------------------------------------------------------------------
+// tiled layout samplers, buffer and size are the whole mip chain
+
+pim_inline float4 VEC_CALL TiledBilinearWrap_c32(const u32* pim_noalias buffer, int2 size, bilinear_t bi)
+{
+    u32 a = buffer[TiledWrap(size, bi.a)];
+    u32 b = buffer[TiledWrap(size, bi.b)];
+    u32 c = buffer[TiledWrap(size, bi.c)];
+    u32 d = buffer[TiledWrap(size, bi.d)];
+    return Blend_c32(a, b, c, d, bi.frac);
+}
+
+pim_inline float4 VEC_CALL TiledUvBilinearWrap_c32(const u32* pim_noalias buffer, int2 size, float2 uv)
+{
+    bilinear_t bi = Bilinear(size, uv);
+    return TiledBilinearWrap_c32(buffer, size, bi);
+}
+
+pim_inline float4 VEC_CALL TiledUvBilinearWrap_dir8(const u32* pim_noalias buffer, int2 size, float2 uv)
+{
+    bilinear_t bi = Bilinear(size, uv);
+    u32 a = buffer[TiledWrap(size, bi.a)];
+    u32 b = buffer[TiledWrap(size, bi.b)];
+    u32 c = buffer[TiledWrap(size, bi.c)];
+    u32 d = buffer[TiledWrap(size, bi.d)];
+    return Blend_dir8(a, b, c, d, bi.frac);
+}
+
+pim_inline float4 VEC_CALL TiledTrilinearWrap_c32(
+    const u32* pim_noalias buffer,
+    const i32* pim_noalias mipOffsets,
+    int2 size,
+    float2 uv,
+    float mip)
+{
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
+    i32 m0 = (i32)f1_floor(mip);
+    i32 m1 = (i32)f1_ceil(mip);
+    float mfrac = f1_frac(mip);
+
+    int2 size0 = CalcMipSize(size, m0);
+    int2 size1 = CalcMipSize(size, m1);
+
+    i32 i0 = mipOffsets[m0];
+    i32 i1 = mipOffsets[m1];
+
+    float4 s0 = TiledUvBilinearWrap_c32(buffer + i0, size0, uv);
+    float4 s1 = TiledUvBilinearWrap_c32(buffer + i1, size1, uv);
+
+    return f4_lerpvs(s0, s1, mfrac);
+}
+
+pim_inline float4 VEC_CALL TiledTrilinearWrap_dir8(
+    const u32* pim_noalias buffer,
+    const i32* pim_noalias mipOffsets,
+    int2 size,
+    float2 uv,
+    float mip)
+{
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
+    i32 m0 = (i32)f1_floor(mip);
+    i32 m1 = (i32)f1_ceil(mip);
+    float mfrac = f1_frac(mip);
+
+    int2 size0 = CalcMipSize(size, m0);
+    int2 size1 = CalcMipSize(size, m1);
+
+    i32 i0 = mipOffsets[m0];
+    i32 i1 = mipOffsets[m1];
+
+    float4 s0 = TiledUvBilinearWrap_dir8(buffer + i0, size0, uv);
+    float4 s1 = TiledUvBilinearWrap_dir8(buffer + i1, size1, uv);
+
+    return f4_normalize3(f4_lerpvs(s0, s1, mfrac));
+}
+
+pim_inline float4 VEC_CALL TiledUvWrapMip_c32(
+    const u32* pim_noalias buffer,
+    const i32* pim_noalias mipOffsets,
+    int2 size,
+    float2 uv,
+    float mip)
+{
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
+    i32 m = (i32)(mip + 0.5f);
+    int2 mipSize = CalcMipSize(size, m);
+    u32 color = buffer[mipOffsets[m] + TiledUvWrap(mipSize, uv)];
+    return ColorToLinear(color);
+}
+
+// ----------------------------------------------------------------------------
+// texture_t samplers, dispatch on the texture's layout
+
+pim_inline float4 VEC_CALL TexTrilinearWrap_c32(const texture_t* pim_noalias tex, float2 uv, float mip)
+{
+    if (tex->layout == TexLayout_Tiled)
+    {
+        return TiledTrilinearWrap_c32(tex->texels, tex->mipOffsets, tex->size, uv, mip);
+    }
+    return TrilinearWrap_c32(tex->texels, tex->size, uv, mip);
+}
+
+pim_inline float4 VEC_CALL TexTrilinearWrap_dir8(const texture_t* pim_noalias tex, float2 uv, float mip)
+{
+    if (tex->layout == TexLayout_Tiled)
+    {
+        return TiledTrilinearWrap_dir8(tex->texels, tex->mipOffsets, tex->size, uv, mip);
+    }
+    return TrilinearWrap_dir8(tex->texels, tex->size, uv, mip);
+}
+
+pim_inline float4 VEC_CALL TexUvWrapMip_c32(const texture_t* pim_noalias tex, float2 uv, float mip)
+{
+    if (tex->layout == TexLayout_Tiled)
+    {
+        return TiledUvWrapMip_c32(tex->texels, tex->mipOffsets, tex->size, uv, mip);
+    }
+    return UvWrapMip_c32(tex->texels, tex->size, uv, mip);
+}
+
+pim_inline float4 VEC_CALL TexUvWrap_c32(const texture_t* pim_noalias tex, float2 uv)
+{
+    return TexUvWrapMip_c32(tex, uv, 0.0f);
+}
+
+// ----------------------------------------------------------------------------
+
 pim_inline void VEC_CALL Write_f4(float4* pim_noalias dst, int2 size, int2 coord, float4 src)
 {
     i32 i = Clamp(size, coord);
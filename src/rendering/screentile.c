@@ -0,0 +1,39 @@
+#include "rendering/screentile.h"
+#include "allocator/allocator.h"
+#include "common/profiler.h"
+
+ProfileMark(pm_new, screentiles_new)
+screentiles_t screentiles_new(int2 size)
+{
+    ProfileBegin(pm_new);
+
+    screentiles_t st = { 0 };
+    st.size = size;
+
+    const i32 tilesX = (size.x + kScreenTile - 1) >> kScreenTileShift;
+    const i32 tilesY = (size.y + kScreenTile - 1) >> kScreenTileShift;
+    const i32 count = screentiles_tilecount(size);
+    if (count > 0)
+    {
+        ASSERT(tilesX <= 0xffff);
+        ASSERT(tilesY <= 0xffff);
+        u32* pim_noalias tiles = tmp_malloc(sizeof(tiles[0]) * count);
+        // walk the Morton curve of the enclosing power of two grid,
+        // keeping the tiles that lie within the image
+        i32 back = 0;
+        for (u32 m = 0; back < count; ++m)
+        {
+            const u32 x = MortonCompact(m);
+            const u32 y = MortonCompact(m >> 1);
+            if ((x < (u32)tilesX) && (y < (u32)tilesY))
+            {
+                tiles[back++] = x | (y << 16);
+            }
+        }
+        st.tileCount = count;
+        st.tiles = tiles;
+    }
+
+    ProfileEnd(pm_new);
+    return st;
+}
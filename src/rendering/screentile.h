@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common/macro.h"
+#include "math/types.h"
+
+PIM_C_BEGIN
+
+// Screen space work decomposition:
+// splits an image into kScreenTile x kScreenTile tiles visited in Morton
+// order, with the pixels of each tile in Morton order as well, so that a
+// contiguous task range covers a compact block of the screen.
+// Task indices map to pixels through screentiles_texel.
+
+#define kScreenTileShift 3
+#define kScreenTile (1 << kScreenTileShift)
+#define kScreenTileArea (kScreenTile * kScreenTile)
+
+typedef struct screentiles_s
+{
+    int2 size;              // image size in pixels
+    i32 tileCount;
+    const u32* pim_noalias tiles;   // tile coordinates, x | (y << 16)
+} screentiles_t;
+
+// tile list is temp allocated, valid for the current frame
+screentiles_t screentiles_new(int2 size);
+
+pim_inline i32 screentiles_tilecount(int2 size)
+{
+    const i32 tilesX = (size.x + kScreenTile - 1) >> kScreenTileShift;
+    const i32 tilesY = (size.y + kScreenTile - 1) >> kScreenTileShift;
+    return tilesX * tilesY;
+}
+
+// gathers the even bits of a Morton code
+pim_inline u32 MortonCompact(u32 x)
+{
+    x &= 0x55555555u;
+    x = (x ^ (x >> 1)) & 0x33333333u;
+    x = (x ^ (x >> 2)) & 0x0f0f0f0fu;
+    x = (x ^ (x >> 4)) & 0x00ff00ffu;
+    x = (x ^ (x >> 8)) & 0x0000ffffu;
+    return x;
+}
+
+// task work size covering every tile
+pim_inline i32 screentiles_worksize(const screentiles_t* st)
+{
+    return st->tileCount * kScreenTileArea;
+}
+
+// index into the tile list of work item i
+pim_inline i32 screentiles_tile(i32 i)
+{
+    return i >> (2 * kScreenTileShift);
+}
+
+// row major pixel index of work item i, or -1 past the edge of the image
+pim_inline i32 screentiles_texel(const screentiles_t* st, i32 i)
+{
+    const u32 tile = st->tiles[screentiles_tile(i)];
+    const u32 m = (u32)i & (kScreenTileArea - 1);
+    const i32 x = (i32)(((tile & 0xffff) << kScreenTileShift) + MortonCompact(m));
+    const i32 y = (i32)(((tile >> 16) << kScreenTileShift) + MortonCompact(m >> 1));
+    if ((x >= st->size.x) || (y >= st->size.y))
+    {
+        return -1;
+    }
+    return x + y * st->size.x;
+}
+
+PIM_C_END
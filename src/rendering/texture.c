@@ -4,6 +4,7 @@
 #include "math/color.h"
 #include "math/blending.h"
 #include "rendering/sampler.h"
+#include "rendering/mipmap.h"
 #include "assets/asset_system.h"
 #include "quake/q_bspfile.h"
 #include "stb/stb_image.h"
@@ -12,13 +13,23 @@
 #include "ui/cimgui_ext.h"
 #include "common/sort.h"
 #include "common/profiler.h"
+#include "common/cvar.h"
+#include "common/cmd.h"
+#include "common/console.h"
+#include "common/random.h"
+#include "common/time.h"
 #include "io/fstr.h"
 #include <glad/glad.h>
 #include <string.h>
+#include <stdlib.h>
+
+static cvar_t cv_r_texture_tiled = { cvart_bool, 0, "r_texture_tiled", "1", "store newly loaded textures in cache friendly 4x4 tiles" };
 
 static table_t ms_table;
 static u8 ms_palette[256 * 3];
 
+static cmdstat_t CmdSamplerBench(i32 argc, const char** argv);
+
 pim_inline genid ToGenId(textureid_t tid)
 {
     genid gid;
@@ -46,8 +57,82 @@ static void FreeTexture(texture_t* tex)
     memset(tex, 0, sizeof(*tex));
 }
 
+ProfileMark(pm_tile, TileTexture)
+static void TileTexture(texture_t* tex)
+{
+    if ((tex->layout != TexLayout_Linear) || !cvar_get_bool(&cv_r_texture_tiled))
+    {
+        return;
+    }
+    const int2 size = tex->size;
+    const i32 mipCount = CalcMipCount(size);
+    if (mipCount > kTexMaxMips)
+    {
+        return;
+    }
+    ProfileBegin(pm_tile);
+
+    const u32* pim_noalias src = tex->texels;
+    u32* pim_noalias dst = perm_calloc(sizeof(dst[0]) * TiledMipChainLen(size));
+    for (i32 m = 0; m < mipCount; ++m)
+    {
+        const int2 mipSize = CalcMipSize(size, m);
+        const u32* pim_noalias mipSrc = src + CalcMipOffset(size, m);
+        // samplers index these instead of summing the smaller mips per tap
+        tex->mipOffsets[m] = CalcTiledMipOffset(size, m);
+        u32* pim_noalias mipDst = dst + tex->mipOffsets[m];
+        for (i32 y = 0; y < mipSize.y; ++y)
+        {
+            for (i32 x = 0; x < mipSize.x; ++x)
+            {
+                int2 coord = { x, y };
+                mipDst[CoordToTiledIndex(mipSize, coord)] = mipSrc[CoordToIndex(mipSize, coord)];
+            }
+        }
+    }
+
+    pim_free(tex->texels);
+    tex->texels = dst;
+    tex->layout = TexLayout_Tiled;
+
+    ProfileEnd(pm_tile);
+}
+
+// row major copy of the mip chain, for consumers that need the linear layout
+static u32* LinearTexels(const texture_t* tex, EAlloc allocator)
+{
+    const int2 size = tex->size;
+    const i32 len = MipChainLen(size);
+    u32* pim_noalias dst = pim_malloc(allocator, sizeof(dst[0]) * len);
+    if (tex->layout != TexLayout_Tiled)
+    {
+        memcpy(dst, tex->texels, sizeof(dst[0]) * len);
+        return dst;
+    }
+
+    const i32 mipCount = CalcMipCount(size);
+    const u32* pim_noalias src = tex->texels;
+    for (i32 m = 0; m < mipCount; ++m)
+    {
+        const int2 mipSize = CalcMipSize(size, m);
+        const u32* pim_noalias mipSrc = src + tex->mipOffsets[m];
+        u32* pim_noalias mipDst = dst + CalcMipOffset(size, m);
+        for (i32 y = 0; y < mipSize.y; ++y)
+        {
+            for (i32 x = 0; x < mipSize.x; ++x)
+            {
+                int2 coord = { x, y };
+                mipDst[CoordToIndex(mipSize, coord)] = mipSrc[CoordToTiledIndex(mipSize, coord)];
+            }
+        }
+    }
+    return dst;
+}
+
 void texture_sys_init(void)
 {
+    cvar_reg(&cv_r_texture_tiled);
+    cmd_reg("sampler_bench", CmdSamplerBench);
     table_new(&ms_table, sizeof(texture_t));
 
     asset_t asset = { 0 };
@@ -90,7 +175,8 @@ bool texture_loadat(const char* path, textureid_t* idOut)
     {
         texture_t tex = { 0 };
         tex.size = (int2) { width, height };
-        tex.texels = texels;
+        tex.texels = perm_realloc(texels, sizeof(texels[0]) * mipmap_len(tex.size));
+        mipmap_c32(tex.texels, tex.size);
         guid_t name = guid_str(path, guid_seed);
         return texture_new(&tex, name, idOut);
     }
@@ -109,6 +195,7 @@ bool texture_new(texture_t* tex, guid_t name, textureid_t* idOut)
     genid id = { 0, 0 };
     if (tex->texels)
     {
+        TileTexture(tex);
         added = table_add(&ms_table, name, tex, &id);
         ASSERT(added);
     }
@@ -149,6 +236,7 @@ bool texture_set(textureid_t id, texture_t* src)
     ASSERT(src);
     if (IsCurrent(id))
     {
+        TileTexture(src);
         texture_t* dst = ms_table.values;
         dst += id.index;
         FreeTexture(dst);
@@ -174,7 +262,9 @@ bool texture_getname(textureid_t tid, guid_t* nameOut)
     return table_getname(&ms_table, gid, nameOut);
 }
 
-#define kTextureVersion 1
+// 1: mip 0 only
+// 2: full mip chain
+#define kTextureVersion 2
 
 bool texture_save(textureid_t tid, guid_t* dst)
 {
@@ -187,19 +277,22 @@ bool texture_save(textureid_t tid, guid_t* dst)
         {
             const texture_t* textures = ms_table.values;
             const texture_t texture = textures[tid.index];
-            const i32 len = texture.size.x * texture.size.y;
+            const i32 len = mipmap_len(texture.size);
             const i32 version = kTextureVersion;
+            // files are always linear, the layout is a runtime choice
+            u32* texels = LinearTexels(&texture, EAlloc_Perm);
             fstr_write(fd, &version, sizeof(version));
             fstr_write(fd, &texture.size, sizeof(texture.size));
-            fstr_write(fd, texture.texels, sizeof(texture.texels[0]) * len);
+            fstr_write(fd, texels, sizeof(texels[0]) * len);
             fstr_close(&fd);
+            pim_free(texels);
             return true;
         }
     }
     return false;
 }
 
-bool texture_load(guid_t name, textureid_t* dst)
+bool texture_load(guid_t name, bool isNormal, textureid_t* dst)
 {
     bool loaded = false;
 
@@ -211,14 +304,29 @@ bool texture_load(guid_t name, textureid_t* dst)
         texture_t texture = { 0 };
         i32 version = 0;
         fstr_read(fd, &version, sizeof(version));
-        if (version == kTextureVersion)
+        if ((version == 1) || (version == kTextureVersion))
         {
             fstr_read(fd, &texture.size, sizeof(texture.size));
             if ((texture.size.x > 0) && (texture.size.y > 0))
             {
-                const i32 len = texture.size.x * texture.size.y;
+                const i32 len = mipmap_len(texture.size);
                 texture.texels = perm_malloc(sizeof(texture.texels[0]) * len);
-                fstr_read(fd, texture.texels, sizeof(texture.texels[0]) * len);
+                if (version == 1)
+                {
+                    fstr_read(fd, texture.texels, sizeof(texture.texels[0]) * texture.size.x * texture.size.y);
+                    if (isNormal)
+                    {
+                        mipmap_dir8(texture.texels, texture.size);
+                    }
+                    else
+                    {
+                        mipmap_c32(texture.texels, texture.size);
+                    }
+                }
+                else
+                {
+                    fstr_read(fd, texture.texels, sizeof(texture.texels[0]) * len);
+                }
                 loaded = texture_new(&texture, name, dst);
             }
         }
@@ -347,9 +455,9 @@ bool texture_unpalette(
         const bool isLight = StrIStr(name, 16, "light");
         const bool fullEmit = isSky || isTeleport || isWindow;
 
-        u32* pim_noalias albedo = perm_malloc(len * sizeof(albedo[0]));
-        u32* pim_noalias rome = perm_malloc(len * sizeof(rome[0]));
-        u32* pim_noalias normal = perm_malloc(len * sizeof(normal[0]));
+        u32* pim_noalias albedo = mipmap_new_c32(size, EAlloc_Perm);
+        u32* pim_noalias rome = mipmap_new_c32(size, EAlloc_Perm);
+        u32* pim_noalias normal = mipmap_new_c32(size, EAlloc_Perm);
 
         float2* pim_noalias gray = perm_malloc(len * sizeof(gray[0]));
 
@@ -419,6 +527,10 @@ bool texture_unpalette(
         pim_free(gray);
         gray = NULL;
 
+        mipmap_c32(albedo, size);
+        mipmap_c32(rome, size);
+        mipmap_dir8(normal, size);
+
         texture_t albedoMap = { 0 };
         albedoMap.size = size;
         albedoMap.texels = albedo;
@@ -507,12 +619,12 @@ static void igTexture(const texture_t* tex)
 
     const i32 width = tex->size.x;
     const i32 height = tex->size.y;
-    const u32* texels = tex->texels;
-    if (!texels)
+    if (!tex->texels)
     {
         ASSERT(false);
         return;
     }
+    u32* texels = LinearTexels(tex, EAlloc_Perm);
 
     glBindTexture(GL_TEXTURE_2D, gs_texHandle);
     ASSERT(!glGetError());
@@ -534,6 +646,7 @@ static void igTexture(const texture_t* tex)
         GL_UNSIGNED_BYTE,           // type
         texels);                    // data
     ASSERT(!glGetError());
+    pim_free(texels);
 
     glBindTexture(GL_TEXTURE_2D, 0);
     ASSERT(!glGetError());
@@ -673,3 +786,118 @@ void texture_sys_gui(bool* pEnabled)
 
     ProfileEnd(pm_OnGui);
 }
+
+// ----------------------------------------------------------------------------
+// sampler_bench: times the reference and SAMPLER_SIMD bilinear kernels on
+// the same random texels, so the comparison excludes texel fetch latency.
+
+typedef enum
+{
+    BenchKernel_c32,
+    BenchKernel_dir8,
+    BenchKernel_f4,
+
+    BenchKernel_COUNT
+} BenchKernel;
+
+static const char* const kBenchKernelNames[] =
+{
+    "c32",
+    "dir8",
+    "f4",
+};
+SASSERT(NELEM(kBenchKernelNames) == BenchKernel_COUNT);
+
+static double BenchKernelMs(
+    BenchKernel kernel,
+    bool reference,
+    const u32* pim_noalias texels,
+    const float4* pim_noalias colors,
+    const float2* pim_noalias fracs,
+    i32 count,
+    float4* pim_noalias sumOut)
+{
+    float4 sum = f4_0;
+    const u64 begin = time_now();
+    for (i32 i = 0; i < count; ++i)
+    {
+        const u32* t = texels + i * 4;
+        const float4* c = colors + i * 4;
+        float4 value;
+        switch (kernel)
+        {
+        default:
+        case BenchKernel_c32:
+            value = reference ?
+                Blend_c32_Ref(t[0], t[1], t[2], t[3], fracs[i]) :
+                Blend_c32(t[0], t[1], t[2], t[3], fracs[i]);
+            break;
+        case BenchKernel_dir8:
+            value = reference ?
+                Blend_dir8_Ref(t[0], t[1], t[2], t[3], fracs[i]) :
+                Blend_dir8(t[0], t[1], t[2], t[3], fracs[i]);
+            break;
+        case BenchKernel_f4:
+            value = reference ?
+                Blend_f4_Ref(c + 0, c + 1, c + 2, c + 3, fracs[i]) :
+                Blend_f4(c + 0, c + 1, c + 2, c + 3, fracs[i]);
+            break;
+        }
+        sum = f4_add(sum, value);
+    }
+    const u64 end = time_now();
+    *sumOut = sum;
+    return time_milli(end - begin);
+}
+
+static cmdstat_t CmdSamplerBench(i32 argc, const char** argv)
+{
+    i32 count = 1 << 20;
+    if (argc > 1)
+    {
+        count = atoi(argv[1]);
+    }
+    if (count <= 0)
+    {
+        con_logf(LogSev_Error, "cmd", "usage: sampler_bench [taps]");
+        return cmdstat_err;
+    }
+
+    u32* texels = perm_malloc(sizeof(texels[0]) * count * 4);
+    float4* colors = perm_malloc(sizeof(colors[0]) * count * 4);
+    float2* fracs = perm_malloc(sizeof(fracs[0]) * count);
+    prng_t rng = prng_get();
+    for (i32 i = 0; i < count * 4; ++i)
+    {
+        texels[i] = prng_u32(&rng);
+        colors[i] = ColorToLinear(texels[i]);
+    }
+    for (i32 i = 0; i < count; ++i)
+    {
+        fracs[i] = f2_v(prng_f32(&rng), prng_f32(&rng));
+    }
+    prng_set(rng);
+
+    con_logf(LogSev_Info, "sampler", "%d taps, simd: %s", count, SAMPLER_SIMD ? "sse" : "none");
+    for (i32 k = 0; k < BenchKernel_COUNT; ++k)
+    {
+        float4 refSum, simdSum;
+        double refMs = BenchKernelMs(k, true, texels, colors, fracs, count, &refSum);
+        double simdMs = BenchKernelMs(k, false, texels, colors, fracs, count, &simdSum);
+        float avgError = f4_hmax(f4_abs(f4_sub(refSum, simdSum))) / count;
+        con_logf(
+            LogSev_Info,
+            "sampler",
+            "%s: ref %.3fms, simd %.3fms, %.2fx, avg error %g",
+            kBenchKernelNames[k],
+            refMs,
+            simdMs,
+            refMs / f1_max((float)simdMs, 1e-6f),
+            avgError);
+    }
+
+    pim_free(texels);
+    pim_free(colors);
+    pim_free(fracs);
+    return cmdstat_ok;
+}
@@ -17,10 +17,23 @@ typedef struct dtextureid_s
     guid_t id;
 } dtextureid_t;
 
+typedef enum
+{
+    TexLayout_Linear,       // row major mips, see CalcMipOffset
+    TexLayout_Tiled,        // tiled mips, see CalcTiledMipOffset
+
+    TexLayout_COUNT
+} TexLayout;
+
+// textures larger than 32k texels on a side are never tiled
+#define kTexMaxMips 16
+
 typedef struct texture_s
 {
-    int2 size;
-    u32* pim_noalias texels;
+    int2 size;              // size of mip 0
+    u32* pim_noalias texels;// full mip chain
+    TexLayout layout;
+    i32 mipOffsets[kTexMaxMips]; // tiled only, texel offset of each mip
 } texture_t;
 
 void texture_sys_init(void);
@@ -30,6 +43,8 @@ void texture_sys_shutdown(void);
 void texture_sys_gui(bool* pEnabled);
 
 bool texture_loadat(const char* path, textureid_t* idOut);
+// takes ownership of tex->texels, which must hold the full mip chain.
+// linear textures are converted to the tiled layout when r_texture_tiled is set.
 bool texture_new(texture_t* tex, guid_t name, textureid_t* idOut);
 
 bool texture_exists(textureid_t id);
@@ -38,13 +53,15 @@ void texture_retain(textureid_t id);
 void texture_release(textureid_t id);
 
 bool texture_get(textureid_t id, texture_t* dst);
+// same ownership and layout conversion as texture_new
 bool texture_set(textureid_t id, texture_t* src);
 
 bool texture_find(guid_t name, textureid_t* idOut);
 bool texture_getname(textureid_t id, guid_t* nameOut);
 
 bool texture_save(textureid_t tid, guid_t* dst);
-bool texture_load(guid_t name, textureid_t* dst);
+// isNormal: v1 files store mip 0 only, their mips are rebuilt as directions
+bool texture_load(guid_t name, bool isNormal, textureid_t* dst);
 
 bool texture_unpalette(
     const u8* bytes,
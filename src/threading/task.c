@@ -1,84 +1,405 @@
 #include "threading/task.h"
 
 #include "threading/thread.h"
-#include "threading/event.h"
+#include "threading/semaphore.h"
 #include "threading/intrin.h"
 #include "threading/sleep.h"
 #include "common/atomics.h"
-#include "containers/ptrqueue.h"
+#include "common/random.h"
 #include "allocator/allocator.h"
 #include "common/profiler.h"
 
 #include <string.h>
 
+// smallest number of chunks each thread should see of a task
+#define kSplitsPerThread    8
+// must be a power of 2
+#define kDequeCapacity      1024
+#define kDequeMask          (kDequeCapacity - 1)
+// idle attempts to find work before parking
+#define kSpinLimit          16
+// idle attempts that pause (exponentially) before yielding
+#define kSpinPauseLimit     10
+// task status holds the parked awaiter's tid + 1 above this bit
+#define kAwaiterShift       8
+#define kStatusMask         ((1 << kAwaiterShift) - 1)
+
 typedef struct range_s
 {
+    task_t* task;
     i32 begin;
     i32 end;
 } range_t;
 
+// Chase-Lev work stealing deque.
+// https://www.dre.vanderbilt.edu/~schmidt/PDF/work-stealing-dequeue.pdf
+// The owning thread pushes and pops at the bottom,
+// other threads steal from the top.
+// Fixed capacity: push fails instead of growing.
+typedef pim_alignas(64) struct deque_s
+{
+    i32 top;
+    i32 bottom;
+    range_t* ptr;
+} deque_t;
+
+typedef enum
+{
+    ParkState_Parked = -1,
+    ParkState_Empty = 0,
+    ParkState_Notified = 1,
+} ParkState;
+
+// futex-style parking spot with a single wake token.
+// an unpark before a park is not lost, the park returns immediately.
+typedef pim_alignas(64) struct parker_s
+{
+    i32 state;
+    semaphore_t sema;
+} parker_t;
+
 // ----------------------------------------------------------------------------
 
 static i32 ms_numthreads;
 static i32 ms_numThreadsRunning;
 static i32 ms_numThreadsSleeping;
 static i32 ms_running;
-static event_t ms_waitPush;
 static thread_t ms_threads[kMaxThreads];
-static ptrqueue_t ms_queues[kMaxThreads];
+static deque_t ms_deques[kMaxThreads];
+static parker_t ms_parkers[kMaxThreads];
+// bit set per thread that is looking for work and may be parked
+static u64 ms_idleMask[kMaxThreads / 64];
 
 static pim_thread_local i32 ms_tid;
+static pim_thread_local prng_t ms_rng;
+// workers wanted by tasks submitted since the last task_sys_schedule
+static pim_thread_local i32 ms_wakeDebt;
 
 // ----------------------------------------------------------------------------
 
 static i32 min_i32(i32 a, i32 b) { return (a < b) ? a : b; }
 static i32 max_i32(i32 a, i32 b) { return (a > b) ? a : b; }
 
-static i32 StealWork(task_t* task, range_t* range, i32 gran)
+static void deque_create(deque_t* dq)
 {
-    const i32 wsize = task->worksize;
-    const i32 a = fetch_add_i32(&(task->head), gran, MO_Acquire);
-    const i32 b = min_i32(a + gran, wsize);
-    range->begin = a;
-    range->end = b;
-    return a < b;
+    dq->top = 0;
+    dq->bottom = 0;
+    dq->ptr = perm_calloc(sizeof(dq->ptr[0]) * kDequeCapacity);
+}
+
+static void deque_destroy(deque_t* dq)
+{
+    pim_free(dq->ptr);
+    dq->ptr = NULL;
+    dq->top = 0;
+    dq->bottom = 0;
+}
+
+static bool deque_empty(const deque_t* dq)
+{
+    const i32 b = load_i32(&(dq->bottom), MO_Relaxed);
+    const i32 t = load_i32(&(dq->top), MO_Relaxed);
+    return b <= t;
+}
+
+// owner only
+static bool deque_push(deque_t* dq, range_t range)
+{
+    const i32 b = load_i32(&(dq->bottom), MO_Relaxed);
+    const i32 t = load_i32(&(dq->top), MO_Acquire);
+    if ((b - t) >= kDequeCapacity)
+    {
+        return false;
+    }
+    dq->ptr[b & kDequeMask] = range;
+    store_i32(&(dq->bottom), b + 1, MO_Release);
+    return true;
+}
+
+// owner only
+static bool deque_pop(deque_t* dq, range_t* range)
+{
+    const i32 b = load_i32(&(dq->bottom), MO_Relaxed) - 1;
+    // seq_cst exchange orders the bottom store before the top load
+    exch_i32(&(dq->bottom), b, MO_SeqCst);
+    i32 t = load_i32(&(dq->top), MO_SeqCst);
+    if (t > b)
+    {
+        // empty
+        store_i32(&(dq->bottom), b + 1, MO_Relaxed);
+        return false;
+    }
+    *range = dq->ptr[b & kDequeMask];
+    if (t == b)
+    {
+        // last item, race against thieves for it
+        const bool won = cmpex_i32(&(dq->top), &t, t + 1, MO_SeqCst);
+        store_i32(&(dq->bottom), b + 1, MO_Relaxed);
+        return won;
+    }
+    return true;
 }
 
-static i32 UpdateProgress(task_t* task, range_t range)
+// any thread
+static bool deque_steal(deque_t* dq, range_t* range)
+{
+    i32 t = load_i32(&(dq->top), MO_SeqCst);
+    const i32 b = load_i32(&(dq->bottom), MO_SeqCst);
+    if (t < b)
+    {
+        // slot t cannot be overwritten until top moves past it,
+        // so a torn read here is always discarded by the failed cmpex.
+        const range_t item = dq->ptr[t & kDequeMask];
+        if (cmpex_i32(&(dq->top), &t, t + 1, MO_SeqCst))
+        {
+            *range = item;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+
+static void Park(i32 tid)
+{
+    parker_t* parker = ms_parkers + tid;
+    if (dec_i32(&(parker->state), MO_AcqRel) == ParkState_Notified)
+    {
+        // consumed a pending token
+        return;
+    }
+    semaphore_wait(parker->sema);
+    store_i32(&(parker->state), ParkState_Empty, MO_Release);
+}
+
+static void Unpark(i32 tid)
+{
+    parker_t* parker = ms_parkers + tid;
+    if (exch_i32(&(parker->state), ParkState_Notified, MO_AcqRel) == ParkState_Parked)
+    {
+        semaphore_signal(parker->sema, 1);
+    }
+}
+
+static void SetIdle(i32 tid)
+{
+    const u64 bit = 1ull << (tid & 63);
+    fetch_or_u64(ms_idleMask + (tid >> 6), bit, MO_SeqCst);
+}
+
+static void ClearIdle(i32 tid)
+{
+    const u64 bit = 1ull << (tid & 63);
+    fetch_and_u64(ms_idleMask + (tid >> 6), ~bit, MO_AcqRel);
+}
+
+// wakes up to 'count' idle threads, returns the number woken.
+// call after publishing work: a thread that marks itself idle
+// after this point is guaranteed to see that work before parking.
+static i32 WakeIdle(i32 count)
+{
+    if (count <= 0)
+    {
+        return 0;
+    }
+
+    ThreadFenceSeqCst();
+
+    i32 woken = 0;
+    for (i32 w = 0; (w < NELEM(ms_idleMask)) && (woken < count); ++w)
+    {
+        u64 mask = load_u64(ms_idleMask + w, MO_Relaxed);
+        for (i32 b = 0; mask && (woken < count); ++b)
+        {
+            const u64 bit = 1ull << b;
+            if (mask & bit)
+            {
+                // claim the bit so that concurrent wakers pick other threads
+                const u64 prev = fetch_and_u64(ms_idleMask + w, ~bit, MO_AcqRel);
+                if (prev & bit)
+                {
+                    Unpark(w * 64 + b);
+                    ++woken;
+                }
+                mask &= ~bit;
+            }
+        }
+    }
+    return woken;
+}
+
+// number of threads besides the submitter that can be kept busy
+static i32 WorkersWanted(const task_t* task)
+{
+    const i32 grain = task->grain;
+    const i32 chunks = (task->worksize + grain - 1) / grain;
+    return min_i32(chunks, ms_numthreads) - 1;
+}
+
+static void Backoff(i32 spins)
+{
+    if (spins < kSpinPauseLimit)
+    {
+        const i32 pauses = 1 << spins;
+        for (i32 i = 0; i < pauses; ++i)
+        {
+            intrin_pause();
+        }
+    }
+    else
+    {
+        intrin_yield();
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+static void MarkComplete(task_t* task);
+static void ExecRange(deque_t* dq, range_t range);
+
+static i32 UpdateProgress(task_t* task, i32 count)
 {
     const i32 wsize = task->worksize;
-    const i32 count = range.end - range.begin;
     const i32 prev = fetch_add_i32(&(task->tail), count, MO_Release);
     ASSERT(prev < wsize);
     return (prev + count) >= wsize;
 }
 
+// pushes a task whose predecessors have all completed
+static void Release(task_t* task)
+{
+    if (task->worksize > 0)
+    {
+        deque_t* dq = ms_deques + ms_tid;
+        const range_t range = { task, 0, task->worksize };
+        // a node queued behind other work would otherwise wait for this
+        // thread even when it has no range worth splitting (worksize 1).
+        const bool behind = !deque_empty(dq);
+        if (deque_push(dq, range))
+        {
+            const i32 wanted = WorkersWanted(task);
+            WakeIdle(behind ? max_i32(1, wanted) : wanted);
+        }
+        else
+        {
+            // deque is full, nothing more to be gained from parallelism
+            ExecRange(dq, range);
+        }
+    }
+    else
+    {
+        // empty node, exists only to join its predecessors
+        MarkComplete(task);
+    }
+}
+
 static void MarkComplete(task_t* task)
 {
-    store_i32(&(task->status), TaskStatus_Complete, MO_Release);
+    // the owner may reuse the task as soon as it is marked complete,
+    // read the continuations out first. the succs array itself stays
+    // valid until every node of its graph has completed.
+    task_t** succs = task->succs;
+    const i32 succcount = task->succcount;
+
+    const i32 prev = exch_i32(&(task->status), TaskStatus_Complete, MO_SeqCst);
+    const i32 awaiter = prev >> kAwaiterShift;
+    if (awaiter)
+    {
+        Unpark(awaiter - 1);
+    }
+
+    for (i32 i = 0; i < succcount; ++i)
+    {
+        task_t* succ = succs[i];
+        if (dec_i32(&(succ->depcount), MO_AcqRel) == 1)
+        {
+            Release(succ);
+        }
+    }
 }
 
-static i32 TryRunTask(i32 tid)
+static void Prepare(task_t* task, task_execute_fn execute, i32 worksize)
 {
     const i32 numthreads = ms_numthreads;
-    const i32 tasksplit = numthreads * (numthreads >> 1);
+    const i32 grain = max_i32(1, worksize / (numthreads * kSplitsPerThread));
 
-    task_t* task = ptrqueue_trypop(ms_queues + tid);
-    if (task)
+    store_i32(&(task->status), TaskStatus_Exec, MO_Release);
+    task->execute = execute;
+    task->grain = grain;
+    store_i32(&(task->worksize), worksize, MO_Release);
+    store_i32(&(task->tail), 0, MO_Release);
+}
+
+// lazy binary splitting:
+// only expose more parallelism when our own deque has run dry,
+// otherwise chew through the range one grain at a time.
+// https://www.cs.rice.edu/~vs3/PDF/tzannes-ppopp10.pdf
+static void ExecRange(deque_t* dq, range_t range)
+{
+    task_t* task = range.task;
+    const task_execute_fn fn = task->execute;
+    const i32 grain = task->grain;
+    i32 begin = range.begin;
+    i32 end = range.end;
+    while (begin < end)
     {
-        const i32 gran = max_i32(1, task->worksize / tasksplit);
-        const task_execute_fn fn = task->execute;
-        range_t range;
-        while (StealWork(task, &range, gran))
+        if (((end - begin) > grain) && deque_empty(dq))
         {
-            fn(task, range.begin, range.end);
-            if (UpdateProgress(task, range))
+            const i32 mid = begin + ((end - begin) >> 1);
+            const range_t upper = { task, mid, end };
+            if (deque_push(dq, upper))
             {
-                MarkComplete(task);
+                end = mid;
+                WakeIdle(1);
             }
         }
+
+        const i32 stop = min_i32(begin + grain, end);
+        fn(task, begin, stop);
+        if (UpdateProgress(task, stop - begin))
+        {
+            MarkComplete(task);
+        }
+        begin = stop;
     }
-    return task != NULL;
+}
+
+static bool TrySteal(i32 tid, range_t* range)
+{
+    const i32 numthreads = ms_numthreads;
+    const i32 first = (i32)(prng_u32(&ms_rng) % (u32)numthreads);
+    for (i32 i = 0; i < numthreads; ++i)
+    {
+        i32 victim = first + i;
+        victim = (victim >= numthreads) ? (victim - numthreads) : victim;
+        if (victim != tid)
+        {
+            deque_t* dq = ms_deques + victim;
+            if (deque_steal(dq, range))
+            {
+                if (!deque_empty(dq))
+                {
+                    // more where that came from, pass it along
+                    WakeIdle(1);
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static i32 TryRunTask(i32 tid)
+{
+    deque_t* dq = ms_deques + tid;
+    range_t range;
+    if (deque_pop(dq, &range) || TrySteal(tid, &range))
+    {
+        ExecRange(dq, range);
+        return 1;
+    }
+    return 0;
 }
 
 static i32 TaskLoop(void* arg)
@@ -88,14 +409,32 @@ static i32 TaskLoop(void* arg)
     const i32 tid = (i32)((isize)arg);
     ASSERT(tid);
     ms_tid = tid;
+    ms_rng = prng_create();
 
+    i32 spins = 0;
     while (load_i32(&ms_running, MO_Relaxed))
     {
-        if (!TryRunTask(tid))
+        if (TryRunTask(tid))
         {
-            inc_i32(&ms_numThreadsSleeping, MO_Acquire);
-            event_wait(&ms_waitPush);
-            dec_i32(&ms_numThreadsSleeping, MO_Release);
+            spins = 0;
+        }
+        else if (spins < kSpinLimit)
+        {
+            // an owner may split its range shortly
+            Backoff(spins++);
+        }
+        else
+        {
+            spins = 0;
+            SetIdle(tid);
+            // anything published before SetIdle is visible here
+            if (!TryRunTask(tid) && load_i32(&ms_running, MO_Acquire))
+            {
+                inc_i32(&ms_numThreadsSleeping, MO_Acquire);
+                Park(tid);
+                dec_i32(&ms_numThreadsSleeping, MO_Release);
+            }
+            ClearIdle(tid);
         }
     }
 
@@ -125,7 +464,7 @@ i32 task_num_active(void)
 TaskStatus task_stat(const task_t* task)
 {
     ASSERT(task);
-    return (TaskStatus)load_i32(&(task->status), MO_Acquire);
+    return (TaskStatus)(load_i32(&(task->status), MO_Acquire) & kStatusMask);
 }
 
 ProfileMark(pm_submit, task_submit)
@@ -137,26 +476,59 @@ void task_submit(task_t* task, task_execute_fn execute, i32 worksize)
 
         ASSERT(execute);
         task_await(task);
-        store_i32(&(task->status), TaskStatus_Exec, MO_Release);
-        task->execute = execute;
-        store_i32(&(task->worksize), worksize, MO_Release);
-        store_i32(&(task->head), 0, MO_Release);
-        store_i32(&(task->tail), 0, MO_Release);
-
-        const i32 numthreads = ms_numthreads;
-        ptrqueue_t* pim_noalias queues = ms_queues;
-        for (i32 t = 0; t < numthreads; ++t)
+
+        task->depcount = 0;
+        task->succcount = 0;
+        task->succs = NULL;
+        Prepare(task, execute, worksize);
+
+        // the submitting thread owns the initial range,
+        // idle workers will steal and split it from there.
+        deque_t* dq = ms_deques + ms_tid;
+        const range_t range = { task, 0, worksize };
+        if (deque_push(dq, range))
         {
-            if (!ptrqueue_trypush(queues + t, task))
-            {
-                INTERRUPT();
-            }
+            ms_wakeDebt += WorkersWanted(task);
+        }
+        else
+        {
+            // deque is full, nothing more to be gained from parallelism
+            ExecRange(dq, range);
         }
 
         ProfileEnd(pm_submit);
     }
 }
 
+// Parks until the task completes or new work shows up.
+// The awaiter's tid is swapped into the task status, so that
+// completion and registration cannot miss each other.
+static void ParkOnTask(i32 tid, const task_t* task)
+{
+    volatile i32* status = (volatile i32*)&(task->status);
+    const i32 waiting = TaskStatus_Exec | ((tid + 1) << kAwaiterShift);
+    i32 expected = TaskStatus_Exec;
+    if (!cmpex_i32(status, &expected, waiting, MO_SeqCst))
+    {
+        // completed, or another thread is already parked on it
+        intrin_yield();
+        return;
+    }
+
+    SetIdle(tid);
+    if (!TryRunTask(tid) && (task_stat(task) == TaskStatus_Exec))
+    {
+        inc_i32(&ms_numThreadsSleeping, MO_Acquire);
+        Park(tid);
+        dec_i32(&ms_numThreadsSleeping, MO_Release);
+    }
+    ClearIdle(tid);
+
+    // deregister, fails harmlessly if the task completed
+    expected = waiting;
+    cmpex_i32(status, &expected, TaskStatus_Exec, MO_SeqCst);
+}
+
 ProfileMark(pm_await, task_await)
 void task_await(const task_t* task)
 {
@@ -165,19 +537,23 @@ void task_await(const task_t* task)
         ProfileBegin(pm_await);
 
         const i32 tid = ms_tid;
-        u64 spins = 0;
+        task_sys_schedule();
+
+        i32 spins = 0;
         while (task_stat(task) == TaskStatus_Exec)
         {
             if (TryRunTask(tid))
             {
                 spins = 0;
             }
+            else if (spins < kSpinLimit)
+            {
+                Backoff(spins++);
+            }
             else
             {
-                // trying to wait on an event here sometimes introduces
-                // a permanently slept main thread.
-                // so instead we do a few spins then yield.
-                intrin_spin(++spins);
+                spins = 0;
+                ParkOnTask(tid, task);
             }
         }
 
@@ -203,32 +579,184 @@ void task_run(task_t* task, task_execute_fn fn, i32 worksize)
     }
 }
 
+// ----------------------------------------------------------------------------
+
+void taskgraph_new(taskgraph_t* tg, EAlloc allocator)
+{
+    ASSERT(tg);
+    memset(tg, 0, sizeof(*tg));
+    graph_new(&(tg->graph), allocator);
+    tg->allocator = allocator;
+}
+
+void taskgraph_del(taskgraph_t* tg)
+{
+    if (tg)
+    {
+        // a completing node still walks its succs after waking the
+        // awaiter, only free them once the whole graph has completed.
+        taskgraph_await(tg);
+        const i32 len = graph_size(&(tg->graph));
+        for (i32 i = 0; i < len; ++i)
+        {
+            task_t* task = tg->tasks[i];
+            pim_free(task->succs);
+            task->succs = NULL;
+            task->succcount = 0;
+        }
+        graph_del(&(tg->graph));
+        pim_free(tg->tasks);
+        pim_free(tg->fns);
+        pim_free(tg->worksizes);
+        memset(tg, 0, sizeof(*tg));
+    }
+}
+
+i32 taskgraph_add(taskgraph_t* tg, task_t* task, task_execute_fn fn, i32 worksize)
+{
+    ASSERT(tg);
+    ASSERT(task);
+    ASSERT(fn);
+    ASSERT(worksize >= 0);
+
+    const i32 i = graph_addvert(&(tg->graph));
+    const i32 len = i + 1;
+    tg->tasks = pim_realloc(tg->allocator, tg->tasks, sizeof(tg->tasks[0]) * len);
+    tg->fns = pim_realloc(tg->allocator, tg->fns, sizeof(tg->fns[0]) * len);
+    tg->worksizes = pim_realloc(tg->allocator, tg->worksizes, sizeof(tg->worksizes[0]) * len);
+    tg->tasks[i] = task;
+    tg->fns[i] = fn;
+    tg->worksizes[i] = worksize;
+    return i;
+}
+
+void taskgraph_depend(taskgraph_t* tg, i32 iBefore, i32 iAfter)
+{
+    ASSERT(tg);
+    ASSERT(iBefore != iAfter);
+    graph_addedge(&(tg->graph), iBefore, iAfter);
+}
+
+ProfileMark(pm_tgsubmit, taskgraph_submit)
+void taskgraph_submit(taskgraph_t* tg)
+{
+    ASSERT(tg);
+    const i32 len = graph_size(&(tg->graph));
+    if (len <= 0)
+    {
+        return;
+    }
+
+    ProfileBegin(pm_tgsubmit);
+
+    task_t** tasks = tg->tasks;
+    const EAlloc allocator = tg->allocator;
+
+    // also asserts that the graph is acyclic
+    i32* order = tmp_malloc(sizeof(order[0]) * len);
+    graph_sort(&(tg->graph), order, len);
+
+    // see taskgraph_del: await everything before freeing any succs
+    taskgraph_await(tg);
+    for (i32 i = 0; i < len; ++i)
+    {
+        task_t* task = tasks[i];
+        pim_free(task->succs);
+        task->succs = NULL;
+        task->succcount = 0;
+        task->depcount = 0;
+    }
+
+    // edges are stored on the dependent vertex, invert them into continuations
+    for (i32 i = 0; i < len; ++i)
+    {
+        i32 edgeCount = 0;
+        const i32* edges = graph_edges(&(tg->graph), i, &edgeCount);
+        tasks[i]->depcount = edgeCount;
+        for (i32 j = 0; j < edgeCount; ++j)
+        {
+            task_t* pred = tasks[edges[j]];
+            const i32 back = pred->succcount++;
+            pred->succs = pim_realloc(allocator, pred->succs, sizeof(pred->succs[0]) * (back + 1));
+            pred->succs[back] = tasks[i];
+        }
+    }
+
+    // every node must be fully prepared before any root can run,
+    // since a root may release its continuations immediately.
+    for (i32 i = 0; i < len; ++i)
+    {
+        const i32 iVert = order[i];
+        Prepare(tasks[iVert], tg->fns[iVert], tg->worksizes[iVert]);
+    }
+
+    // push in reverse topological order so that the owner pops the
+    // earliest roots first.
+    for (i32 i = len - 1; i >= 0; --i)
+    {
+        task_t* task = tasks[order[i]];
+        if (task->depcount == 0)
+        {
+            Release(task);
+        }
+    }
+
+    ProfileEnd(pm_tgsubmit);
+}
+
+void taskgraph_await(const taskgraph_t* tg)
+{
+    ASSERT(tg);
+    const i32 len = graph_size(&(tg->graph));
+    for (i32 i = 0; i < len; ++i)
+    {
+        task_await(tg->tasks[i]);
+    }
+}
+
+void taskgraph_run(taskgraph_t* tg)
+{
+    taskgraph_submit(tg);
+    taskgraph_await(tg);
+}
+
+// ----------------------------------------------------------------------------
+
 ProfileMark(pm_schedule, task_sys_schedule)
 void task_sys_schedule(void)
 {
-    ProfileBegin(pm_schedule);
+    const i32 debt = ms_wakeDebt;
+    if (debt > 0)
+    {
+        ProfileBegin(pm_schedule);
 
-    event_wakeall(&ms_waitPush);
+        ms_wakeDebt = 0;
+        WakeIdle(debt);
 
-    ProfileEnd(pm_schedule);
+        ProfileEnd(pm_schedule);
+    }
 }
 
 void task_sys_init(void)
 {
     intrin_clockres_begin(1);
-    event_create(&ms_waitPush);
     store_i32(&ms_running, 1, MO_Release);
 
     const i32 numthreads = thread_hardware_count();
     ms_numthreads = numthreads;
+    ms_rng = prng_create();
+
+    for (i32 t = 0; t < numthreads; ++t)
+    {
+        deque_create(ms_deques + t);
+        ms_parkers[t].state = ParkState_Empty;
+        semaphore_create(&(ms_parkers[t].sema), 0);
+    }
 
-    const i32 kQueueSize = 64;
-    ptrqueue_create(ms_queues + 0, EAlloc_Perm, kQueueSize);
     thread_set_priority(NULL, 1);
     thread_set_aff(NULL, 1ull << 0);
     for (i32 t = 1; t < numthreads; ++t)
     {
-        ptrqueue_create(ms_queues + t, EAlloc_Perm, kQueueSize);
         thread_create(ms_threads + t, TaskLoop, (void*)((isize)t));
         thread_set_priority(ms_threads + t, 1);
         thread_set_aff(ms_threads + t, 1ull << t);
@@ -243,23 +771,30 @@ void task_sys_update(void)
 void task_sys_shutdown(void)
 {
     store_i32(&ms_running, 0, MO_Release);
+    const i32 numthreads = ms_numthreads;
     while (load_i32(&ms_numThreadsRunning, MO_Acquire) > 0)
     {
-        event_wakeall(&ms_waitPush);
+        for (i32 t = 1; t < numthreads; ++t)
+        {
+            Unpark(t);
+        }
         intrin_yield();
     }
-    const i32 numthreads = ms_numthreads;
     for (i32 t = 1; t < numthreads; ++t)
     {
         thread_join(ms_threads + t);
-        ptrqueue_destroy(ms_queues + t);
     }
-    ptrqueue_destroy(ms_queues + 0);
+    for (i32 t = 0; t < numthreads; ++t)
+    {
+        deque_destroy(ms_deques + t);
+        semaphore_destroy(&(ms_parkers[t].sema));
+    }
 
-    event_destroy(&ms_waitPush);
     intrin_clockres_end(1);
 
     memset(ms_threads, 0, sizeof(ms_threads));
-    memset(ms_queues, 0, sizeof(ms_queues));
+    memset(ms_deques, 0, sizeof(ms_deques));
+    memset(ms_parkers, 0, sizeof(ms_parkers));
+    memset(ms_idleMask, 0, sizeof(ms_idleMask));
     ms_numthreads = 0;
 }
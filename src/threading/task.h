@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common/macro.h"
+#include "containers/graph.h"
 
 PIM_C_BEGIN
 
@@ -18,10 +19,24 @@ typedef struct task_s
     task_execute_fn execute;
     i32 status;
     i32 worksize;
-    i32 head;
+    i32 grain;
     i32 tail;
+    i32 depcount;               // unfinished predecessors
+    i32 succcount;
+    struct task_s** succs;      // released once this task completes
 } task_t;
 
+// a DAG of tasks, submitted as a unit.
+// tasks begin executing as soon as all of their predecessors complete.
+typedef struct taskgraph_s
+{
+    graph_t graph;
+    task_t** tasks;
+    task_execute_fn* fns;
+    i32* worksizes;
+    EAlloc allocator;
+} taskgraph_t;
+
 i32 task_thread_id(void);
 i32 task_thread_ct(void);
 i32 task_num_active(void);
@@ -33,6 +48,15 @@ i32 task_poll(const task_t* task);
 
 void task_run(task_t* task, task_execute_fn fn, i32 worksize);
 
+void taskgraph_new(taskgraph_t* tg, EAlloc allocator);
+void taskgraph_del(taskgraph_t* tg);
+i32 taskgraph_add(taskgraph_t* tg, task_t* task, task_execute_fn fn, i32 worksize);
+// iAfter will not begin until iBefore completes
+void taskgraph_depend(taskgraph_t* tg, i32 iBefore, i32 iAfter);
+void taskgraph_submit(taskgraph_t* tg);
+void taskgraph_await(const taskgraph_t* tg);
+void taskgraph_run(taskgraph_t* tg);
+
 void task_sys_schedule(void);
 
 void task_sys_init(void);